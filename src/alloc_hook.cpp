@@ -0,0 +1,42 @@
+// Replacements for the global allocation functions, built into tim2core only
+// with the TIM2DUMP_ALLOC_HOOK option. They allocate through the counted
+// malloc family of alloc_stats, so --stats sees every operator new. The
+// aligned (std::align_val_t) forms keep the library's versions; nothing in
+// tim2dump allocates over-aligned types.
+
+#include "alloc_stats.h"
+#include <new>
+
+namespace {
+
+void* allocate(std::size_t size) {
+    if (size == 0) size = 1;
+    for (;;) {
+        if (void* block = tim2::alloc::countedMalloc(size)) return block;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) throw std::bad_alloc();
+        handler();
+    }
+}
+
+void* allocate(std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return allocate(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+} // namespace
+
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+void* operator new(std::size_t size, const std::nothrow_t& tag) noexcept { return allocate(size, tag); }
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept { return allocate(size, tag); }
+
+void operator delete(void* block) noexcept { tim2::alloc::countedFree(block); }
+void operator delete[](void* block) noexcept { tim2::alloc::countedFree(block); }
+void operator delete(void* block, std::size_t) noexcept { tim2::alloc::countedFree(block); }
+void operator delete[](void* block, std::size_t) noexcept { tim2::alloc::countedFree(block); }
+void operator delete(void* block, const std::nothrow_t&) noexcept { tim2::alloc::countedFree(block); }
+void operator delete[](void* block, const std::nothrow_t&) noexcept { tim2::alloc::countedFree(block); }
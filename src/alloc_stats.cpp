@@ -0,0 +1,261 @@
+#include "alloc_stats.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace tim2 {
+namespace alloc {
+
+std::atomic<bool> g_enabled{false};
+
+namespace {
+
+struct ThreadTotals {
+    std::array<std::atomic<uint64_t>, kPhaseSlots> allocations{};
+    std::array<std::atomic<uint64_t>, kPhaseSlots> bytes{};
+    std::array<std::atomic<uint64_t>, kPhaseSlots> peakLiveBytes{};
+};
+
+// Like the phase totals, owned here so that exited threads still count.
+// Never destroyed: operator delete may still report during static
+// destruction.
+struct Registry {
+    std::mutex mutex;
+    std::vector<ThreadTotals*> threads;
+};
+
+Registry& registry() {
+    static Registry* instance = new Registry;
+    return *instance;
+}
+
+// Plain data only, so it needs no constructor or destructor and is usable
+// from operator new at any point in a thread's life
+struct ThreadState {
+    ThreadTotals* totals;
+    uint8_t slot;
+    bool busy;    // Inside the accounting itself: its own allocations are not counted
+    int64_t live; // Allocated minus freed on this thread
+    int64_t start;
+    int64_t peak;
+};
+
+thread_local ThreadState t_state{nullptr, kOutside, false, 0, 0, 0};
+
+std::atomic<int64_t> g_live{0};
+std::atomic<int64_t> g_peak{0};
+
+ThreadTotals& threadTotals() {
+    if (!t_state.totals) {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.threads.push_back(new ThreadTotals);
+        t_state.totals = reg.threads.back();
+    }
+    return *t_state.totals;
+}
+
+// Only the owning thread writes, so a plain load/store pair is enough
+void add(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+void raise(std::atomic<uint64_t>& counter, uint64_t value) {
+    if (value > counter.load(std::memory_order_relaxed)) counter.store(value, std::memory_order_relaxed);
+}
+
+// Prefix of every block from countedMalloc/countedRealloc. Only blocks
+// allocated while counting is on are charged when they are freed, so
+// objects made before enable() cannot drive the live totals negative.
+// 16 bytes keep the payload aligned for any fundamental type.
+struct alignas(16) BlockHeader {
+    uint64_t size;
+    uint64_t counted;
+};
+
+static_assert(sizeof(BlockHeader) == 16, "block header must keep malloc alignment");
+
+BlockHeader* headerOf(void* block) {
+    return static_cast<BlockHeader*>(block) - 1;
+}
+
+/**
+ * Charge one block to the current slot and raise the peaks. The busy flag
+ * keeps the first call on a thread, which registers its totals (and so
+ * allocates), from recursing; blocks allocated meanwhile are not charged.
+ */
+bool charge(size_t bytes) {
+    ThreadState& state = t_state;
+    if (!enabled() || state.busy) return false;
+    state.busy = true;
+
+    ThreadTotals& totals = threadTotals();
+    add(totals.allocations[state.slot], 1);
+    add(totals.bytes[state.slot], bytes);
+
+    state.live += static_cast<int64_t>(bytes);
+    if (state.live - state.start > state.peak) state.peak = state.live - state.start;
+
+    const int64_t live = g_live.fetch_add(static_cast<int64_t>(bytes), std::memory_order_relaxed) +
+                         static_cast<int64_t>(bytes);
+    int64_t peak = g_peak.load(std::memory_order_relaxed);
+    while (live > peak && !g_peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+
+    state.busy = false;
+    return true;
+}
+
+} // namespace
+
+bool hooked() {
+#ifdef TIM2DUMP_ALLOC_HOOK
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool enable() {
+    if (!hooked()) return false;
+    g_live.store(0, std::memory_order_relaxed);
+    g_peak.store(0, std::memory_order_relaxed);
+    g_enabled.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+void recordAllocation(size_t bytes) {
+    charge(bytes);
+}
+
+// Frees of charged blocks are recorded even while busy, as this does not
+// allocate
+void recordFree(size_t bytes) {
+    t_state.live -= static_cast<int64_t>(bytes);
+    g_live.fetch_sub(static_cast<int64_t>(bytes), std::memory_order_relaxed);
+}
+
+void* countedMalloc(size_t size) {
+    if (size > SIZE_MAX - sizeof(BlockHeader)) return nullptr;
+    auto* header = static_cast<BlockHeader*>(std::malloc(sizeof(BlockHeader) + size));
+    if (!header) return nullptr;
+    header->size = size;
+    header->counted = charge(size);
+    return header + 1;
+}
+
+void* countedRealloc(void* block, size_t size) {
+    if (!block) return countedMalloc(size);
+    if (size > SIZE_MAX - sizeof(BlockHeader)) return nullptr;
+
+    const BlockHeader before = *headerOf(block);
+    auto* header = static_cast<BlockHeader*>(std::realloc(headerOf(block), sizeof(BlockHeader) + size));
+    if (!header) return nullptr;
+    if (before.counted) recordFree(before.size);
+    header->size = size;
+    header->counted = charge(size);
+    return header + 1;
+}
+
+void countedFree(void* block) {
+    if (!block) return;
+    BlockHeader* header = headerOf(block);
+    if (header->counted) recordFree(header->size);
+    std::free(header);
+}
+
+Report collect() {
+    Report report{};
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    for (const ThreadTotals* totals : reg.threads) {
+        for (size_t s = 0; s < kPhaseSlots; ++s) {
+            report[s].allocations += totals->allocations[s].load(std::memory_order_relaxed);
+            report[s].bytes += totals->bytes[s].load(std::memory_order_relaxed);
+            report[s].peakLiveBytes = std::max(report[s].peakLiveBytes,
+                                               totals->peakLiveBytes[s].load(std::memory_order_relaxed));
+        }
+    }
+    return report;
+}
+
+uint64_t heapPeakBytes() {
+    return static_cast<uint64_t>(g_peak.load(std::memory_order_relaxed));
+}
+
+uint64_t peakRssBytes() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+#ifdef __linux__
+    // VmHWM follows clear_refs resets, ru_maxrss does not
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmHWM:", 0) == 0) {
+            return std::stoull(line.substr(6)) * 1024;
+        }
+    }
+#endif
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+bool resetPeakRss() {
+#ifdef __linux__
+    std::ofstream clear("/proc/self/clear_refs");
+    return static_cast<bool>(clear << "5" << std::flush);
+#else
+    return false;
+#endif
+}
+
+ScopeState enterPhase(size_t slot) {
+    ThreadState& state = t_state;
+    const ScopeState saved{state.slot, state.start, state.peak};
+    state.slot = static_cast<uint8_t>(slot);
+    state.start = state.live;
+    state.peak = 0;
+    return saved;
+}
+
+/**
+ * Record the peak of the scope being left, then hand it to the enclosing
+ * scope, for which it counts from where the inner scope started.
+ */
+void leavePhase(const ScopeState& saved) {
+    ThreadState& state = t_state;
+    state.busy = true;
+    raise(threadTotals().peakLiveBytes[state.slot], static_cast<uint64_t>(state.peak));
+    state.busy = false;
+
+    const int64_t inner = state.start - saved.start + state.peak;
+    state.slot = saved.slot;
+    state.start = saved.start;
+    state.peak = std::max(saved.peak, inner);
+}
+
+} // namespace alloc
+} // namespace tim2
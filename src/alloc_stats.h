@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace tim2 {
+namespace alloc {
+
+// Heap accounting for --stats.
+//
+// With the TIM2DUMP_ALLOC_HOOK build option (on by default) the global
+// operator new and delete (alloc_hook.cpp) go through the counted malloc
+// family below, which the PNG encoder uses as well; other allocators can
+// report through recordAllocation/recordFree. Each allocation is charged to
+// the innermost stats::Scope of the allocating thread, or to the last slot
+// when no scope is open. Counted blocks carry their requested size and
+// whether they were charged, so only blocks allocated after enable() are
+// subtracted when freed.
+//
+// Allocation counts and bytes are exclusive, like phase times. The peak of
+// a phase is the most one of its scopes, nested scopes included, raised its
+// thread's live heap: what a worker needs to run that phase once.
+
+constexpr size_t kPhaseSlots = 8;       // stats::Phase values, then "outside phases"
+constexpr size_t kOutside = kPhaseSlots - 1;
+
+struct PhaseTotals {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+    uint64_t peakLiveBytes = 0;
+};
+
+using Report = std::array<PhaseTotals, kPhaseSlots>;
+
+extern std::atomic<bool> g_enabled;
+
+inline bool enabled() {
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+// Whether operator new is hooked (TIM2DUMP_ALLOC_HOOK)
+bool hooked();
+
+// Start counting; false if nothing would be counted because the hook is
+// not built in
+bool enable();
+
+// For other allocators: report only frees of blocks that were reported
+// while enabled(), or the live totals drift
+void recordAllocation(size_t bytes);
+void recordFree(size_t bytes);
+
+// malloc/realloc/free that report to the current phase. The blocks have a
+// 16-byte header: free them only with countedFree.
+void* countedMalloc(size_t size);
+void* countedRealloc(void* block, size_t size);
+void countedFree(void* block);
+
+// Sum of every thread's totals so far
+Report collect();
+
+// Most bytes live at once over all threads in blocks allocated since
+// enable()
+uint64_t heapPeakBytes();
+
+// Peak resident set size of the process; 0 if unknown
+uint64_t peakRssBytes();
+
+// Restart the peak RSS from the current RSS. Only Linux can (clear_refs);
+// elsewhere the peak covers the whole process lifetime.
+bool resetPeakRss();
+
+// What stats::Scope saves on entry and hands back on exit
+struct ScopeState {
+    uint8_t slot = kOutside;
+    int64_t start = 0;
+    int64_t peak = 0;
+};
+
+ScopeState enterPhase(size_t slot);
+void leavePhase(const ScopeState& saved);
+
+} // namespace alloc
+} // namespace tim2
@@ -0,0 +1,136 @@
+#include "batch_journal.h"
+#include <sstream>
+
+#ifndef TIM2DUMP_VERSION
+#define TIM2DUMP_VERSION "unknown"
+#endif
+
+namespace fs = std::filesystem;
+
+namespace tim2 {
+
+std::vector<ManifestOutput> BatchJournal::SourceState::outputList() const {
+    std::vector<ManifestOutput> list;
+    list.reserve(outputs.size());
+    for (const auto& [key, path] : outputs) {
+        list.push_back({key.first, key.second, path});
+    }
+    return list;
+}
+
+BatchJournal::BatchJournal(std::string optionsKey)
+    : m_optionsKey(std::move(optionsKey)) {
+}
+
+std::string BatchJournal::headerLine() const {
+    return std::string("tim2dump-journal\t1\t") + TIM2DUMP_VERSION + "\t" + m_optionsKey;
+}
+
+/**
+ * Parse a journal. Lines are only ever appended, so the last one may be cut
+ * short by the crash; an incomplete or unparsable line ends the read instead
+ * of failing it. A later "P" for the same export replaces the earlier one.
+ */
+bool BatchJournal::load(const fs::path& file) {
+    m_sources.clear();
+
+    std::ifstream in(file);
+    if (!in) {
+        m_lastError = "No journal at " + file.string();
+        return false;
+    }
+
+    std::string line;
+    if (!std::getline(in, line) || line != headerLine()) {
+        m_lastError = "Journal was written by another version or with other options";
+        return false;
+    }
+
+    while (std::getline(in, line)) {
+        if (in.eof()) break;  // No trailing newline: the write was interrupted
+
+        std::istringstream fields(line);
+        std::string tag, source, picture, mip, path;
+        if (!std::getline(fields, tag, '\t') || !std::getline(fields, source, '\t') ||
+            !std::getline(fields, picture, '\t')) {
+            break;
+        }
+
+        try {
+            if (tag == "P" && std::getline(fields, mip, '\t') && std::getline(fields, path)) {
+                m_sources[source].outputs[{std::stoull(picture), std::stoull(mip)}] = path;
+            } else if (tag == "D" && std::getline(fields, mip)) {
+                m_sources[source].done.insert({std::stoull(picture), std::stoull(mip)});
+            } else {
+                break;
+            }
+        } catch (const std::exception&) {
+            break;
+        }
+    }
+
+    return true;
+}
+
+const BatchJournal::SourceState* BatchJournal::find(const std::string& source) const {
+    auto it = m_sources.find(source);
+    return it != m_sources.end() ? &it->second : nullptr;
+}
+
+bool BatchJournal::open(const fs::path& file, bool append) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_path = file;
+
+    std::error_code ec;
+    const bool writeHeader = !append || !fs::exists(file, ec);
+    m_out.open(file, append ? std::ios::app : std::ios::trunc);
+    if (!m_out) {
+        m_lastError = "Failed to open journal " + file.string();
+        return false;
+    }
+
+    if (writeHeader) {
+        m_out << headerLine() << "\n" << std::flush;
+    }
+    return true;
+}
+
+/**
+ * Sources or outputs whose paths cannot be stored are left out, as in the
+ * manifest: one such line would end load() early and lose every later
+ * record. A resumed run exports those sources again.
+ */
+void BatchJournal::planned(const std::string& source, const std::vector<ManifestOutput>& outputs) {
+    if (!isStorablePath(source)) return;
+    for (const auto& output : outputs) {
+        if (!isStorablePath(output.path)) return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_out.is_open()) return;
+
+    for (const auto& output : outputs) {
+        m_out << "P\t" << source << "\t" << output.picture << "\t" << output.mip << "\t" << output.path << "\n";
+    }
+    m_out.flush();
+}
+
+void BatchJournal::done(const std::string& source, size_t picture, size_t mip) {
+    if (!isStorablePath(source)) return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_out.is_open()) return;
+
+    m_out << "D\t" << source << "\t" << picture << "\t" << mip << "\n" << std::flush;
+}
+
+void BatchJournal::finish() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_out.is_open()) return;
+
+    m_out.close();
+    std::error_code ec;
+    fs::remove(m_path, ec);
+}
+
+} // namespace tim2
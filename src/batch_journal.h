@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include "batch_manifest.h"
+
+namespace tim2 {
+
+// Append-only record of a batch run in progress, for --resume.
+//
+// "P" lines record the output name planned for every export of a source, "D"
+// lines record exports that are completely on disk (written to a temp file
+// and renamed). Lines are flushed as they are added, so a killed process
+// leaves a usable journal; a run that completes deletes it.
+class BatchJournal {
+public:
+    static constexpr const char* kFileName = ".tim2dump-journal";
+
+    // What an interrupted run left for one source
+    struct SourceState {
+        std::map<std::pair<size_t, size_t>, std::string> outputs;  // (picture, mip) -> path
+        std::set<std::pair<size_t, size_t>> done;
+
+        bool complete() const {
+            if (outputs.empty()) return false;
+            for (const auto& [key, path] : outputs) {
+                if (done.count(key) == 0) return false;
+            }
+            return true;
+        }
+        std::vector<ManifestOutput> outputList() const;
+    };
+
+    // Options that change output bytes, as for BatchManifest
+    explicit BatchJournal(std::string optionsKey);
+
+    // Read a previous run's journal; false if missing or written with other options
+    bool load(const std::filesystem::path& file);
+    const SourceState* find(const std::string& source) const;
+
+    // Start recording; appends to an existing journal when resuming
+    bool open(const std::filesystem::path& file, bool append);
+
+    // Thread-safe appends (paths relative to the output root)
+    void planned(const std::string& source, const std::vector<ManifestOutput>& outputs);
+    void done(const std::string& source, size_t picture, size_t mip);
+
+    // Close and delete the journal after a completed run
+    void finish();
+
+    const std::string& getLastError() const { return m_lastError; }
+
+private:
+    std::string m_optionsKey;
+    std::map<std::string, SourceState> m_sources;  // Loaded state (read-only while running)
+
+    std::mutex m_mutex;
+    std::ofstream m_out;
+    std::filesystem::path m_path;
+    std::string m_lastError;
+
+    std::string headerLine() const;
+};
+
+} // namespace tim2
@@ -0,0 +1,168 @@
+#include "batch_manifest.h"
+#include <fstream>
+#include <sstream>
+
+#ifndef TIM2DUMP_VERSION
+#define TIM2DUMP_VERSION "unknown"
+#endif
+
+namespace fs = std::filesystem;
+
+namespace tim2 {
+
+bool isStorablePath(const std::string& path) {
+    return !path.empty() && path.find_first_of("\t\r\n") == std::string::npos;
+}
+
+BatchManifest::BatchManifest(std::string optionsKey)
+    : m_optionsKey(std::move(optionsKey)) {
+}
+
+std::string BatchManifest::headerPrefix() {
+    return std::string("tim2dump-manifest\t1\t") + TIM2DUMP_VERSION + "\t";
+}
+
+std::string BatchManifest::headerLine() const {
+    return headerPrefix() + m_optionsKey;
+}
+
+/**
+ * Parse a manifest written by save(). Anything unexpected (other version,
+ * other options, malformed lines) discards the whole file: the worst case is
+ * a full re-export, never a skipped file that should have been redone.
+ */
+bool BatchManifest::load(const fs::path& file) {
+    m_entries.clear();
+
+    std::ifstream in(file);
+    if (!in) {
+        m_lastError = "No manifest at " + file.string();
+        return false;
+    }
+
+    std::string line;
+    if (!std::getline(in, line)) {
+        m_lastError = "Empty manifest: " + file.string();
+        return false;
+    }
+    if (m_optionsKey.empty() && line.compare(0, headerPrefix().size(), headerPrefix()) == 0) {
+        m_optionsKey = line.substr(headerPrefix().size());
+    }
+    if (line != headerLine()) {
+        m_lastError = "Manifest was written by another version or with other options";
+        return false;
+    }
+
+    ManifestEntry* current = nullptr;
+    while (std::getline(in, line)) {
+        if (line.empty()) continue;
+
+        std::istringstream fields(line);
+        std::string tag;
+        std::getline(fields, tag, '\t');
+
+        bool ok = false;
+        if (tag == "F") {
+            ManifestEntry entry;
+            std::string size, mtime, hash;
+            if (std::getline(fields, size, '\t') && std::getline(fields, mtime, '\t') &&
+                std::getline(fields, hash, '\t') && std::getline(fields, entry.source)) {
+                try {
+                    entry.size = std::stoull(size);
+                    entry.mtime = std::stoll(mtime);
+                    entry.hash = std::stoull(hash, nullptr, 16);
+                    ok = true;
+                } catch (const std::exception&) {
+                }
+            }
+            if (ok) {
+                std::string source = entry.source;
+                current = &(m_entries[source] = std::move(entry));
+            }
+        } else if (tag == "O" && current) {
+            ManifestOutput output;
+            std::string picture, mip;
+            if (std::getline(fields, picture, '\t') && std::getline(fields, mip, '\t') &&
+                std::getline(fields, output.path)) {
+                try {
+                    output.picture = std::stoull(picture);
+                    output.mip = std::stoull(mip);
+                    current->outputs.push_back(std::move(output));
+                    ok = true;
+                } catch (const std::exception&) {
+                }
+            }
+        }
+
+        if (!ok) {
+            m_entries.clear();
+            m_lastError = "Malformed manifest line: " + line;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool BatchManifest::save(const fs::path& file) const {
+    const fs::path temp = file.string() + ".tmp";
+
+    {
+        std::ofstream out(temp, std::ios::trunc);
+        if (!out) {
+            m_lastError = "Failed to create " + temp.string();
+            return false;
+        }
+
+        out << headerLine() << "\n";
+        for (const auto& [source, entry] : m_entries) {
+            out << "F\t" << entry.size << "\t" << entry.mtime << "\t"
+                << std::hex << entry.hash << std::dec << "\t" << source << "\n";
+            for (const auto& output : entry.outputs) {
+                out << "O\t" << output.picture << "\t" << output.mip << "\t" << output.path << "\n";
+            }
+        }
+
+        if (!out.good()) {
+            m_lastError = "Failed to write " + temp.string();
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(temp, file, ec);
+    if (ec) {
+        m_lastError = "Failed to replace " + file.string() + ": " + ec.message();
+        fs::remove(temp, ec);
+        return false;
+    }
+    return true;
+}
+
+const ManifestEntry* BatchManifest::find(const std::string& source) const {
+    auto it = m_entries.find(source);
+    return it != m_entries.end() ? &it->second : nullptr;
+}
+
+/**
+ * Add or replace an entry. Sources or outputs whose paths cannot be stored
+ * are left out, so they are simply exported again next time.
+ */
+void BatchManifest::set(ManifestEntry entry) {
+    if (!isStorablePath(entry.source)) return;
+    for (const auto& output : entry.outputs) {
+        if (!isStorablePath(output.path)) {
+            m_entries.erase(entry.source);
+            return;
+        }
+    }
+
+    std::string source = entry.source;
+    m_entries[source] = std::move(entry);
+}
+
+void BatchManifest::erase(const std::string& source) {
+    m_entries.erase(source);
+}
+
+} // namespace tim2
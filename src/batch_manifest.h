@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace tim2 {
+
+// One exported image of a manifest entry
+struct ManifestOutput {
+    size_t picture = 0;
+    size_t mip = 0;
+    std::string path;  // Relative to the output root, '/'-separated
+};
+
+// What a source file looked like when it was last exported, and what it produced
+struct ManifestEntry {
+    std::string source;  // Relative to the input root, '/'-separated
+    uintmax_t size = 0;
+    int64_t mtime = 0;   // filesystem::file_time_type ticks
+    uint64_t hash = 0;   // Hash64 of the whole file
+    std::vector<ManifestOutput> outputs;
+};
+
+// Paths are stored verbatim in tab-separated lines, so ones containing a tab
+// or line break cannot be recorded
+bool isStorablePath(const std::string& path);
+
+// Incremental batch state, kept as a small text file in the output root.
+//
+// The first line records the tool version and the options that affect the
+// exported bytes; a manifest written under different ones is ignored as a
+// whole. Each source is one tab-separated "F" line followed by its "O" lines.
+class BatchManifest {
+public:
+    static constexpr const char* kFileName = ".tim2dump-manifest";
+
+    // Options that change output bytes, e.g. "format=png". An empty key
+    // accepts whatever options the loaded file was written with.
+    explicit BatchManifest(std::string optionsKey);
+
+    // Load a previous manifest; a missing or incompatible file leaves it empty
+    bool load(const std::filesystem::path& file);
+    const std::string& optionsKey() const { return m_optionsKey; }
+
+    // Write atomically (temp file + rename)
+    bool save(const std::filesystem::path& file) const;
+
+    const ManifestEntry* find(const std::string& source) const;
+    void set(ManifestEntry entry);
+    void erase(const std::string& source);
+
+    const std::map<std::string, ManifestEntry>& entries() const { return m_entries; }
+    const std::string& getLastError() const { return m_lastError; }
+
+private:
+    std::string m_optionsKey;
+    std::map<std::string, ManifestEntry> m_entries;  // Sorted, so saves are stable
+    mutable std::string m_lastError;
+
+    std::string headerLine() const;
+    static std::string headerPrefix();
+};
+
+} // namespace tim2
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "tim2_types.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace tim2 {
+
+// One picture/mip level to export, sized from its headers.
+// Costs are rough nanosecond estimates from BatchPlanner's cost model; they
+// only need to rank tasks, not predict wall time exactly.
+struct PlannedExport {
+    size_t picture = 0;
+    size_t mip = 0;
+    size_t mipLevels = 1;       // Mip levels of the picture (for naming)
+    size_t width = 0;
+    size_t height = 0;
+    PixelFormat pixelFormat = TIM2_NONE;
+    uint64_t decodeCost = 0;
+    uint64_t encodeCost = 0;
+    std::string outputFilename;
+
+    uint64_t cost() const { return decodeCost + encodeCost; }
+};
+
+// One input file and everything it will export
+struct PlannedFile {
+    std::filesystem::path path;
+    std::filesystem::path outputDir;
+    uintmax_t fileSize = 0;
+    bool headersValid = false;  // false: loadFile will report the error
+    size_t pictureCount = 0;
+    uint64_t readCost = 0;      // Read + parse estimate
+    uint64_t peakMemory = 0;    // Bytes held while the file is converted (estimate)
+    std::vector<PlannedExport> exports;
+
+    uint64_t cost() const;
+};
+
+// Header-derived cost estimates and largest-first (LPT) ordering for batch runs
+class BatchPlanner {
+public:
+    // Read the file's headers and fill in its exports and cost estimates.
+    // Output names are left empty; the caller assigns them in discovery order.
+    static void planFile(PlannedFile& file, const std::string& format);
+
+    // Indices into files, largest estimated cost first (ties keep discovery order)
+    static std::vector<size_t> largestFirst(const std::vector<PlannedFile>& files);
+
+    // Simulated makespan of dispatching every export largest-first on `threads` workers
+    static uint64_t estimateMakespan(const std::vector<PlannedFile>& files, size_t threads);
+
+    // Sum of all estimated work (read, decode and encode)
+    static uint64_t totalCost(const std::vector<PlannedFile>& files);
+};
+
+} // namespace tim2
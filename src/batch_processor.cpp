@@ -0,0 +1,1530 @@
+#include "batch_processor.h"
+#include "image_converter.h"
+#include "thread_pool.h"
+#include "table_formatter.h"
+#include "directory_walker.h"
+#include "directory_watcher.h"
+#include "utils.h"
+#include "hash.h"
+#include "phase_stats.h"
+#include "trace_recorder.h"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+namespace tim2 {
+
+namespace {
+
+// Waits shorter than this did not really block and are left out of --trace
+constexpr uint64_t kTraceWaitNanos = 10000;
+
+// Stage queue operations, shown as wait spans in --trace when they block
+template<typename Queue>
+auto tracedPop(Queue& queue, const char* span) {
+    trace::Span wait(span, "wait", kTraceWaitNanos);
+    return queue.pop();
+}
+
+template<typename Queue, typename T>
+bool tracedPush(Queue& queue, T&& value, const char* span) {
+    trace::Span wait(span, "wait", kTraceWaitNanos);
+    return queue.push(std::forward<T>(value));
+}
+
+uint64_t elapsedNanos(std::chrono::steady_clock::time_point start) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now() - start).count());
+}
+
+// Hash a whole file in fixed-size chunks
+bool hashFile(const fs::path& path, uint64_t& hash) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    Hash64 hasher;
+    std::vector<char> chunk(1 << 16);
+    while (file.read(chunk.data(), chunk.size()) || file.gcount() > 0) {
+        hasher.update(chunk.data(), static_cast<size_t>(file.gcount()));
+    }
+    if (file.bad()) return false;
+
+    hash = hasher.digest();
+    return true;
+}
+
+} // namespace
+
+BatchProcessor::BatchProcessor(BatchOptions options)
+    : m_options(std::move(options)) {
+    std::random_device random;
+    char tag[32];
+    std::snprintf(tag, sizeof(tag), "%08x%08x", random(), random());
+    m_tempTag = tag;
+}
+
+std::string BatchProcessor::tempPath(const std::string& output) const {
+    return output + "." + m_tempTag + kTempSuffix;
+}
+
+bool BatchProcessor::hasTIM2Extension(const fs::path& path) {
+    auto ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+                 [](unsigned char c){ return std::tolower(c); });
+
+    return ext == ".tim2" || ext == ".tm2";
+}
+
+/**
+ * Walker filter, run on scan threads. Cheap checks go first: globs on the
+ * path relative to the input root, then the size limits (from the directory
+ * entry, usually no extra syscall), then either the extension or, with
+ * detectContent, a single 16-byte header read.
+ */
+bool BatchProcessor::acceptFile(const fs::directory_entry& entry) const {
+    if (!matchesFilters(entry)) return false;
+
+    if (m_options.detectContent) {
+        return TIM2Parser::probeFile(entry.path().string());
+    }
+    return hasTIM2Extension(entry.path());
+}
+
+bool BatchProcessor::matchesFilters(const fs::directory_entry& entry) const {
+    if (!m_options.includePatterns.empty() || !m_options.excludePatterns.empty()) {
+        const std::string relative = entry.path().lexically_relative(m_inputPath).generic_string();
+
+        for (const auto& pattern : m_options.excludePatterns) {
+            if (utils::globMatch(pattern, relative)) return false;
+        }
+
+        if (!m_options.includePatterns.empty()) {
+            bool included = false;
+            for (const auto& pattern : m_options.includePatterns) {
+                if (utils::globMatch(pattern, relative)) {
+                    included = true;
+                    break;
+                }
+            }
+            if (!included) return false;
+        }
+    }
+
+    if (m_options.minFileSize > 0 || m_options.maxFileSize > 0) {
+        std::error_code ec;
+        const uintmax_t size = entry.file_size(ec);
+        if (ec) return false;
+        if (size < m_options.minFileSize) return false;
+        if (m_options.maxFileSize > 0 && size > m_options.maxFileSize) return false;
+    }
+
+    return true;
+}
+
+/**
+ * Run the batch:
+ *   1) Scan the input tree in parallel; each listed directory's files are
+ *      planned from their headers and named as a group, then queued
+ *   2) Stream queued files through the read/convert/write pipeline, largest
+ *      first, while the scan is still going
+ *   3) Print the summary
+ *
+ * With planOnly, wait for the whole scan and print the plan instead.
+ */
+int BatchProcessor::run() {
+    m_inputPath = fs::path(m_options.inputPath);
+
+    if (!fs::exists(m_inputPath)) {
+        std::cerr << "Error: Input path does not exist: " << m_options.inputPath << "\n";
+        return 1;
+    }
+
+    if (!fs::is_directory(m_inputPath)) {
+        std::cerr << "Error: Input path is not a directory: " << m_options.inputPath << "\n";
+        return 1;
+    }
+
+    m_useOutputFolder = !m_options.outputFolder.empty();
+    if (m_useOutputFolder) {
+        m_outputRoot = fs::path(m_options.outputFolder);
+    }
+
+    // Prepare output directory if specified
+    if (m_useOutputFolder && !m_options.planOnly) {
+        try {
+            fs::create_directories(m_outputRoot);
+        } catch (const std::exception& e) {
+            std::cerr << "Error creating output directory: " << e.what() << "\n";
+            return 1;
+        }
+    }
+
+    m_entries.clear();
+    m_pending.clear();
+    m_finished.clear();
+    m_discoveryDone = false;
+    m_outputNames.clear();
+    m_outputNames.setTempSuffix(kTempSuffix);
+    m_unchanged.clear();
+    m_resumed.clear();
+    m_manifest.reset();
+    m_journal.reset();
+    m_interrupted.reset();
+    m_dedup.reset();
+    m_stateRoot = m_useOutputFolder ? m_outputRoot : m_inputPath;
+
+    const std::string optionsKey = "format=" + m_options.format;
+
+    if (m_options.dedup) {
+        m_dedup = std::make_unique<DedupIndex>();
+    }
+
+    m_counters.reset();
+    m_memory.reset();
+    if (m_options.memoryBudget > 0) {
+        m_memory = std::make_unique<MemoryBudget>(m_options.memoryBudget);
+    }
+
+    m_cache.reset();
+    if (!m_options.cacheDir.empty()) {
+        m_cache = std::make_unique<TextureCache>(m_options.cacheDir, m_options.cacheMaxBytes);
+    }
+
+    if (m_options.incremental) {
+        m_manifest = std::make_unique<BatchManifest>(optionsKey);
+        if (!m_manifest->load(m_stateRoot / (BatchManifest::kFileName + shardSuffix())) && m_options.verbose) {
+            std::cout << "Incremental: " << m_manifest->getLastError() << ", exporting everything\n";
+        }
+    }
+
+    const fs::path journalPath = m_stateRoot / (BatchJournal::kFileName + shardSuffix());
+    if (m_options.resume) {
+        m_interrupted = std::make_unique<BatchJournal>(optionsKey);
+        if (!m_interrupted->load(journalPath)) {
+            std::cout << "Nothing to resume (" << m_interrupted->getLastError() << "), starting from the beginning\n";
+            m_interrupted.reset();
+        }
+    }
+
+    if (!m_options.planOnly) {
+        m_journal = std::make_unique<BatchJournal>(optionsKey);
+        if (!m_journal->open(journalPath, m_interrupted != nullptr)) {
+            std::cerr << "Warning: " << m_journal->getLastError() << "; this run cannot be resumed\n";
+            m_journal.reset();
+        }
+    }
+
+    const size_t threadCount = m_options.threads > 0 ? m_options.threads : ThreadPool::defaultThreadCount();
+
+    size_t processedCount = 0;
+    int successCount = 0;
+    int failCount = 0;
+
+    {
+        ThreadPool pool(threadCount);
+        ThreadPool scanPool(std::max<size_t>(1, m_options.scanThreads), "scan");
+        m_pool = &pool;
+
+        if (!m_options.files.empty()) {
+            std::cout << "Converting " << m_options.files.size() << " file(s)";
+        } else if (!m_options.fileList.empty()) {
+            std::cout << "Reading file list from "
+                      << (m_options.fileList == "-" ? std::string("standard input") : m_options.fileList);
+        } else {
+            std::cout << "Scanning " << m_options.inputPath << " for TIM2 files";
+        }
+        if (m_options.shardCount > 1) {
+            std::cout << " (shard " << m_options.shardIndex << "/" << m_options.shardCount << ")";
+        }
+        std::cout << "...\n\n";
+
+        if (!m_options.planOnly && (m_options.progress || !m_options.progressJson.empty())) {
+            m_progress = std::make_unique<ProgressReporter>(m_counters, threadCount, m_options.progress,
+                                                            m_options.progressJson);
+            m_progress->start();
+        }
+
+        DirectoryWalker walker(scanPool, [this](const fs::directory_entry& entry) {
+            return acceptFile(entry);
+        });
+        if (!m_options.fileList.empty() || !m_options.files.empty()) {
+            scanPool.submit([this] { readFileList(); });
+        } else {
+            walker.start(m_inputPath,
+                         [this](const fs::path&, std::vector<fs::path> files) { addDirectoryGroup(std::move(files)); },
+                         [this] { finishDiscovery(); });
+        }
+
+        if (m_options.planOnly) {
+            scanPool.wait();
+            m_pool = nullptr;
+
+            if (m_entries.empty()) {
+                if (!m_unchanged.empty() || !m_resumed.empty()) {
+                    std::cout << "All " << m_unchanged.size() + m_resumed.size()
+                              << " TIM2 file(s) are unchanged or already done; nothing to do.\n";
+                } else {
+                    std::cout << "No TIM2 files found in " << m_options.inputPath << "\n";
+                }
+                return 0;
+            }
+
+            std::vector<PlannedFile> plan;
+            plan.reserve(m_entries.size());
+            for (const auto& entry : m_entries) {
+                plan.push_back(entry->plan);
+            }
+
+            std::cout << "Found " << plan.size() << " TIM2 file(s) to process.\n";
+            if (!m_unchanged.empty()) {
+                std::cout << "Skipping " << m_unchanged.size() << " unchanged file(s).\n";
+            }
+            if (!m_resumed.empty()) {
+                std::cout << "Skipping " << m_resumed.size() << " file(s) finished by the interrupted run.\n";
+            }
+            TableFormatter::displayBatchPlan(plan, threadCount, m_options.verbose);
+            return 0;
+        }
+
+        runPipeline(threadCount, processedCount, successCount, failCount);
+        scanPool.wait();
+        m_pool = nullptr;
+
+        if (m_progress) {
+            m_progress->stop();
+            m_progress.reset();
+        }
+    }
+
+    if (m_manifest) {
+        saveManifest();
+    }
+
+    // The run completed, so there is nothing left to resume
+    if (m_journal) {
+        m_journal->finish();
+    }
+
+    if (m_cache) {
+        m_cache->evict();
+    }
+
+    const fs::path dedupReport = m_stateRoot / ("tim2dump-dedup" + shardSuffix() + ".txt");
+    if (m_dedup && !m_dedup->writeReport(dedupReport)) {
+        std::cerr << "Warning: Failed to write " << dedupReport.string() << "\n";
+    }
+
+    if (m_options.shardCount > 1) {
+        writeShardSummary(processedCount, successCount, failCount);
+    }
+
+    if (processedCount == 0 && m_unchanged.empty() && m_resumed.empty()) {
+        std::cout << "No TIM2 files found in " << m_options.inputPath << "\n";
+        return 0;
+    }
+
+    // Summary
+    std::cout << "\n" << std::string(60, '-') << "\n";
+    std::cout << "Batch conversion complete!\n";
+    std::cout << "  Processed: " << processedCount << " file(s)\n";
+    std::cout << "  Success: " << successCount << "\n";
+    std::cout << "  Failed: " << failCount << "\n";
+    if (m_options.incremental) {
+        std::cout << "  Unchanged: " << m_unchanged.size() << " (skipped)\n";
+    }
+    if (m_options.resume) {
+        std::cout << "  Resumed: " << m_resumed.size() << " file(s) already done (skipped)\n";
+    }
+    if (m_cache) {
+        std::cout << "  Cache: " << m_cache->hits() << " hit(s), " << m_cache->misses() << " miss(es)\n";
+    }
+    if (m_memory) {
+        std::ostringstream memory;
+        memory << std::fixed << std::setprecision(1) << "  Memory: peak " << m_memory->peak() / 1048576.0
+               << " MB reserved of " << m_memory->limit() / 1048576.0 << " MB budget\n";
+        std::cout << memory.str();
+    }
+    if (m_dedup) {
+        std::cout << "  Duplicates: " << m_dedup->duplicateCount() << " (see " << dedupReport.string() << ")\n";
+    }
+
+    if (m_useOutputFolder) {
+        std::cout << "  Output directory: " << m_outputRoot.string() << "\n";
+    } else {
+        std::cout << "  Files saved alongside source files\n";
+    }
+
+    return (failCount > 0) ? 1 : 0;
+}
+
+/**
+ * Walker callback (scan thread): plan one directory's files from their
+ * headers, name them in the order given (sorted by the walker), journal the
+ * names, then make the files available to the readers. Files that are
+ * unchanged (incremental) or were finished by an interrupted run (resume)
+ * are set aside first, which also claims their output names before any new
+ * ones are handed out.
+ */
+void BatchProcessor::addDirectoryGroup(std::vector<fs::path> files) {
+    std::vector<std::unique_ptr<FileEntry>> group;
+    std::vector<bool> foreign;  // Planned only so names match a single run
+    std::vector<ManifestEntry> unchanged;
+    std::vector<ManifestEntry> resumed;
+    group.reserve(files.size());
+
+    std::vector<bool> own(files.size(), true);
+    std::vector<bool> needed(files.size(), true);
+    if (m_options.shardCount > 1) {
+        selectShardFiles(files, own, needed);
+    }
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (!needed[i]) continue;
+
+        auto entry = std::make_unique<FileEntry>();
+        entry->plan.path = std::move(files[i]);
+        entry->record.source = entry->plan.path.lexically_relative(m_inputPath).generic_string();
+
+        if (!own[i]) {
+            BatchPlanner::planFile(entry->plan, m_options.format);
+            group.push_back(std::move(entry));
+            foreign.push_back(true);
+            continue;
+        }
+
+        const ManifestEntry* known = nullptr;
+        if (m_manifest) {
+            if (checkUnchanged(*entry, known)) {
+                unchanged.push_back(std::move(entry->record));
+                continue;
+            }
+            if (known) entry->previousOutputs = known->outputs;
+        }
+
+        if (m_interrupted && checkResumed(*entry)) {
+            resumed.push_back(std::move(entry->record));
+            continue;
+        }
+
+        BatchPlanner::planFile(entry->plan, m_options.format);
+        group.push_back(std::move(entry));
+        foreign.push_back(false);
+    }
+
+    // Other shards sharing the output directory may already have written
+    // the names this group is about to plan, for the neighbours planned
+    // above. A single run into a fresh directory would not see those files,
+    // so they must not push this shard's names to other suffixes.
+    if (m_options.shardCount > 1 && m_useOutputFolder) {
+        releaseShardNames(group);
+    }
+
+    // Walker groups never share an output directory, and list groups come
+    // from a single thread, so naming needs no global lock
+    for (size_t i = 0; i < group.size(); ++i) {
+        planOutputNames(group[i]->plan, group[i]->previousOutputs);
+        if (m_journal && !foreign[i]) {
+            m_journal->planned(group[i]->record.source, plannedOutputs(group[i]->plan));
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for (auto& record : unchanged) {
+            m_unchanged.push_back(std::move(record));
+        }
+        for (auto& record : resumed) {
+            m_resumed.push_back(std::move(record));
+        }
+
+        for (size_t i = 0; i < group.size(); ++i) {
+            if (foreign[i]) continue;
+
+            auto& entry = group[i];
+            entry->sequence = m_entries.size();
+
+            BatchCounters::add(m_counters.filesQueued, 1);
+            BatchCounters::add(m_counters.exportsQueued, entry->plan.exports.size());
+            BatchCounters::add(m_counters.costQueued, entry->plan.cost());
+
+            m_pending.push_back(entry.get());
+            std::push_heap(m_pending.begin(), m_pending.end(), lessUrgent);
+            m_entries.push_back(std::move(entry));
+        }
+    }
+    m_pendingChanged.notify_all();
+}
+
+// ".shard-i-of-N" for state files of a sharded run, empty otherwise
+std::string BatchProcessor::shardSuffix() const {
+    if (m_options.shardCount <= 1) return {};
+    return ".shard-" + std::to_string(m_options.shardIndex) + "-of-" + std::to_string(m_options.shardCount);
+}
+
+/**
+ * Split one directory's files (name order) for sharding. `own` marks files
+ * whose relative path hashes to this shard. `needed` also marks other
+ * shards' files that can influence this shard's output names: two names can
+ * only collide if one file's stem is a prefix of the other's, so sort by stem
+ * and keep every run of stems sharing a root stem that contains an own file.
+ * Other files are never opened.
+ */
+void BatchProcessor::selectShardFiles(const std::vector<fs::path>& files,
+                                      std::vector<bool>& own, std::vector<bool>& needed) const {
+    std::vector<std::string> stems(files.size());
+    std::vector<size_t> byStem(files.size());
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        const std::string relative = files[i].lexically_relative(m_inputPath).generic_string();
+        own[i] = Hash64::of(relative.data(), relative.size()) % m_options.shardCount == m_options.shardIndex;
+        needed[i] = own[i];
+        stems[i] = files[i].stem().string();
+        byStem[i] = i;
+    }
+
+    // Outputs in the source directory are not renamed on conflict
+    if (!m_useOutputFolder) return;
+
+    std::sort(byStem.begin(), byStem.end(), [&stems](size_t a, size_t b) {
+        return stems[a] != stems[b] ? stems[a] < stems[b] : a < b;
+    });
+
+    for (size_t begin = 0; begin < byStem.size();) {
+        const std::string& root = stems[byStem[begin]];
+        size_t end = begin + 1;
+        while (end < byStem.size() && stems[byStem[end]].compare(0, root.size(), root) == 0) {
+            ++end;
+        }
+
+        bool hasOwn = false;
+        for (size_t k = begin; k < end; ++k) hasOwn = hasOwn || own[byStem[k]];
+        if (hasOwn) {
+            for (size_t k = begin; k < end; ++k) needed[byStem[k]] = true;
+        }
+        begin = end;
+    }
+}
+
+/**
+ * Let the group's planned names reuse on-disk files named like them: in a
+ * shared output directory those are outputs of other shards (or of an
+ * earlier run of the same split), which a single run would not have found.
+ */
+void BatchProcessor::releaseShardNames(const std::vector<std::unique_ptr<FileEntry>>& group) {
+    std::map<fs::path, std::unordered_set<std::string>> baseNames;
+    for (const auto& entry : group) {
+        const fs::path dir = m_outputRoot / fs::relative(entry->plan.path.parent_path(), m_inputPath);
+        for (const auto& e : entry->plan.exports) {
+            baseNames[dir].insert(exportBaseName(entry->plan, e));
+        }
+    }
+    for (const auto& [dir, names] : baseNames) {
+        m_outputNames.release(dir, names, m_options.format);
+    }
+}
+
+/**
+ * Per-shard summary for mergeShards(): "key value" lines, written next to
+ * the shard's manifest.
+ */
+void BatchProcessor::writeShardSummary(size_t processedCount, int successCount, int failCount) {
+    const fs::path file = m_stateRoot / ("tim2dump-summary" + shardSuffix() + ".txt");
+
+    std::ofstream out(file, std::ios::trunc);
+    out << "shard " << m_options.shardIndex << " " << m_options.shardCount << "\n";
+    out << "processed " << processedCount << "\n";
+    out << "success " << successCount << "\n";
+    out << "failed " << failCount << "\n";
+    out << "unchanged " << m_unchanged.size() << "\n";
+    out << "resumed " << m_resumed.size() << "\n";
+    out << "duplicates " << (m_dedup ? m_dedup->duplicateCount() : 0) << "\n";
+
+    if (!out.good()) {
+        std::cerr << "Warning: Failed to write " << file.string() << "\n";
+    }
+}
+
+/**
+ * File-list discovery (one scan-pool task). Entries are paths, relative to
+ * the working directory or absolute, that must lie below the base directory.
+ * They are filtered like scanned files, except that any file name is taken
+ * unless detectContent asks for a header check, and passed on in runs that
+ * share a directory: a run ends at a directory change, after 64 entries, or
+ * when no more input is buffered, so a slow producer's files start right
+ * away.
+ */
+void BatchProcessor::readFileList() {
+    stats::Scope scope(stats::Phase::Scan);
+    std::ifstream listFile;
+    std::istream* in = nullptr;
+    if (m_options.fileList == "-") {
+        in = &std::cin;
+    } else if (!m_options.fileList.empty()) {
+        listFile.open(m_options.fileList);
+        if (!listFile) {
+            std::cerr << "Error: Cannot open file list: " << m_options.fileList << "\n";
+            finishDiscovery();
+            return;
+        }
+        in = &listFile;
+    }
+
+    const char delimiter = m_options.nullSeparated ? '\0' : '\n';
+    const fs::path base = fs::absolute(m_inputPath).lexically_normal();
+
+    std::vector<fs::path> group;
+    auto flush = [this, &group] {
+        if (group.empty()) return;
+        addDirectoryGroup(std::move(group));
+        group.clear();
+    };
+
+    // Explicit files are read like a list that is fully buffered
+    size_t nextFile = 0;
+    auto next = [&](std::string& line) -> bool {
+        if (in) return static_cast<bool>(std::getline(*in, line, delimiter));
+        if (nextFile == m_options.files.size()) return false;
+        line = m_options.files[nextFile++];
+        return true;
+    };
+
+    std::string line;
+    while (next(line)) {
+        if (!m_options.nullSeparated && !line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+
+        const fs::path relative = fs::absolute(line).lexically_normal().lexically_relative(base);
+        if (relative.empty() || *relative.begin() == "..") {
+            std::cerr << "Warning: Skipping " << line << ": not below " << m_options.inputPath << "\n";
+            continue;
+        }
+
+        const fs::path path = m_inputPath / relative;
+        std::error_code ec;
+        const fs::directory_entry entry(path, ec);
+        if (!matchesFilters(entry)) continue;
+        if (m_options.detectContent && !TIM2Parser::probeFile(path.string())) continue;
+
+        if (!group.empty() && group.back().parent_path() != path.parent_path()) flush();
+        group.push_back(path);
+        if (group.size() >= 64 || (in && in->rdbuf()->in_avail() <= 0)) flush();
+    }
+
+    flush();
+    finishDiscovery();
+}
+
+/**
+ * Watch mode: one incremental run over the whole tree, then one over every
+ * batch of files the watcher reports. The watcher starts first, so files
+ * written during the initial run are not missed. The manifest keeps output
+ * names stable: a rewritten source is exported again under the names it had
+ * before. A failed round does not end the watch; stop is only checked
+ * between rounds, so a round in progress is always completed.
+ */
+int BatchProcessor::watch(const std::atomic<bool>& stop) {
+    m_options.incremental = true;
+    m_options.fileList.clear();
+    m_options.files.clear();
+
+    DirectoryWatcher watcher(m_options.inputPath);
+    if (!m_options.outputFolder.empty()) {
+        watcher.ignore(m_options.outputFolder);
+    }
+    watcher.start();
+
+    int result = run();
+
+    std::vector<fs::path> changed;
+    bool rescan = false;
+    for (;;) {
+        std::cout << "\nWatching " << m_options.inputPath << (watcher.polling() ? " (polling)" : "")
+                  << " for new TIM2 files; press Ctrl+C to stop\n";
+
+        do {
+            if (!watcher.wait(changed, rescan, stop)) return result;
+
+            m_options.files.clear();
+            for (const auto& path : changed) {
+                std::error_code ec;
+                if (acceptFile(fs::directory_entry(path, ec))) {
+                    m_options.files.push_back(path.string());
+                }
+            }
+        } while (!rescan && m_options.files.empty());
+
+        // Lost events: look at the whole tree again
+        if (rescan) {
+            m_options.files.clear();
+        }
+
+        std::cout << "\n";
+        result = run();
+    }
+}
+
+void BatchProcessor::finishDiscovery() {
+    m_counters.discoveryDone.store(true, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_discoveryDone = true;
+    }
+    m_pendingChanged.notify_all();
+    m_resultReady.notify_all();
+}
+
+/**
+ * Heap order for pending files: larger estimated cost first, then earlier
+ * discovery.
+ */
+bool BatchProcessor::lessUrgent(const FileEntry* a, const FileEntry* b) {
+    const uint64_t ca = a->plan.cost();
+    const uint64_t cb = b->plan.cost();
+    return ca != cb ? ca < cb : a->sequence > b->sequence;
+}
+
+/**
+ * Pop the most expensive file discovered so far, waiting while the scan is
+ * still running. Returns nullptr once the scan is done and nothing is left.
+ */
+BatchProcessor::FileEntry* BatchProcessor::nextPendingFile() {
+    trace::Span wait("wait: no pending files", "wait", kTraceWaitNanos);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_pendingChanged.wait(lock, [this] { return !m_pending.empty() || m_discoveryDone; });
+    if (m_pending.empty()) return nullptr;
+
+    std::pop_heap(m_pending.begin(), m_pending.end(), lessUrgent);
+    FileEntry* entry = m_pending.back();
+    m_pending.pop_back();
+    return entry;
+}
+
+/**
+ * Incremental check for one source (scan thread). Always fills in the entry's
+ * record stamp and sets `previous` to its manifest entry, if any. The source
+ * is unchanged when its size matches and either its mtime or (after a touch)
+ * its content hash does, and every recorded output is still in its directory
+ * listing; its outputs are then claimed for this run.
+ */
+bool BatchProcessor::checkUnchanged(FileEntry& entry, const ManifestEntry*& previous) {
+    const fs::path& path = entry.plan.path;
+    ManifestEntry& record = entry.record;
+
+    std::error_code ec;
+    record.size = fs::file_size(path, ec);
+    if (ec) return false;
+    record.mtime = fs::last_write_time(path, ec).time_since_epoch().count();
+    if (ec) return false;
+
+    previous = m_manifest->find(record.source);
+    if (!previous || previous->size != record.size) return false;
+
+    if (previous->mtime != record.mtime) {
+        if (!hashFile(path, record.hash) || record.hash != previous->hash) return false;
+    }
+    record.hash = previous->hash;
+
+    for (const auto& output : previous->outputs) {
+        if (!m_outputNames.exists(m_stateRoot / output.path)) return false;
+    }
+    for (const auto& output : previous->outputs) {
+        if (!m_outputNames.claim(m_stateRoot / output.path)) return false;
+    }
+
+    record.outputs = previous->outputs;
+    return true;
+}
+
+/**
+ * Resume check for one source (scan thread). A source the interrupted run
+ * finished completely is skipped if its outputs are all still there (and
+ * hashed for the manifest in incremental mode); otherwise it is exported
+ * again under the names that run planned for it.
+ */
+bool BatchProcessor::checkResumed(FileEntry& entry) {
+    const BatchJournal::SourceState* state = m_interrupted->find(entry.record.source);
+    if (!state) return false;
+
+    std::vector<ManifestOutput> outputs = state->outputList();
+    entry.previousOutputs = outputs;
+    if (!state->complete()) return false;
+
+    for (const auto& output : outputs) {
+        if (!m_outputNames.exists(m_stateRoot / output.path)) return false;
+    }
+    if (m_manifest && !hashFile(entry.plan.path, entry.record.hash)) return false;
+
+    for (const auto& output : outputs) {
+        if (!m_outputNames.claim(m_stateRoot / output.path)) return false;
+    }
+
+    entry.record.outputs = std::move(outputs);
+    return true;
+}
+
+// "<stem>[_pic<n>][_mip<n>]", before conflict suffixes and the extension
+std::string BatchProcessor::exportBaseName(const PlannedFile& file, const PlannedExport& e) {
+    std::string baseName = file.path.stem().string();
+    if (file.pictureCount > 1) {
+        baseName += "_pic" + std::to_string(e.picture);
+    }
+    if (e.mipLevels > 1) {
+        baseName += "_mip" + std::to_string(e.mip);
+    }
+    return baseName;
+}
+
+/**
+ * Decide where a planned file's exports go and name each one:
+ * "<stem>[_picN][_mipN].<fmt>", with "_N" appended in the output folder when
+ * that name is already taken. A re-exported source keeps the name its
+ * picture/mip level had in the manifest or the interrupted run's journal.
+ * Called for one directory group at a time, in file name order; groups never
+ * share an output directory, so the result does not depend on the order
+ * groups arrive in.
+ */
+void BatchProcessor::planOutputNames(PlannedFile& file, const std::vector<ManifestOutput>& previous) {
+    if (m_useOutputFolder) {
+        // Preserve relative directory structure in output folder
+        auto relativePath = fs::relative(file.path.parent_path(), m_inputPath);
+        file.outputDir = m_outputRoot / relativePath;
+    } else {
+        // Save alongside source file
+        file.outputDir = file.path.parent_path();
+    }
+
+    for (auto& e : file.exports) {
+        const std::string baseName = exportBaseName(file, e);
+
+        if (m_useOutputFolder) {
+            e.outputFilename.clear();
+
+            for (const auto& output : previous) {
+                if (output.picture != e.picture || output.mip != e.mip) continue;
+
+                const fs::path reused = file.outputDir / fs::path(output.path).filename();
+                if ((m_stateRoot / output.path).lexically_normal() == reused.lexically_normal() &&
+                    m_outputNames.claim(reused)) {
+                    e.outputFilename = reused.string();
+                }
+                break;
+            }
+
+            // Handle conflicts in case different files happen to have the same name
+            if (e.outputFilename.empty()) {
+                e.outputFilename = m_outputNames.reserve(file.outputDir, baseName, m_options.format);
+            }
+        } else {
+            // Save alongside source with standard naming
+            e.outputFilename = (file.outputDir / (baseName + "." + m_options.format)).string();
+        }
+    }
+}
+
+// A file's export names relative to m_stateRoot, as the manifest and journal store them
+std::vector<ManifestOutput> BatchProcessor::plannedOutputs(const PlannedFile& file) const {
+    std::vector<ManifestOutput> outputs;
+    outputs.reserve(file.exports.size());
+
+    const fs::path root = m_stateRoot.lexically_normal();
+    for (const auto& e : file.exports) {
+        const std::string path = fs::path(e.outputFilename).lexically_normal().lexically_relative(root).generic_string();
+        outputs.push_back({e.picture, e.mip, path});
+    }
+    return outputs;
+}
+
+/**
+ * Start the reader, dispatcher and writer threads around the pool, then print
+ * each file's buffered log as it finishes. Shuts the stages down once the
+ * scan is complete and every discovered file is done.
+ */
+void BatchProcessor::runPipeline(size_t threadCount, size_t& processedCount, int& successCount, int& failCount) {
+    const size_t queueDepth = m_options.queueDepth > 0 ? m_options.queueDepth : threadCount * 2;
+
+    m_readQueue = std::make_unique<BoundedQueue<LoadedFile>>(queueDepth);
+    m_writeQueue = std::make_unique<BoundedQueue<EncodedOutput>>(queueDepth);
+    m_filesInFlight = 0;
+    m_maxFilesInFlight = std::max<size_t>(1, queueDepth);
+
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < std::max<size_t>(1, m_options.readThreads); ++i) {
+        readers.emplace_back([this, i] {
+            trace::setThreadName("reader " + std::to_string(i));
+            readerLoop();
+        });
+    }
+    std::thread dispatcher([this] {
+        trace::setThreadName("dispatcher");
+        dispatchLoop();
+    });
+    std::vector<std::thread> writers;
+    for (size_t i = 0; i < std::max<size_t>(1, m_options.writeThreads); ++i) {
+        writers.emplace_back([this, i] {
+            trace::setThreadName("writer " + std::to_string(i));
+            writerLoop();
+        });
+    }
+
+    // Print each file's log in one block as soon as it finishes
+    for (;;) {
+        std::vector<FileEntry*> finished;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_resultReady.wait(lock, [this, processedCount] {
+                return !m_finished.empty() || (m_discoveryDone && processedCount == m_entries.size());
+            });
+            if (m_finished.empty()) break;
+            finished.swap(m_finished);
+        }
+
+        std::unique_lock<std::mutex> console;
+        if (m_progress) console = m_progress->holdConsole();
+
+        for (const FileEntry* entry : finished) {
+            for (const auto& line : entry->result.lines) {
+                (line.isError ? std::cerr : std::cout) << line.text << "\n";
+            }
+
+            processedCount++;
+            if (entry->result.success) {
+                successCount++;
+            } else {
+                failCount++;
+            }
+        }
+    }
+
+    // Every file is done, so every stage is idle: shut them down in order
+    for (auto& reader : readers) reader.join();
+    m_readQueue->close();
+    dispatcher.join();
+    m_pool->wait();
+    m_writeQueue->close();
+    for (auto& writer : writers) writer.join();
+}
+
+/**
+ * Reader stage: take the largest pending file and load it whole. With a
+ * memory budget, the file's estimated peak is reserved first, so a reader
+ * waits here while the files in flight use up the budget. Blocks on the read
+ * queue when the pool is behind.
+ */
+void BatchProcessor::readerLoop() {
+    while (FileEntry* entry = nextPendingFile()) {
+        trace::Item item(&entry->plan.path);
+        if (m_memory) {
+            trace::Span wait("wait: memory budget", "wait", kTraceWaitNanos);
+            entry->reservedMemory = m_memory->acquire(entry->plan.peakMemory);
+        }
+
+        LoadedFile loaded;
+        loaded.entry = entry;
+        const std::string path = entry->plan.path.string();
+
+        {
+            stats::Scope scope(stats::Phase::Read);
+            std::ifstream file(path, std::ios::binary | std::ios::ate);
+            if (!file) {
+                loaded.error = "Failed to open file: " + path;
+            } else {
+                const std::streamsize size = file.tellg();
+                file.seekg(0, std::ios::beg);
+                loaded.bytes.resize(static_cast<size_t>(std::max<std::streamsize>(0, size)));
+                if (!file.read(reinterpret_cast<char*>(loaded.bytes.data()), size)) {
+                    loaded.error = "Failed to read file: " + path;
+                } else if (m_manifest) {
+                    entry->record.hash = Hash64::of(loaded.bytes.data(), loaded.bytes.size());
+                }
+            }
+        }
+        BatchCounters::add(m_counters.bytesRead, loaded.bytes.size());
+        BatchCounters::add(m_counters.costDone, entry->plan.readCost);
+
+        tracedPush(*m_readQueue, std::move(loaded), "wait: read queue full");
+    }
+}
+
+/**
+ * Move loaded files onto the pool, keeping at most m_maxFilesInFlight files
+ * parsed-but-unfinished at once. This is what lets a full write queue push
+ * back all the way to the readers.
+ */
+void BatchProcessor::dispatchLoop() {
+    while (auto loaded = tracedPop(*m_readQueue, "wait: read queue empty")) {
+        size_t inFlight = m_filesInFlight.load();
+        for (;;) {
+            if (inFlight < m_maxFilesInFlight) {
+                if (m_filesInFlight.compare_exchange_weak(inFlight, inFlight + 1)) break;
+            } else {
+                trace::Span wait("wait: files in flight", "wait", kTraceWaitNanos);
+                m_filesInFlight.wait(inFlight);
+                inFlight = m_filesInFlight.load();
+            }
+        }
+
+        auto file = std::make_shared<LoadedFile>(std::move(*loaded));
+        m_pool->submit([this, file] { parseFile(*file); });
+    }
+}
+
+/**
+ * Writer stage: put encoded images on disk and complete their jobs. Each
+ * image goes to a temp file that is renamed over the output, so an output
+ * is either complete or absent, and an existing file (possibly a hardlink
+ * shared with another output) is replaced rather than written into.
+ */
+void BatchProcessor::writerLoop() {
+    while (auto output = tracedPop(*m_writeQueue, "wait: write queue empty")) {
+        ExportJob& job = output->ctx->jobs[output->jobIndex];
+        trace::Item item(&output->ctx->entry->plan.path, static_cast<int>(job.plan->picture),
+                         static_cast<int>(job.plan->mip));
+        const std::string temp = tempPath(job.plan->outputFilename);
+
+        {
+            stats::Scope scope(stats::Phase::Write);
+            {
+                std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+                if (file) {
+                    file.write(reinterpret_cast<const char*>(output->bytes.data()), output->bytes.size());
+                    job.success = file.good();
+                }
+            }
+
+            std::error_code ec;
+            if (job.success) {
+                fs::rename(temp, job.plan->outputFilename, ec);
+                job.success = !ec;
+            }
+            if (!job.success) {
+                fs::remove(temp, ec);
+            }
+        }
+
+        if (job.success) {
+            BatchCounters::add(m_counters.bytesWritten, output->bytes.size());
+        }
+
+        if (output->storeInCache && job.success) {
+            m_cache->store(job.contentKey, m_options.format, output->bytes);
+        }
+
+        finishExport(output->ctx, output->jobIndex);
+    }
+}
+
+/**
+ * Pool task: parse a loaded file and fan out one decode task per planned
+ * picture/mip level, largest first. All console output goes into the file's
+ * context; the last export to be written hands it to run() for printing.
+ */
+void BatchProcessor::parseFile(LoadedFile& loaded) {
+    FileEntry* entry = loaded.entry;
+    const PlannedFile& planned = entry->plan;
+
+    trace::Item item(&planned.path);
+    auto ctx = std::make_shared<FileContext>();
+    ctx->entry = entry;
+    ctx->parser = std::make_unique<TIM2Parser>();
+    ctx->lines.push_back({false, "Processing: " + planned.path.string()});
+
+    if (!loaded.error.empty()) {
+        ctx->lines.push_back({true, "  Error: " + loaded.error});
+        finishFile(entry, std::move(ctx->lines), false);
+        return;
+    }
+
+    const TIM2Parser& parser = *ctx->parser;
+    bool parsed = false;
+    std::string parseError;
+    try {
+        parsed = ctx->parser->loadFromMemory(loaded.bytes.data(), loaded.bytes.size());
+        if (!parsed) parseError = parser.getLastError();
+    } catch (const std::exception& e) {
+        parseError = e.what();
+    }
+    loaded.bytes = {};  // Pictures hold their own copies now
+
+    if (!parsed) {
+        ctx->lines.push_back({true, "  Error: " + parseError});
+        finishFile(entry, std::move(ctx->lines), false);
+        return;
+    }
+
+    if (m_useOutputFolder) {
+        try {
+            fs::create_directories(planned.outputDir);
+        } catch (const std::exception& e) {
+            ctx->lines.push_back({true, std::string("  Error creating directory: ") + e.what()});
+            finishFile(entry, std::move(ctx->lines), false);
+            return;
+        }
+    }
+
+    for (const auto& e : planned.exports) {
+        const auto* pic = parser.getPicture(e.picture);
+        if (!pic) continue;
+        ctx->jobs.push_back({pic, &e, false, 0, false, {}});
+    }
+
+    if (ctx->jobs.empty()) {
+        finishFile(entry, std::move(ctx->lines), true);
+        return;
+    }
+
+    // The owner pops its own deque LIFO while thieves take from the front,
+    // so queue the largest first: idle workers steal the big exports.
+    std::vector<size_t> order(ctx->jobs.size());
+    for (size_t j = 0; j < order.size(); ++j) order[j] = j;
+    std::stable_sort(order.begin(), order.end(), [&ctx](size_t a, size_t b) {
+        return ctx->jobs[a].plan->cost() > ctx->jobs[b].plan->cost();
+    });
+
+    ctx->remainingJobs = ctx->jobs.size();
+    std::vector<uint64_t> pictureHashes(parser.getPictureCount(), 0);
+    std::vector<bool> pictureHashed(parser.getPictureCount(), false);
+
+    for (size_t j : order) {
+        ExportJob& job = ctx->jobs[j];
+
+        try {
+            // Content key: which picture bytes and mip level, not which file
+            if (m_dedup || m_cache) {
+                const size_t picture = job.plan->picture;
+                if (!pictureHashed[picture]) {
+                    pictureHashes[picture] = job.pic->contentHash();
+                    pictureHashed[picture] = true;
+                }
+
+                Hash64 key;
+                key.updateValue(pictureHashes[picture]);
+                key.updateValue(static_cast<uint64_t>(job.plan->mip));
+                job.contentKey = key.digest();
+            }
+
+            if (m_dedup) {
+                job.dedupLeader = m_dedup->acquire(job.contentKey, job.plan->outputFilename,
+                                                   [this, ctx, j](const std::string* leaderPath) {
+                                                       linkDuplicate(ctx, j, leaderPath);
+                                                   });
+                if (!job.dedupLeader) continue;
+            }
+
+            m_pool->submit([this, ctx, j] { decodeExport(ctx, j); });
+        } catch (const std::exception& e) {
+            failExport(ctx, j, e.what());
+        }
+    }
+}
+
+/**
+ * Decode task for one picture/mip level. A cache hit goes straight to the
+ * writers. Otherwise, images of at least two bands' worth of pixels are
+ * decoded by separate row-band tasks into a shared buffer; the band that
+ * finishes last queues the encode task.
+ */
+void BatchProcessor::decodeExport(const std::shared_ptr<FileContext>& ctx, size_t jobIndex) {
+    const ExportJob& job = ctx->jobs[jobIndex];
+    trace::Item item(&ctx->entry->plan.path, static_cast<int>(job.plan->picture), static_cast<int>(job.plan->mip));
+
+    if (m_cache) {
+        EncodedOutput cached;
+        cached.ctx = ctx;
+        cached.jobIndex = jobIndex;
+        if (m_cache->lookup(job.contentKey, m_options.format, cached.bytes)) {
+            if (!tracedPush(*m_writeQueue, std::move(cached), "wait: write queue full")) {
+                finishExport(ctx, jobIndex);
+            }
+            return;
+        }
+    }
+
+    const size_t width  = job.pic->getMipMapWidth(job.plan->mip);
+    const size_t height = job.pic->getMipMapHeight(job.plan->mip);
+    const size_t bandPixels = m_options.bandPixels;
+
+    auto decoded = std::make_shared<DecodeBuffer>();
+
+    try {
+        if (bandPixels == 0 || m_pool->size() < 2 || width * height < bandPixels * 2) {
+            const auto start = std::chrono::steady_clock::now();
+            decoded->pixels = job.pic->decodeImage(job.plan->mip);
+            BatchCounters::add(m_counters.decodeNanos, elapsedNanos(start));
+            m_pool->submit([this, ctx, jobIndex, decoded] { encodeExport(ctx, jobIndex, decoded); });
+            return;
+        }
+
+        const size_t rowsPerBand = std::max<size_t>(1, bandPixels / width);
+        const size_t bandCount = (height + rowsPerBand - 1) / rowsPerBand;
+
+        decoded->pixels.resize(width * height);
+        decoded->remainingBands = bandCount;
+
+        // If a submit throws part way, the bands already queued never reach
+        // zero, so only the handler below finishes the export
+        for (size_t band = 0; band < bandCount; ++band) {
+            const size_t firstRow = band * rowsPerBand;
+            const size_t rowCount = std::min(rowsPerBand, height - firstRow);
+
+            m_pool->submit([this, ctx, jobIndex, decoded, firstRow, rowCount, width] {
+                decodeBand(ctx, jobIndex, decoded, firstRow, rowCount, width);
+            });
+        }
+    } catch (const std::exception& e) {
+        failExport(ctx, jobIndex, e.what());
+    }
+}
+
+/**
+ * Band task: decode some rows into the shared buffer. The last band to
+ * finish encodes the image, or fails the export if any band threw.
+ */
+void BatchProcessor::decodeBand(const std::shared_ptr<FileContext>& ctx, size_t jobIndex,
+                                const std::shared_ptr<DecodeBuffer>& decoded, size_t firstRow, size_t rowCount,
+                                size_t width) {
+    ExportJob& job = ctx->jobs[jobIndex];
+    trace::Item item(&ctx->entry->plan.path, static_cast<int>(job.plan->picture), static_cast<int>(job.plan->mip));
+
+    try {
+        const auto start = std::chrono::steady_clock::now();
+        job.pic->decodeRows(job.plan->mip, firstRow, rowCount, decoded->pixels.data() + firstRow * width);
+        BatchCounters::add(m_counters.decodeNanos, elapsedNanos(start));
+    } catch (const std::exception& e) {
+        // Only the first band to fail writes the message
+        if (!decoded->failed.exchange(true)) job.error = e.what();
+    }
+
+    if (decoded->remainingBands.fetch_sub(1) != 1) return;
+
+    if (decoded->failed) {
+        decoded->pixels = {};
+        job.success = false;
+        finishExport(ctx, jobIndex);
+    } else {
+        encodeExport(ctx, jobIndex, decoded);
+    }
+}
+
+/**
+ * Encode task: turn decoded pixels into BMP/PNG bytes and hand them to the
+ * writer stage (blocking while the write queue is full).
+ */
+void BatchProcessor::encodeExport(const std::shared_ptr<FileContext>& ctx, size_t jobIndex,
+                                  const std::shared_ptr<DecodeBuffer>& decoded) {
+    const ExportJob& job = ctx->jobs[jobIndex];
+    trace::Item item(&ctx->entry->plan.path, static_cast<int>(job.plan->picture), static_cast<int>(job.plan->mip));
+    const size_t width  = job.pic->getMipMapWidth(job.plan->mip);
+    const size_t height = job.pic->getMipMapHeight(job.plan->mip);
+
+    EncodedOutput output;
+    output.ctx = ctx;
+    output.jobIndex = jobIndex;
+    output.storeInCache = m_cache != nullptr;
+
+    const auto start = std::chrono::steady_clock::now();
+    bool encoded = false;
+    try {
+        if (m_options.format == "png") {
+            encoded = tim2::ImageConverter::encodePNG(decoded->pixels, width, height, output.bytes);
+        } else {
+            encoded = tim2::ImageConverter::encodeBMP(decoded->pixels, width, height, output.bytes);
+        }
+    } catch (const std::exception& e) {
+        ctx->jobs[jobIndex].error = e.what();
+    }
+    decoded->pixels = {};
+    BatchCounters::add(m_counters.encodeNanos, elapsedNanos(start));
+
+    if (!encoded || !tracedPush(*m_writeQueue, std::move(output), "wait: write queue full")) {
+        finishExport(ctx, jobIndex);
+    }
+}
+
+/**
+ * Dedup waiter: the leader export with the same content is settled. Link its
+ * file into place, or export this one normally if the leader failed. Runs on
+ * whichever thread settled the leader (a writer) or, if it was already
+ * written, on the pool thread parsing this file.
+ */
+void BatchProcessor::linkDuplicate(const std::shared_ptr<FileContext>& ctx, size_t jobIndex,
+                                   const std::string* leaderPath) {
+    if (!leaderPath) {
+        m_pool->submit([this, ctx, jobIndex] { decodeExport(ctx, jobIndex); });
+        return;
+    }
+
+    ExportJob& job = ctx->jobs[jobIndex];
+    if (*leaderPath == job.plan->outputFilename) {
+        // Two sources saved alongside each other under the same name
+        job.success = true;
+    } else {
+        const std::string temp = tempPath(job.plan->outputFilename);
+        LinkMethod method = DedupIndex::materialize(*leaderPath, temp);
+
+        std::error_code ec;
+        if (method != LinkMethod::Failed) {
+            fs::rename(temp, job.plan->outputFilename, ec);
+            if (ec) {
+                method = LinkMethod::Failed;
+                fs::remove(temp, ec);
+            }
+        }
+
+        job.success = method != LinkMethod::Failed;
+        m_dedup->recordDuplicate(*leaderPath, job.plan->outputFilename, method);
+    }
+
+    finishExport(ctx, jobIndex);
+}
+
+/**
+ * A task of this export threw: keep the message for the file's log and
+ * finish the export as failed, so its file still completes.
+ */
+void BatchProcessor::failExport(const std::shared_ptr<FileContext>& ctx, size_t jobIndex, const char* what) {
+    ExportJob& job = ctx->jobs[jobIndex];
+    job.success = false;
+    job.error = what;
+    finishExport(ctx, jobIndex);
+}
+
+/**
+ * An export is written (or failed). Journals it, and releases anything
+ * waiting on it as a dedup leader before counting it towards its file.
+ */
+void BatchProcessor::finishExport(const std::shared_ptr<FileContext>& ctx, size_t jobIndex) {
+    const ExportJob& job = ctx->jobs[jobIndex];
+    BatchCounters::add(m_counters.exportsDone, 1);
+    BatchCounters::add(m_counters.costDone, job.plan->cost());
+
+    if (m_journal && job.success) {
+        m_journal->done(ctx->entry->record.source, job.plan->picture, job.plan->mip);
+    }
+
+    if (m_dedup && job.dedupLeader) {
+        m_dedup->complete(job.contentKey, job.success);
+    }
+
+    finishJob(ctx);
+}
+
+/**
+ * Called once per finished export. The last one assembles the file's log in
+ * picture/mip order and reports the file as done.
+ */
+void BatchProcessor::finishJob(const std::shared_ptr<FileContext>& ctx) {
+    if (ctx->remainingJobs.fetch_sub(1) != 1) return;
+
+    bool fileSuccess = true;
+    for (const auto& job : ctx->jobs) {
+        if (job.success) {
+            ctx->lines.push_back({false, "  -> " + job.plan->outputFilename});
+        } else {
+            if (!job.error.empty()) ctx->lines.push_back({true, "  Error: " + job.error});
+            ctx->lines.push_back({true, "  Failed to export: " + job.plan->outputFilename});
+            fileSuccess = false;
+        }
+    }
+
+    finishFile(ctx->entry, std::move(ctx->lines), fileSuccess, ctx->jobs.size());
+}
+
+void BatchProcessor::finishFile(FileEntry* entry, std::vector<LogLine> lines, bool success,
+                                size_t exportsFinished) {
+    // Exports that never ran (the file failed to load) count as done
+    const std::vector<PlannedExport>& exports = entry->plan.exports;
+    if (exportsFinished < exports.size()) {
+        BatchCounters::add(m_counters.exportsDone, exports.size() - exportsFinished);
+        if (exportsFinished == 0) {
+            for (const auto& e : exports) BatchCounters::add(m_counters.costDone, e.cost());
+        }
+    }
+    BatchCounters::add(m_counters.filesDone, 1);
+    if (!success) BatchCounters::add(m_counters.filesFailed, 1);
+
+    if (m_memory) {
+        m_memory->release(entry->reservedMemory);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        entry->result.lines = std::move(lines);
+        entry->result.success = success;
+        m_finished.push_back(entry);
+    }
+    m_resultReady.notify_all();
+
+    // Let the dispatcher admit another file
+    m_filesInFlight.fetch_sub(1);
+    m_filesInFlight.notify_one();
+}
+
+/**
+ * Write the manifest for the next incremental run: this run's successes,
+ * unchanged files and files finished before a resume, minus failures (so
+ * they are retried). Entries for sources not seen this run are kept as long
+ * as the source still exists, so runs with --include/--exclude do not
+ * forget the rest of the tree.
+ */
+void BatchProcessor::saveManifest() {
+    BatchManifest manifest = *m_manifest;
+    std::unordered_set<std::string> seen;
+
+    for (const auto& entry : m_entries) {
+        ManifestEntry record = entry->record;
+        seen.insert(record.source);
+
+        if (!entry->result.success) {
+            manifest.erase(record.source);
+            continue;
+        }
+
+        record.outputs = plannedOutputs(entry->plan);
+        manifest.set(std::move(record));
+    }
+
+    for (const auto& record : m_unchanged) {
+        seen.insert(record.source);
+        manifest.set(record);
+    }
+
+    for (const auto& record : m_resumed) {
+        seen.insert(record.source);
+        manifest.set(record);
+    }
+
+    std::vector<std::string> gone;
+    for (const auto& [source, record] : manifest.entries()) {
+        std::error_code ec;
+        if (seen.count(source) == 0 && !fs::exists(m_inputPath / source, ec)) {
+            gone.push_back(source);
+        }
+    }
+    for (const auto& source : gone) {
+        manifest.erase(source);
+    }
+
+    if (!manifest.save(m_stateRoot / (BatchManifest::kFileName + shardSuffix()))) {
+        std::cerr << "Warning: " << manifest.getLastError() << "\n";
+    }
+}
+
+/**
+ * `merge` command: sum every "tim2dump-summary.shard-*.txt" in the output
+ * root, check that all shards of the split reported, and combine the
+ * per-shard manifests into the plain manifest that a later unsharded
+ * incremental run reads.
+ */
+int BatchProcessor::mergeShards(const std::string& outputRoot) {
+    const fs::path root(outputRoot);
+    const std::string summaryPrefix = "tim2dump-summary.shard-";
+    const std::string manifestPrefix = std::string(BatchManifest::kFileName) + ".shard-";
+
+    std::vector<fs::path> summaries;
+    std::vector<fs::path> manifests;
+
+    std::error_code ec;
+    for (fs::directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec)) {
+        const std::string name = it->path().filename().string();
+        if (name.compare(0, summaryPrefix.size(), summaryPrefix) == 0) {
+            summaries.push_back(it->path());
+        } else if (name.compare(0, manifestPrefix.size(), manifestPrefix) == 0) {
+            manifests.push_back(it->path());
+        }
+    }
+    std::sort(summaries.begin(), summaries.end());
+    std::sort(manifests.begin(), manifests.end());
+
+    if (summaries.empty()) {
+        std::cerr << "Error: No shard summaries found in " << outputRoot << "\n";
+        return 1;
+    }
+
+    std::map<std::string, uint64_t> totals;
+    std::vector<bool> seen;
+    size_t shardCount = 0;
+    bool consistent = true;
+
+    for (const auto& file : summaries) {
+        std::ifstream in(file);
+        std::string key;
+        uint64_t value = 0;
+        size_t index = 0, count = 0;
+
+        if (!(in >> key >> index >> count) || key != "shard" || count == 0 || index >= count ||
+            (shardCount != 0 && count != shardCount)) {
+            std::cerr << "Error: Unexpected shard summary: " << file.string() << "\n";
+            consistent = false;
+            continue;
+        }
+
+        shardCount = count;
+        seen.resize(shardCount, false);
+        seen[index] = true;
+
+        while (in >> key >> value) {
+            totals[key] += value;
+        }
+    }
+
+    size_t missing = 0;
+    for (size_t i = 0; i < seen.size(); ++i) {
+        if (!seen[i]) {
+            std::cerr << "Error: Shard " << i << "/" << shardCount << " has not reported\n";
+            missing++;
+        }
+    }
+
+    BatchManifest merged("");
+    size_t mergedManifests = 0;
+    for (const auto& file : manifests) {
+        BatchManifest shard(merged.optionsKey());
+        if (!shard.load(file)) {
+            std::cerr << "Warning: Skipping " << file.string() << ": " << shard.getLastError() << "\n";
+            continue;
+        }
+
+        if (mergedManifests++ == 0) {
+            merged = BatchManifest(shard.optionsKey());
+        }
+        for (const auto& [source, entry] : shard.entries()) {
+            merged.set(entry);
+        }
+    }
+
+    const fs::path manifestFile = root / BatchManifest::kFileName;
+    if (mergedManifests > 0 && !merged.save(manifestFile)) {
+        std::cerr << "Error: " << merged.getLastError() << "\n";
+        consistent = false;
+    }
+
+    std::cout << "Merged " << summaries.size() << " shard summary(ies) in " << outputRoot << "\n";
+    std::cout << "  Processed: " << totals["processed"] << " file(s)\n";
+    std::cout << "  Success: " << totals["success"] << "\n";
+    std::cout << "  Failed: " << totals["failed"] << "\n";
+    if (totals["unchanged"] > 0) std::cout << "  Unchanged: " << totals["unchanged"] << " (skipped)\n";
+    if (totals["resumed"] > 0) std::cout << "  Resumed: " << totals["resumed"] << " file(s) already done (skipped)\n";
+    if (totals["duplicates"] > 0) std::cout << "  Duplicates: " << totals["duplicates"] << "\n";
+    if (mergedManifests > 0) {
+        std::cout << "  Manifest: " << manifestFile.string() << " (" << merged.entries().size() << " source(s))\n";
+    }
+    if (missing > 0) {
+        std::cout << "  Missing shards: " << missing << "\n";
+    }
+
+    return (!consistent || missing > 0 || totals["failed"] > 0) ? 1 : 0;
+}
+
+} // namespace tim2
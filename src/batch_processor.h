@@ -0,0 +1,300 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "tim2_parser.h"
+#include "batch_planner.h"
+#include "bounded_queue.h"
+#include "output_names.h"
+#include "batch_manifest.h"
+#include "dedup_index.h"
+#include "texture_cache.h"
+#include "batch_journal.h"
+#include "memory_budget.h"
+#include "batch_progress.h"
+
+namespace tim2 {
+
+struct BatchOptions {
+    std::string inputPath;      // Directory to scan recursively (with fileList: base directory)
+    std::string fileList;       // Read source paths from this file ("-" = stdin) instead of scanning
+    bool nullSeparated = false; // fileList entries end in '\0' instead of '\n'
+    std::vector<std::string> files; // Explicit source paths, used like a file list (watch mode)
+    std::string format = "bmp"; // Output format: bmp or png
+    std::string outputFolder;   // Empty = save alongside source files
+    size_t threads = 0;         // Decode/encode workers (0 = hardware concurrency)
+    size_t scanThreads = 4;     // Directory scan threads
+    size_t readThreads = 2;     // Reader stage threads
+    size_t writeThreads = 2;    // Writer stage threads
+    size_t queueDepth = 0;      // Capacity of each stage queue (0 = 2 x workers)
+    size_t bandPixels = 1 << 16; // Decode images of 2x this size in row bands (0 = never split)
+    uint64_t memoryBudget = 0;  // Limit on the estimated memory of files in flight (0 = none)
+
+    // Discovery filters
+    bool detectContent = false;  // Sniff file headers instead of checking extensions
+    uintmax_t minFileSize = 0;   // Skip smaller files
+    uintmax_t maxFileSize = 0;   // Skip larger files (0 = no limit)
+    std::vector<std::string> includePatterns;  // If set, path must match one (see utils::globMatch)
+    std::vector<std::string> excludePatterns;  // Path must match none
+
+    bool dedup = false;         // Export identical pictures once, link the copies (see DedupIndex)
+    std::string cacheDir;       // Persistent encoded-export cache (empty = none, see TextureCache)
+    uintmax_t cacheMaxBytes = uintmax_t(1) << 30;  // Cache size limit, enforced after the run
+    bool incremental = false;   // Skip sources unchanged since the last run (see BatchManifest)
+    bool resume = false;        // Skip work an interrupted run finished (see BatchJournal)
+    size_t shardIndex = 0;      // Process only the files of shard shardIndex of shardCount
+    size_t shardCount = 1;
+    bool planOnly = false;      // --plan: print the estimated work and exit
+    bool progress = false;      // Live status line on stderr (see ProgressReporter)
+    std::string progressJson;   // Append JSON progress lines here ("-" = stderr)
+    bool verbose = false;
+};
+
+class ThreadPool;
+
+// Converts every TIM2 file below a directory, or every file in a list.
+//
+// The tree is scanned by a parallel DirectoryWalker that streams each
+// directory's files into the batch as soon as it has been listed. For every
+// file the batch reads the headers, estimates the cost of each export and
+// assigns the output names; a directory's files are named together, in name
+// order, so conflict resolution is deterministic even though directories are
+// discovered in any order. The conversion itself is a staged pipeline:
+//
+//   readers --[queue]--> decode/encode pool --[queue]--> writers
+//
+// Reader threads always load the largest file discovered so far (LPT). The
+// work-stealing pool parses each file and runs one decode task per exported
+// picture/mip level (split into row bands for large images) followed by an
+// encode task that produces the BMP/PNG bytes in memory. Writer threads put
+// those bytes on disk. The queues are bounded, so a stage that falls behind
+// stalls the ones feeding it instead of letting loaded files or encoded
+// images pile up; disk and CPUs stay busy at the same time.
+//
+// With a file list, there is no scan: one thread reads the list and feeds
+// runs of entries from the same directory into the batch as they arrive.
+// The input directory becomes the base that output paths are relative to,
+// and names are assigned in list order.
+//
+// Console output is buffered per file and each file's block is printed in
+// one piece when the file finishes.
+//
+// In incremental mode a manifest in the output root remembers each source's
+// size, mtime and hash and the outputs it produced. Sources whose stat (or,
+// if only the mtime moved, whose hash) still matches and whose outputs are
+// all present are skipped at discovery; re-exported sources keep the output
+// names they had before.
+//
+// With dedup, each export is keyed by its picture's content hash and mip
+// level; only the first export of a key is decoded and encoded, and the
+// others become links to its file once it is written. With a cache
+// directory, exports found there under the same key skip decoding and
+// encoding and go straight to the writers; new exports are added to it.
+//
+// Outputs are written to a temp file and renamed into place, and every run
+// keeps a journal of planned and finished exports in the output root until
+// it completes. After a crash, --resume skips the files whose exports were
+// all finished and reuses the planned names for the rest; leftover temp
+// files are deleted as their directories are listed.
+//
+// With shardCount > 1, each file belongs to the shard picked by a hash of its
+// path relative to the input root, and only that shard's files are exported.
+// Output names still come out as in a single run: a file whose stem is a
+// prefix of another's (or the other way round) may compete with it for a
+// name, so such neighbours from other shards are planned and named alongside
+// the shard's own files, then dropped. Shards may share one output
+// directory: on-disk files named like the names being planned are taken to
+// be other shards' outputs and reused, not avoided. State files get a
+// ".shard-i-of-N" suffix, and mergeShards() combines them once every shard
+// is done.
+class BatchProcessor {
+public:
+    explicit BatchProcessor(BatchOptions options);
+
+    // Run the whole batch; returns the process exit code
+    int run();
+
+    // Convert the tree, then keep converting files as they are written
+    // (see DirectoryWatcher) until stop is set; returns the process exit code
+    int watch(const std::atomic<bool>& stop);
+
+    // Combine the per-shard manifests and summaries in an output directory
+    // into one manifest and one summary; returns the process exit code
+    static int mergeShards(const std::string& outputRoot);
+
+    // Extension filter used for discovery (.tim2 / .tm2, any case)
+    static bool hasTIM2Extension(const std::filesystem::path& path);
+
+    // Discovery filter: globs, size limits, then extension or content sniff
+    bool acceptFile(const std::filesystem::directory_entry& entry) const;
+
+    // The glob and size part of acceptFile(), also applied to listed files
+    bool matchesFilters(const std::filesystem::directory_entry& entry) const;
+
+private:
+    struct LogLine {
+        bool isError;
+        std::string text;
+    };
+
+    struct ExportJob {
+        const Picture* pic;
+        const PlannedExport* plan;
+        bool success = false;
+        uint64_t contentKey = 0;   // Dedup/cache key
+        bool dedupLeader = false;  // Other exports wait for this one
+        std::string error;         // What a task threw, if one did
+    };
+
+    struct FileResult {
+        std::vector<LogLine> lines;
+        bool success = false;
+    };
+
+    // One discovered file: its plan and, once finished, its result.
+    // Entries are heap-allocated so pointers stay valid while more are added.
+    struct FileEntry {
+        size_t sequence = 0;  // Discovery order, breaks cost ties
+        PlannedFile plan;
+        FileResult result;
+        ManifestEntry record;  // Source key; incremental mode adds the stamp and (reader) hash
+        std::vector<ManifestOutput> previousOutputs;  // Names to keep, from the manifest or journal
+        uint64_t reservedMemory = 0;  // Held in m_memory from read until finishFile()
+    };
+
+    // Shared by all tasks of one file; the last task to finish reports it
+    struct FileContext {
+        FileEntry* entry;
+        std::unique_ptr<TIM2Parser> parser;
+        std::vector<ExportJob> jobs;
+        std::vector<LogLine> lines;
+        std::atomic<size_t> remainingJobs{0};
+    };
+
+    // Decoded pixels of one export, filled by one task or by several row bands
+    struct DecodeBuffer {
+        std::vector<Color32> pixels;
+        std::atomic<size_t> remainingBands{0};
+        std::atomic<bool> failed{false};  // A band threw: skip the encode
+    };
+
+    // Reader stage -> pool
+    struct LoadedFile {
+        FileEntry* entry = nullptr;
+        std::vector<uint8_t> bytes;
+        std::string error;  // Non-empty if the read failed
+    };
+
+    // Pool -> writer stage
+    struct EncodedOutput {
+        std::shared_ptr<FileContext> ctx;
+        size_t jobIndex = 0;
+        std::vector<uint8_t> bytes;
+        bool storeInCache = false;  // Freshly encoded, add to m_cache once written
+    };
+
+    BatchOptions m_options;
+    std::filesystem::path m_inputPath;
+    std::filesystem::path m_outputRoot;
+    bool m_useOutputFolder = false;
+    ThreadPool* m_pool = nullptr;
+
+    // Discovery and scheduling state, guarded by m_mutex
+    std::mutex m_mutex;
+    std::condition_variable m_pendingChanged;  // Readers wait for work
+    std::condition_variable m_resultReady;     // run() waits for finished files
+    std::vector<std::unique_ptr<FileEntry>> m_entries;
+    std::vector<FileEntry*> m_pending;         // Max-heap on estimated cost
+    std::vector<FileEntry*> m_finished;        // Not yet printed
+    bool m_discoveryDone = false;
+
+    // Output names: one listing per output directory, then in-memory only
+    OutputNameTable m_outputNames;
+
+    // Manifest, journal and dedup report live here (output root, or input root
+    // when saving alongside sources)
+    std::filesystem::path m_stateRoot;
+
+    // Incremental mode: the previous run's manifest (read-only while running)
+    // and the sources found unchanged, guarded by m_mutex
+    std::unique_ptr<BatchManifest> m_manifest;
+    std::vector<ManifestEntry> m_unchanged;
+
+    // This run's journal, and with --resume the interrupted run's (read-only)
+    // plus the sources it had finished, guarded by m_mutex
+    std::unique_ptr<BatchJournal> m_journal;
+    std::unique_ptr<BatchJournal> m_interrupted;
+    std::vector<ManifestEntry> m_resumed;
+
+    // Outputs are written as "<name>.<m_tempTag><kTempSuffix>" and then
+    // renamed; the tag is unique per process, so shards sharing a directory
+    // never write to the same temp file
+    static constexpr const char* kTempSuffix = ".tim2tmp";
+    std::string m_tempTag;
+    std::string tempPath(const std::string& output) const;
+
+    // Dedup mode
+    std::unique_ptr<DedupIndex> m_dedup;
+
+    // Persistent export cache (optional)
+    std::unique_ptr<TextureCache> m_cache;
+
+    // Memory budget (optional): readers reserve each file's estimated peak
+    std::unique_ptr<MemoryBudget> m_memory;
+
+    // Progress counters (always kept) and their reporter (optional)
+    BatchCounters m_counters;
+    std::unique_ptr<ProgressReporter> m_progress;
+
+    // Pipeline state
+    std::unique_ptr<BoundedQueue<LoadedFile>> m_readQueue;
+    std::unique_ptr<BoundedQueue<EncodedOutput>> m_writeQueue;
+    std::atomic<size_t> m_filesInFlight{0};
+    size_t m_maxFilesInFlight = 1;
+
+    void addDirectoryGroup(std::vector<std::filesystem::path> files);
+    void readFileList();
+    void finishDiscovery();
+    FileEntry* nextPendingFile();
+    static bool lessUrgent(const FileEntry* a, const FileEntry* b);
+    std::string shardSuffix() const;
+    void selectShardFiles(const std::vector<std::filesystem::path>& files,
+                          std::vector<bool>& own, std::vector<bool>& needed) const;
+    void releaseShardNames(const std::vector<std::unique_ptr<FileEntry>>& group);
+    void writeShardSummary(size_t processedCount, int successCount, int failCount);
+    void planOutputNames(PlannedFile& file, const std::vector<ManifestOutput>& previous);
+    static std::string exportBaseName(const PlannedFile& file, const PlannedExport& e);
+    std::vector<ManifestOutput> plannedOutputs(const PlannedFile& file) const;
+    bool checkUnchanged(FileEntry& entry, const ManifestEntry*& previous);
+    bool checkResumed(FileEntry& entry);
+    void saveManifest();
+    void runPipeline(size_t threadCount, size_t& processedCount, int& successCount, int& failCount);
+
+    // Stage bodies
+    void readerLoop();
+    void dispatchLoop();
+    void writerLoop();
+
+    // Pool tasks
+    void parseFile(LoadedFile& loaded);
+    void decodeExport(const std::shared_ptr<FileContext>& ctx, size_t jobIndex);
+    void decodeBand(const std::shared_ptr<FileContext>& ctx, size_t jobIndex,
+                    const std::shared_ptr<DecodeBuffer>& decoded, size_t firstRow, size_t rowCount, size_t width);
+    void encodeExport(const std::shared_ptr<FileContext>& ctx, size_t jobIndex,
+                      const std::shared_ptr<DecodeBuffer>& decoded);
+
+    void linkDuplicate(const std::shared_ptr<FileContext>& ctx, size_t jobIndex, const std::string* leaderPath);
+    void failExport(const std::shared_ptr<FileContext>& ctx, size_t jobIndex, const char* what);
+    void finishExport(const std::shared_ptr<FileContext>& ctx, size_t jobIndex);
+    void finishJob(const std::shared_ptr<FileContext>& ctx);
+    void finishFile(FileEntry* entry, std::vector<LogLine> lines, bool success, size_t exportsFinished = 0);
+};
+
+} // namespace tim2
@@ -0,0 +1,229 @@
+#include "batch_progress.h"
+#include "json_writer.h"
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#ifdef _WIN32
+#include <io.h>
+#define TIM2_ISATTY(fd) _isatty(fd)
+#define TIM2_FILENO(f) _fileno(f)
+#else
+#include <unistd.h>
+#define TIM2_ISATTY(fd) isatty(fd)
+#define TIM2_FILENO(f) fileno(f)
+#endif
+
+namespace tim2 {
+
+namespace {
+
+constexpr auto kTick = std::chrono::milliseconds(250);  // Terminal redraw rate
+constexpr double kPlainLineInterval = 10.0;             // Seconds, non-terminal stderr
+constexpr double kJsonInterval = 5.0;                   // Seconds
+constexpr double kRateSmoothing = 0.3;                  // Weight of the newest rate sample
+constexpr double kCostRateSmoothing = 0.05;             // Slower: ~5 s window for the ETA
+
+std::string formatEta(double seconds) {
+    if (seconds < 0) return "--";
+
+    const uint64_t total = static_cast<uint64_t>(seconds + 0.5);
+    char text[32];
+    if (total >= 3600) {
+        std::snprintf(text, sizeof(text), "%lluh%02llum", static_cast<unsigned long long>(total / 3600),
+                      static_cast<unsigned long long>(total / 60 % 60));
+    } else if (total >= 60) {
+        std::snprintf(text, sizeof(text), "%llum%02llus", static_cast<unsigned long long>(total / 60),
+                      static_cast<unsigned long long>(total % 60));
+    } else {
+        std::snprintf(text, sizeof(text), "%llus", static_cast<unsigned long long>(total));
+    }
+    return text;
+}
+
+} // namespace
+
+void BatchCounters::reset() {
+    for (auto* counter : {&filesQueued, &filesDone, &filesFailed, &exportsQueued, &exportsDone, &bytesRead,
+                          &bytesWritten, &costQueued, &costDone, &decodeNanos, &encodeNanos}) {
+        counter->store(0, std::memory_order_relaxed);
+    }
+    discoveryDone.store(false, std::memory_order_relaxed);
+}
+
+ProgressReporter::ProgressReporter(const BatchCounters& counters, size_t workers, bool live,
+                                   const std::string& jsonPath)
+    : m_counters(counters), m_workers(std::max<size_t>(1, workers)), m_live(live) {
+    m_terminal = live && TIM2_ISATTY(TIM2_FILENO(stderr));
+
+    if (jsonPath == "-") {
+        m_json = &std::cerr;
+    } else if (!jsonPath.empty()) {
+        m_jsonFile.open(jsonPath, std::ios::app);
+        if (m_jsonFile) {
+            m_json = &m_jsonFile;
+        } else {
+            std::cerr << "Warning: Cannot open progress log " << jsonPath << "\n";
+        }
+    }
+}
+
+ProgressReporter::~ProgressReporter() {
+    stop();
+}
+
+void ProgressReporter::start() {
+    m_start = std::chrono::steady_clock::now();
+    m_previous = sample();
+    m_thread = std::thread([this] { loop(); });
+}
+
+void ProgressReporter::stop() {
+    if (!m_thread.joinable()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_stopMutex);
+        m_stopping = true;
+    }
+    m_stopChanged.notify_all();
+    m_thread.join();
+
+    const Sample now = sample();
+    update(now);
+
+    std::lock_guard<std::mutex> lock(m_consoleMutex);
+    if (m_lineShown) {
+        std::cerr << "\r\033[K" << std::flush;
+        m_lineShown = false;
+    }
+    if (m_json) {
+        *m_json << jsonLine(now, true) << "\n" << std::flush;
+    }
+}
+
+std::unique_lock<std::mutex> ProgressReporter::holdConsole() {
+    std::unique_lock<std::mutex> lock(m_consoleMutex);
+    if (m_lineShown) {
+        std::cerr << "\r\033[K" << std::flush;
+        m_lineShown = false;
+    }
+    return lock;
+}
+
+ProgressReporter::Sample ProgressReporter::sample() const {
+    constexpr auto relaxed = std::memory_order_relaxed;
+    Sample s;
+    s.filesQueued = m_counters.filesQueued.load(relaxed);
+    s.filesDone = m_counters.filesDone.load(relaxed);
+    s.filesFailed = m_counters.filesFailed.load(relaxed);
+    s.exportsQueued = m_counters.exportsQueued.load(relaxed);
+    s.exportsDone = m_counters.exportsDone.load(relaxed);
+    s.bytesRead = m_counters.bytesRead.load(relaxed);
+    s.bytesWritten = m_counters.bytesWritten.load(relaxed);
+    s.costQueued = m_counters.costQueued.load(relaxed);
+    s.costDone = m_counters.costDone.load(relaxed);
+    s.decodeNanos = m_counters.decodeNanos.load(relaxed);
+    s.encodeNanos = m_counters.encodeNanos.load(relaxed);
+    s.discoveryDone = m_counters.discoveryDone.load(relaxed);
+    s.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    return s;
+}
+
+/**
+ * Reporter thread: sample every tick to keep the smoothed rates current, and
+ * emit whichever outputs are due.
+ */
+void ProgressReporter::loop() {
+    double lastPlain = 0;
+    double lastJson = 0;
+
+    std::unique_lock<std::mutex> stopLock(m_stopMutex);
+    while (!m_stopChanged.wait_for(stopLock, kTick, [this] { return m_stopping; })) {
+        const Sample now = sample();
+        update(now);
+
+        std::lock_guard<std::mutex> lock(m_consoleMutex);
+        if (m_terminal) {
+            std::cerr << "\r" << statusLine(now) << "\033[K" << std::flush;
+            m_lineShown = true;
+        } else if (m_live && now.elapsed - lastPlain >= kPlainLineInterval) {
+            std::cerr << statusLine(now) << "\n";
+            lastPlain = now.elapsed;
+        }
+        if (m_json && now.elapsed - lastJson >= kJsonInterval) {
+            *m_json << jsonLine(now, false) << "\n" << std::flush;
+            lastJson = now.elapsed;
+        }
+    }
+}
+
+// Exponentially smoothed throughput since the previous sample
+void ProgressReporter::update(const Sample& now) {
+    const double interval = now.elapsed - m_previous.elapsed;
+    if (interval <= 0) return;
+
+    const double readRate = (now.bytesRead - m_previous.bytesRead) / interval;
+    const double writeRate = (now.bytesWritten - m_previous.bytesWritten) / interval;
+    m_readRate += kRateSmoothing * (readRate - m_readRate);
+    m_writeRate += kRateSmoothing * (writeRate - m_writeRate);
+
+    const double costRate = (now.costDone - m_previous.costDone) / interval;
+    m_costRate = m_costRate > 0 ? m_costRate + kCostRateSmoothing * (costRate - m_costRate) : costRate;
+    m_previous = now;
+}
+
+/**
+ * Remaining estimated cost over the recent rate at which cost is completed.
+ * Files run largest first and the cost model is only roughly proportional
+ * to time, so the rate drifts during a run; a recent rate follows that drift
+ * where the whole-run average would not. While the scan is still running the
+ * total is a lower bound, so the ETA is too.
+ */
+double ProgressReporter::etaSeconds(const Sample& now) const {
+    if (m_costRate <= 0) return -1;
+    const uint64_t remaining = now.costQueued > now.costDone ? now.costQueued - now.costDone : 0;
+    return remaining / m_costRate;
+}
+
+std::string ProgressReporter::statusLine(const Sample& now) const {
+    const char* more = now.discoveryDone ? "" : "+";
+    const double workNanos = static_cast<double>(now.decodeNanos + now.encodeNanos);
+    const double decodeShare = workNanos > 0 ? 100.0 * now.decodeNanos / workNanos : 0;
+    const double busy = now.elapsed > 0 ? 100.0 * workNanos / (now.elapsed * 1e9 * m_workers) : 0;
+
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(1);
+    line << "files " << now.filesDone << "/" << now.filesQueued << more;
+    if (now.filesFailed > 0) line << " (" << now.filesFailed << " failed)";
+    line << " | exports " << now.exportsDone << "/" << now.exportsQueued << more
+         << " | in " << m_readRate / 1048576.0 << " MB/s, out " << m_writeRate / 1048576.0 << " MB/s"
+         << " | decode " << std::setprecision(0) << decodeShare << "% encode " << (workNanos > 0 ? 100 - decodeShare : 0)
+         << "%, busy " << busy << "%"
+         << " | ETA " << formatEta(etaSeconds(now)) << more;
+    return line.str();
+}
+
+std::string ProgressReporter::jsonLine(const Sample& now, bool done) const {
+    JsonWriter json;
+    json.beginObject()
+        .field("elapsed", now.elapsed)
+        .field("filesDone", now.filesDone)
+        .field("filesQueued", now.filesQueued)
+        .field("filesFailed", now.filesFailed)
+        .field("scanning", !now.discoveryDone)
+        .field("exportsDone", now.exportsDone)
+        .field("exportsQueued", now.exportsQueued)
+        .field("bytesRead", now.bytesRead)
+        .field("bytesWritten", now.bytesWritten)
+        .field("readBytesPerSec", m_readRate)
+        .field("writeBytesPerSec", m_writeRate)
+        .field("decodeSeconds", now.decodeNanos / 1e9)
+        .field("encodeSeconds", now.encodeNanos / 1e9)
+        .field("etaSeconds", done ? 0.0 : etaSeconds(now))
+        .field("done", done)
+        .endObject();
+    return json.str();
+}
+
+} // namespace tim2
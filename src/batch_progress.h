@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace tim2 {
+
+// Live counters of a batch run. Pipeline threads only add to them, with
+// relaxed atomics (one update per task, not per pixel); ProgressReporter
+// reads them from its own thread. A snapshot is therefore not exactly
+// consistent across counters, which is fine for a progress display.
+struct BatchCounters {
+    std::atomic<uint64_t> filesQueued{0};
+    std::atomic<uint64_t> filesDone{0};
+    std::atomic<uint64_t> filesFailed{0};
+    std::atomic<uint64_t> exportsQueued{0};
+    std::atomic<uint64_t> exportsDone{0};
+    std::atomic<uint64_t> bytesRead{0};
+    std::atomic<uint64_t> bytesWritten{0};
+    std::atomic<uint64_t> costQueued{0};   // BatchPlanner estimates, for the ETA
+    std::atomic<uint64_t> costDone{0};
+    std::atomic<uint64_t> decodeNanos{0};  // Worker time spent decoding
+    std::atomic<uint64_t> encodeNanos{0};  // Worker time spent encoding
+    std::atomic<bool> discoveryDone{false};
+
+    static void add(std::atomic<uint64_t>& counter, uint64_t value) {
+        counter.fetch_add(value, std::memory_order_relaxed);
+    }
+    void reset();
+};
+
+// Periodic batch progress output.
+//
+// The live display is one status line on stderr: files, exports, input and
+// output throughput, how worker time splits between decoding and encoding,
+// and an ETA from the planner's cost estimates. On a terminal it is redrawn
+// in place a few times per second; otherwise a plain line is printed every
+// few seconds. The JSON log gets one object per line at a fixed interval and
+// a final one with "done": true, for schedulers and dashboards.
+class ProgressReporter {
+public:
+    // jsonPath: append JSON lines there ("-" = stderr); empty = no JSON
+    ProgressReporter(const BatchCounters& counters, size_t workers, bool live, const std::string& jsonPath);
+    ~ProgressReporter();
+
+    ProgressReporter(const ProgressReporter&) = delete;
+    ProgressReporter& operator=(const ProgressReporter&) = delete;
+
+    void start();
+
+    // Stop the thread, clear the live line and write the final JSON line
+    void stop();
+
+    // Hold while printing other console output; clears the live line first
+    std::unique_lock<std::mutex> holdConsole();
+
+private:
+    struct Sample {
+        uint64_t filesQueued, filesDone, filesFailed;
+        uint64_t exportsQueued, exportsDone;
+        uint64_t bytesRead, bytesWritten;
+        uint64_t costQueued, costDone;
+        uint64_t decodeNanos, encodeNanos;
+        bool discoveryDone;
+        double elapsed;  // Seconds since start()
+    };
+
+    const BatchCounters& m_counters;
+    size_t m_workers;
+    bool m_live;
+    bool m_terminal = false;
+    std::ofstream m_jsonFile;
+    std::ostream* m_json = nullptr;
+
+    std::chrono::steady_clock::time_point m_start;
+    Sample m_previous{};
+    double m_readRate = 0;   // Smoothed bytes per second
+    double m_writeRate = 0;
+    double m_costRate = 0;   // Smoothed estimated cost completed per second
+
+    std::thread m_thread;
+    std::mutex m_stopMutex;
+    std::condition_variable m_stopChanged;
+    bool m_stopping = false;
+
+    std::mutex m_consoleMutex;
+    bool m_lineShown = false;
+
+    Sample sample() const;
+    void loop();
+    void update(const Sample& now);
+    std::string statusLine(const Sample& now) const;
+    std::string jsonLine(const Sample& now, bool done) const;
+    double etaSeconds(const Sample& now) const;
+};
+
+} // namespace tim2
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+namespace tim2 {
+
+// Bounded multi-producer/multi-consumer queue connecting batch pipeline stages.
+//
+// The ring itself is lock-free (Dmitry Vyukov's bounded MPMC design: each
+// cell carries a sequence number that tells producers and consumers whether
+// it is free or filled for their lap). push()/pop() add blocking on top with
+// C++20 atomic wait/notify, which is what gives the pipeline backpressure: a
+// fast stage stalls once the queue in front of a slow stage is full.
+template <typename T>
+class BoundedQueue {
+public:
+    // Capacity is rounded up to a power of two
+    explicit BoundedQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+
+        m_mask = size - 1;
+        m_cells = std::make_unique<Cell[]>(size);
+        for (size_t i = 0; i < size; ++i) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // Non-blocking; leaves value untouched and returns false when full
+    bool tryPush(T& value) {
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[pos & m_mask];
+            const size_t seq = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+            if (diff == 0) {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Non-blocking; returns nullopt when empty
+    std::optional<T> tryPop() {
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[pos & m_mask];
+            const size_t seq = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+
+            if (diff == 0) {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    std::optional<T> result(std::move(cell.value));
+                    cell.value = T{};
+                    cell.sequence.store(pos + m_mask + 1, std::memory_order_release);
+                    return result;
+                }
+            } else if (diff < 0) {
+                return std::nullopt;
+            } else {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Block while full. Returns false (value untouched) if the queue was closed.
+    bool push(T value) {
+        for (;;) {
+            const uint32_t popEpoch = m_popEpoch.load(std::memory_order_acquire);
+            if (m_closed.load(std::memory_order_acquire)) return false;
+
+            if (tryPush(value)) {
+                m_pushEpoch.fetch_add(1, std::memory_order_release);
+                m_pushEpoch.notify_all();
+                return true;
+            }
+            m_popEpoch.wait(popEpoch, std::memory_order_acquire);
+        }
+    }
+
+    // Block while empty. Returns nullopt once the queue is closed and drained.
+    std::optional<T> pop() {
+        for (;;) {
+            const uint32_t pushEpoch = m_pushEpoch.load(std::memory_order_acquire);
+
+            if (auto value = tryPop()) {
+                m_popEpoch.fetch_add(1, std::memory_order_release);
+                m_popEpoch.notify_all();
+                return value;
+            }
+            if (m_closed.load(std::memory_order_acquire)) {
+                // A push may have landed between tryPop and the closed check
+                if (auto value = tryPop()) return value;
+                return std::nullopt;
+            }
+            m_pushEpoch.wait(pushEpoch, std::memory_order_acquire);
+        }
+    }
+
+    // Wake everyone; further pushes fail, pops drain what is left
+    void close() {
+        m_closed.store(true, std::memory_order_release);
+        m_pushEpoch.fetch_add(1, std::memory_order_release);
+        m_popEpoch.fetch_add(1, std::memory_order_release);
+        m_pushEpoch.notify_all();
+        m_popEpoch.notify_all();
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence{0};
+        T value{};
+    };
+
+    std::unique_ptr<Cell[]> m_cells;
+    size_t m_mask = 0;
+
+    alignas(64) std::atomic<size_t> m_enqueuePos{0};
+    alignas(64) std::atomic<size_t> m_dequeuePos{0};
+    alignas(64) std::atomic<uint32_t> m_pushEpoch{0};
+    alignas(64) std::atomic<uint32_t> m_popEpoch{0};
+    std::atomic<bool> m_closed{false};
+};
+
+} // namespace tim2
@@ -0,0 +1,399 @@
+#include "conversion_server.h"
+#include "tim2_parser.h"
+#include "image_converter.h"
+#include "thread_pool.h"
+#include "json_writer.h"
+#include "hash.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <latch>
+#include <sstream>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace tim2 {
+
+using namespace protocol;
+
+namespace {
+
+#ifndef _WIN32
+// Fill a sockaddr_un; false if the path does not fit
+bool makeAddress(const std::string& path, sockaddr_un& address) {
+    address = {};
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) return false;
+    std::copy(path.begin(), path.end(), address.sun_path);
+    return true;
+}
+
+int connectTo(const std::string& path) {
+    sockaddr_un address;
+    if (!makeAddress(path, address)) return -1;
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+#endif
+
+std::string infoJson(const TIM2Parser& parser) {
+    const FileHeader& header = parser.getFileHeader();
+    JsonWriter json;
+    json.beginObject()
+        .field("version", header.formatVersion)
+        .field("alignment", header.formatId == TIM2_ALIGN_128 ? 128 : 16)
+        .key("pictures").beginArray();
+
+    for (const auto& pic : parser.getPictures()) {
+        char hash[20];
+        std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(pic.contentHash()));
+
+        json.beginObject()
+            .field("width", pic.header.imageWidth)
+            .field("height", pic.header.imageHeight)
+            .field("format", pixelFormatToString(static_cast<PixelFormat>(pic.header.imageType)))
+            .field("clutColors", pic.header.clutColors)
+            .field("mipLevels", pic.header.mipMapTextures)
+            .field("imageSize", pic.header.imageSize)
+            .field("clutSize", pic.header.clutSize)
+            .field("contentHash", std::string_view(hash))
+            .endObject();
+    }
+
+    json.endArray().endObject();
+    return json.str();
+}
+
+} // namespace
+
+ConversionServer::ConversionServer(ServerOptions options)
+    : m_options(std::move(options)) {
+}
+
+ConversionServer::~ConversionServer() = default;
+
+#ifndef _WIN32
+
+/**
+ * Accept loop. An existing socket file is only replaced if nothing answers
+ * on it, so a second server cannot steal the path from a running one. The
+ * loop wakes up regularly to check stop; on shutdown, open connections are
+ * shut down so their threads leave their blocking reads, then joined.
+ */
+int ConversionServer::run(const std::atomic<bool>& stop) {
+    sockaddr_un address;
+    if (!makeAddress(m_options.socketPath, address)) {
+        std::cerr << "Error: Invalid socket path: " << m_options.socketPath << "\n";
+        return 1;
+    }
+
+    std::error_code ec;
+    if (fs::exists(m_options.socketPath, ec)) {
+        const int probe = connectTo(m_options.socketPath);
+        if (probe >= 0) {
+            close(probe);
+            std::cerr << "Error: A server is already listening on " << m_options.socketPath << "\n";
+            return 1;
+        }
+        if (!fs::is_socket(m_options.socketPath, ec)) {
+            std::cerr << "Error: " << m_options.socketPath << " exists and is not a socket\n";
+            return 1;
+        }
+        fs::remove(m_options.socketPath, ec);
+    }
+
+    const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listener, 64) != 0) {
+        std::cerr << "Error: Cannot listen on " << m_options.socketPath << ": " << std::strerror(errno) << "\n";
+        if (listener >= 0) close(listener);
+        return 1;
+    }
+
+    // A client that disconnects mid-response must not kill the server
+    std::signal(SIGPIPE, SIG_IGN);
+
+    const size_t threadCount = m_options.threads > 0 ? m_options.threads : ThreadPool::defaultThreadCount();
+    m_pool = std::make_unique<ThreadPool>(threadCount);
+
+    std::cout << "Listening on " << m_options.socketPath << " (" << threadCount
+              << " decode threads); press Ctrl+C to stop\n";
+
+    while (!stop) {
+        pollfd descriptor{listener, POLLIN, 0};
+        const int ready = poll(&descriptor, 1, 200);
+
+        {
+            // Reap finished connections
+            std::lock_guard<std::mutex> lock(m_connectionsMutex);
+            for (auto it = m_connections.begin(); it != m_connections.end();) {
+                if ((*it)->done) {
+                    (*it)->thread.join();
+                    it = m_connections.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        if (ready <= 0) continue;
+
+        const int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) continue;
+
+        auto connection = std::make_unique<Connection>();
+        connection->fd = fd;
+        Connection& ref = *connection;
+        std::lock_guard<std::mutex> lock(m_connectionsMutex);
+        m_connections.push_back(std::move(connection));
+        ref.thread = std::thread([this, &ref] { serveConnection(ref); });
+    }
+
+    close(listener);
+    fs::remove(m_options.socketPath, ec);
+
+    {
+        std::lock_guard<std::mutex> lock(m_connectionsMutex);
+        for (auto& connection : m_connections) {
+            if (!connection->done) shutdown(connection->fd, SHUT_RDWR);
+        }
+    }
+    for (auto& connection : m_connections) {
+        connection->thread.join();
+    }
+    m_connections.clear();
+    m_pool.reset();
+
+    std::cout << "\nServed " << m_requests.load() << " request(s), " << m_cacheHits.load() << " cache hit(s)\n";
+    return 0;
+}
+
+void ConversionServer::serveConnection(Connection& connection) {
+    std::vector<Color32> pixels;  // Reused by every request on this connection
+
+    for (;;) {
+        Request request;
+        bool malformed = false;
+        if (!receiveRequest(connection.fd, request, malformed)) break;
+
+        const auto start = std::chrono::steady_clock::now();
+        const Response response = malformed ? Response::error("Malformed request") : handle(request, pixels);
+        m_requests++;
+
+        if (m_options.verbose) {
+            const auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+            std::ostringstream line;
+            line << (malformed ? "?" : request.op == Op::Info ? "info" : "export") << " ";
+            if (request.source == Source::Path) {
+                line.write(reinterpret_cast<const char*>(request.data.data()),
+                           static_cast<std::streamsize>(request.data.size()));
+            } else {
+                line << "<" << request.data.size() << " bytes>";
+            }
+            line << " -> " << (response.status == Status::Ok ? "ok" : "error") << " ("
+                 << elapsed.count() << " ms)\n";
+            std::cout << line.str();
+        }
+
+        if (!sendResponse(connection.fd, response)) break;
+    }
+
+    close(connection.fd);
+    connection.done = true;
+}
+
+bool sendServerRequest(const std::string& socketPath, const Request& request, Response& response,
+                       std::string& error) {
+    std::signal(SIGPIPE, SIG_IGN);
+
+    const int fd = connectTo(socketPath);
+    if (fd < 0) {
+        error = "Cannot connect to " + socketPath + ": " + std::strerror(errno);
+        return false;
+    }
+
+    const bool ok = sendRequest(fd, request) && receiveResponse(fd, response);
+    close(fd);
+    if (!ok) error = "Connection to " + socketPath + " was closed";
+    return ok;
+}
+
+#else
+
+int ConversionServer::run(const std::atomic<bool>&) {
+    std::cerr << "Error: 'serve' needs Unix domain sockets and is not available on this platform\n";
+    return 1;
+}
+
+void ConversionServer::serveConnection(Connection&) {
+}
+
+bool sendServerRequest(const std::string&, const Request&, Response&, std::string& error) {
+    error = "'client' needs Unix domain sockets and is not available on this platform";
+    return false;
+}
+
+#endif
+
+/**
+ * Parse the source (read from disk for path requests) and answer it. Export
+ * responses come from the cache when the same picture content, mip level and
+ * format has been encoded before, even if it was sent under another path.
+ */
+Response ConversionServer::handle(const Request& request, std::vector<Color32>& pixels) {
+    TIM2Parser parser;
+    const bool loaded = request.source == Source::Path
+                            ? parser.loadFile(std::string(request.data.begin(), request.data.end()))
+                            : parser.loadFromMemory(request.data.data(), request.data.size());
+    if (!loaded) {
+        return Response::error(parser.getLastError());
+    }
+
+    Response response;
+    if (request.op == Op::Info) {
+        const std::string json = infoJson(parser);
+        response.kind = Kind::Json;
+        response.body.assign(json.begin(), json.end());
+        return response;
+    }
+
+    const Picture* pic = parser.getPicture(request.picture);
+    if (!pic) {
+        return Response::error("Picture index out of range: " + std::to_string(request.picture));
+    }
+    // A picture without mip levels has no image, as in the batch planner
+    if (request.mip >= pic->header.mipMapTextures) {
+        return Response::error("MIP level out of range: " + std::to_string(request.mip));
+    }
+
+    Hash64 key;
+    key.updateValue(pic->contentHash());
+    key.updateValue(request.mip);
+    key.updateValue(request.format);
+
+    response.kind = Kind::Image;
+    if (cacheLookup(key.digest(), response.body)) {
+        m_cacheHits++;
+        return response;
+    }
+
+    std::string decodeError;
+    if (!decode(*pic, request.mip, pixels, decodeError)) {
+        return Response::error("Failed to decode image: " + decodeError);
+    }
+    const size_t width = pic->getMipMapWidth(request.mip);
+    const size_t height = pic->getMipMapHeight(request.mip);
+    const bool encoded = request.format == Format::PNG
+                             ? ImageConverter::encodePNG(pixels, width, height, response.body)
+                             : ImageConverter::encodeBMP(pixels, width, height, response.body);
+    if (!encoded) {
+        return Response::error("Failed to encode image");
+    }
+
+    cacheStore(key.digest(), response.body);
+    return response;
+}
+
+/**
+ * Decode into the connection's buffer: directly for small images, in row
+ * bands on the shared pool for large ones (the connection thread waits).
+ * Returns false with the message if decoding threw; every band counts down
+ * either way, so the wait always ends.
+ */
+bool ConversionServer::decode(const Picture& pic, size_t mip, std::vector<Color32>& pixels, std::string& error) {
+    const size_t width = pic.getMipMapWidth(mip);
+    const size_t height = pic.getMipMapHeight(mip);
+    const size_t bandPixels = m_options.bandPixels;
+
+    try {
+        pixels.resize(width * height);
+        if (bandPixels == 0 || width * height < 2 * bandPixels || height < 2) {
+            pic.decodeRows(mip, 0, height, pixels.data());
+            return true;
+        }
+    } catch (const std::exception& e) {
+        error = e.what();
+        return false;
+    }
+
+    const size_t rowsPerBand = std::max<size_t>(1, bandPixels / width);
+    const size_t bandCount = (height + rowsPerBand - 1) / rowsPerBand;
+    std::latch done(static_cast<std::ptrdiff_t>(bandCount));
+    std::mutex errorMutex;
+    bool failed = false;
+
+    for (size_t band = 0; band < bandCount; ++band) {
+        const size_t firstRow = band * rowsPerBand;
+        const size_t rowCount = std::min(rowsPerBand, height - firstRow);
+        try {
+            m_pool->submit([&pic, &pixels, &done, &errorMutex, &failed, &error, mip, firstRow, rowCount, width] {
+                try {
+                    pic.decodeRows(mip, firstRow, rowCount, pixels.data() + firstRow * width);
+                } catch (const std::exception& e) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if (!failed) error = e.what();
+                    failed = true;
+                }
+                done.count_down();
+            });
+        } catch (const std::exception& e) {
+            // Count down for the bands that will never run
+            {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!failed) error = e.what();
+                failed = true;
+            }
+            done.count_down(static_cast<std::ptrdiff_t>(bandCount - band));
+            break;
+        }
+    }
+    done.wait();
+    return !failed;
+}
+
+bool ConversionServer::cacheLookup(uint64_t key, std::vector<uint8_t>& bytes) {
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    auto it = m_cacheIndex.find(key);
+    if (it == m_cacheIndex.end()) return false;
+
+    m_cache.splice(m_cache.begin(), m_cache, it->second);
+    bytes = it->second->second;
+    return true;
+}
+
+void ConversionServer::cacheStore(uint64_t key, const std::vector<uint8_t>& bytes) {
+    if (bytes.size() > m_options.cacheMaxBytes) return;
+
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    if (m_cacheIndex.count(key)) return;  // Another connection stored it first
+
+    m_cache.emplace_front(key, bytes);
+    m_cacheIndex[key] = m_cache.begin();
+    m_cacheBytes += bytes.size();
+
+    while (m_cacheBytes > m_options.cacheMaxBytes) {
+        m_cacheBytes -= m_cache.back().second.size();
+        m_cacheIndex.erase(m_cache.back().first);
+        m_cache.pop_back();
+    }
+}
+
+} // namespace tim2
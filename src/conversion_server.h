@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "server_protocol.h"
+#include "tim2_types.h"
+
+namespace tim2 {
+
+class Picture;
+class ThreadPool;
+
+struct ServerOptions {
+    std::string socketPath;
+    size_t threads = 0;          // Band decode workers (0 = hardware concurrency)
+    size_t bandPixels = 1 << 16; // Split decodes of 2x this size into row bands (0 = never)
+    uintmax_t cacheMaxBytes = uintmax_t(256) << 20;  // Encoded-image memory cache
+    bool verbose = false;
+};
+
+// Conversion daemon for `serve` (POSIX only).
+//
+// Listens on a Unix domain socket and answers info and export requests (see
+// server_protocol.h) until stopped. Each connection gets its own thread and
+// its own reusable pixel buffer; large decodes are split into row bands on
+// one shared, long-lived worker pool. Encoded images are kept in an LRU
+// memory cache keyed by picture content, mip level and format, so repeated
+// requests for the same texture skip decoding and encoding entirely.
+class ConversionServer {
+public:
+    explicit ConversionServer(ServerOptions options);
+    ~ConversionServer();
+
+    // Serve until stop is set; returns the process exit code
+    int run(const std::atomic<bool>& stop);
+
+private:
+    struct Connection {
+        int fd = -1;
+        std::thread thread;
+        std::atomic<bool> done{false};
+    };
+
+    ServerOptions m_options;
+    std::unique_ptr<ThreadPool> m_pool;
+
+    std::mutex m_connectionsMutex;
+    std::list<std::unique_ptr<Connection>> m_connections;
+
+    // LRU cache: most recently used at the front
+    using CacheList = std::list<std::pair<uint64_t, std::vector<uint8_t>>>;
+    std::mutex m_cacheMutex;
+    CacheList m_cache;
+    std::unordered_map<uint64_t, CacheList::iterator> m_cacheIndex;
+    uintmax_t m_cacheBytes = 0;
+
+    std::atomic<uint64_t> m_requests{0};
+    std::atomic<uint64_t> m_cacheHits{0};
+
+    void serveConnection(Connection& connection);
+    protocol::Response handle(const protocol::Request& request, std::vector<Color32>& pixels);
+    bool decode(const Picture& pic, size_t mip, std::vector<Color32>& pixels, std::string& error);
+
+    bool cacheLookup(uint64_t key, std::vector<uint8_t>& bytes);
+    void cacheStore(uint64_t key, const std::vector<uint8_t>& bytes);
+};
+
+// Send one request to a running server; false with an error message if the
+// server cannot be reached or the connection breaks
+bool sendServerRequest(const std::string& socketPath, const protocol::Request& request,
+                       protocol::Response& response, std::string& error);
+
+} // namespace tim2
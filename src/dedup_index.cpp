@@ -0,0 +1,165 @@
+#include "dedup_index.h"
+#include <algorithm>
+#include <fstream>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace tim2 {
+
+namespace {
+
+// Copy-on-write clone of a whole file (btrfs, XFS, bcachefs, ...)
+bool reflinkFile(const fs::path& from, const fs::path& to) {
+#if defined(__linux__) && defined(FICLONE)
+    const int src = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (src < 0) return false;
+
+    const int dst = ::open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (dst < 0) {
+        ::close(src);
+        return false;
+    }
+
+    const bool cloned = ::ioctl(dst, FICLONE, src) == 0;
+    ::close(dst);
+    ::close(src);
+
+    if (!cloned) {
+        std::error_code ec;
+        fs::remove(to, ec);
+    }
+    return cloned;
+#else
+    (void)from;
+    (void)to;
+    return false;
+#endif
+}
+
+} // namespace
+
+bool DedupIndex::acquire(uint64_t key, const std::string& outputPath, Waiter waiter) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    auto [it, inserted] = m_entries.try_emplace(key);
+    Entry& entry = it->second;
+    if (inserted) {
+        entry.leaderPath = outputPath;
+        return true;
+    }
+
+    if (!entry.done) {
+        entry.waiters.push_back(std::move(waiter));
+        return false;
+    }
+
+    const std::string leaderPath = entry.leaderPath;
+    lock.unlock();
+    waiter(&leaderPath);
+    return false;
+}
+
+/**
+ * Settle a leader. Waiters run on the calling thread, outside the lock. On
+ * failure the key is forgotten, so a later export with the same content can
+ * become the leader again.
+ */
+void DedupIndex::complete(uint64_t key, bool success) {
+    std::vector<Waiter> waiters;
+    std::string leaderPath;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(key);
+        if (it == m_entries.end()) return;
+
+        waiters.swap(it->second.waiters);
+        if (success) {
+            it->second.done = true;
+            leaderPath = it->second.leaderPath;
+        } else {
+            m_entries.erase(it);
+        }
+    }
+
+    for (auto& waiter : waiters) {
+        waiter(success ? &leaderPath : nullptr);
+    }
+}
+
+/**
+ * Hardlinks cost nothing but share the inode, so the batch writer always
+ * replaces output files rather than writing into them. Reflinks are
+ * independent files that share blocks; plain copies are the fallback.
+ */
+LinkMethod DedupIndex::materialize(const fs::path& from, const fs::path& to) {
+    std::error_code ec;
+    fs::remove(to, ec);
+
+    fs::create_hard_link(from, to, ec);
+    if (!ec) return LinkMethod::Hardlink;
+
+    if (reflinkFile(from, to)) return LinkMethod::Reflink;
+
+    fs::copy_file(from, to, fs::copy_options::overwrite_existing, ec);
+    return ec ? LinkMethod::Failed : LinkMethod::Copy;
+}
+
+void DedupIndex::recordDuplicate(const std::string& leaderPath, const std::string& path, LinkMethod method) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_duplicates.push_back({leaderPath, path, method});
+}
+
+size_t DedupIndex::duplicateCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_duplicates.size();
+}
+
+const char* DedupIndex::methodName(LinkMethod method) {
+    switch (method) {
+        case LinkMethod::Hardlink: return "hardlink";
+        case LinkMethod::Reflink:  return "reflink";
+        case LinkMethod::Copy:     return "copy";
+        case LinkMethod::Failed:   return "failed";
+    }
+    return "unknown";
+}
+
+/**
+ * Report format, one group per leader:
+ *
+ *   <leader output>
+ *     = <duplicate output> (<method>)
+ */
+bool DedupIndex::writeReport(const fs::path& file) const {
+    std::vector<Duplicate> duplicates;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        duplicates = m_duplicates;
+    }
+
+    std::sort(duplicates.begin(), duplicates.end(), [](const Duplicate& a, const Duplicate& b) {
+        return a.leaderPath != b.leaderPath ? a.leaderPath < b.leaderPath : a.path < b.path;
+    });
+
+    std::ofstream out(file, std::ios::trunc);
+    if (!out) return false;
+
+    out << "# tim2dump duplicate report: " << duplicates.size() << " duplicate export(s)\n";
+    for (size_t i = 0; i < duplicates.size(); ++i) {
+        if (i == 0 || duplicates[i].leaderPath != duplicates[i - 1].leaderPath) {
+            out << duplicates[i].leaderPath << "\n";
+        }
+        out << "  = " << duplicates[i].path << " (" << methodName(duplicates[i].method) << ")\n";
+    }
+
+    return out.good();
+}
+
+} // namespace tim2
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace tim2 {
+
+// How a duplicate output was put on disk
+enum class LinkMethod {
+    Hardlink,
+    Reflink,
+    Copy,
+    Failed
+};
+
+// Content-addressed deduplication of batch exports.
+//
+// Every export is registered under a key derived from its picture's content
+// hash and mip level. The first export with a key becomes the leader and is
+// decoded, encoded and written as usual; later ones wait for it and are then
+// materialized from the leader's file instead (hardlink, else reflink, else
+// copy). If the leader fails, its waiters are told to export on their own.
+class DedupIndex {
+public:
+    // Called once the leader is settled: its output path, or nullptr on failure
+    using Waiter = std::function<void(const std::string* leaderPath)>;
+
+    // Register an export. Returns true if the caller is the leader and must
+    // export it. Otherwise `waiter` is called, either right away (leader
+    // already written) or from complete().
+    bool acquire(uint64_t key, const std::string& outputPath, Waiter waiter);
+
+    // The leader for `key` is done (written or failed); runs its waiters
+    void complete(uint64_t key, bool success);
+
+    // Put a copy of `from` at `to`, trying the cheapest method first
+    static LinkMethod materialize(const std::filesystem::path& from, const std::filesystem::path& to);
+
+    // Remember a duplicate for the report
+    void recordDuplicate(const std::string& leaderPath, const std::string& path, LinkMethod method);
+
+    size_t duplicateCount() const;
+
+    // Write the duplicate list grouped by leader, sorted by path
+    bool writeReport(const std::filesystem::path& file) const;
+
+    static const char* methodName(LinkMethod method);
+
+private:
+    struct Entry {
+        std::string leaderPath;
+        bool done = false;
+        std::vector<Waiter> waiters;
+    };
+
+    struct Duplicate {
+        std::string leaderPath;
+        std::string path;
+        LinkMethod method;
+    };
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<uint64_t, Entry> m_entries;
+    std::vector<Duplicate> m_duplicates;
+};
+
+} // namespace tim2
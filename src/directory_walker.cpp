@@ -0,0 +1,63 @@
+#include "directory_walker.h"
+#include "phase_stats.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace tim2 {
+
+DirectoryWalker::DirectoryWalker(ThreadPool& pool, FileFilter filter)
+    : m_pool(pool), m_filter(std::move(filter)) {
+}
+
+void DirectoryWalker::start(const fs::path& root, GroupCallback onGroup, std::function<void()> onComplete) {
+    m_onGroup = std::move(onGroup);
+    m_onComplete = std::move(onComplete);
+
+    m_pendingDirectories = 1;
+    m_pool.submit([this, root] { scanDirectory(root); });
+}
+
+/**
+ * List one directory: queue a task per subdirectory (symlinked directories
+ * are not followed, matching recursive_directory_iterator's default), report
+ * the matching files as a sorted group, and fire onComplete if this was the
+ * last directory outstanding.
+ *
+ * Subdirectory tasks are counted before this task is, so the pending count
+ * can only reach zero once the whole tree has been listed.
+ */
+void DirectoryWalker::scanDirectory(const fs::path& directory) {
+    stats::Scope scope(stats::Phase::Scan);
+    std::vector<fs::path> files;
+
+    try {
+        for (const auto& entry : fs::directory_iterator(directory)) {
+            std::error_code ec;
+            if (entry.is_directory(ec) && !entry.is_symlink(ec)) {
+                m_pendingDirectories.fetch_add(1);
+                m_pool.submit([this, path = entry.path()] { scanDirectory(path); });
+            } else if (entry.is_regular_file(ec) && m_filter(entry)) {
+                files.push_back(entry.path());
+            }
+        }
+    } catch (const std::exception& e) {
+        std::ostringstream message;
+        message << "Error scanning directory: " << e.what() << "\n";
+        std::cerr << message.str();
+    }
+
+    if (!files.empty()) {
+        std::sort(files.begin(), files.end());
+        m_onGroup(directory, std::move(files));
+    }
+
+    if (m_pendingDirectories.fetch_sub(1) == 1) {
+        m_onComplete();
+    }
+}
+
+} // namespace tim2
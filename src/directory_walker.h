@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+namespace tim2 {
+
+class ThreadPool;
+
+// Parallel recursive directory scan.
+//
+// Every directory is listed by its own task on the given pool, and each
+// subdirectory found becomes a new task, so wide trees (and slow network
+// shares) are enumerated concurrently. Matching files are not collected into
+// one big list: as soon as a directory has been listed, its matches are
+// handed to the caller as one group, sorted by name, so consumers can start
+// working while the rest of the tree is still being scanned.
+class DirectoryWalker {
+public:
+    // Decides whether a regular file belongs in the results
+    using FileFilter = std::function<bool(const std::filesystem::directory_entry&)>;
+
+    // Receives one directory's matches (never empty), on a pool thread
+    using GroupCallback = std::function<void(const std::filesystem::path& directory,
+                                             std::vector<std::filesystem::path> files)>;
+
+    DirectoryWalker(ThreadPool& pool, FileFilter filter);
+
+    // Start scanning root on the pool and return immediately. onComplete runs
+    // once, on a pool thread, after the last directory has been reported.
+    void start(const std::filesystem::path& root, GroupCallback onGroup, std::function<void()> onComplete);
+
+private:
+    ThreadPool& m_pool;
+    FileFilter m_filter;
+    GroupCallback m_onGroup;
+    std::function<void()> m_onComplete;
+    std::atomic<size_t> m_pendingDirectories{0};
+
+    void scanDirectory(const std::filesystem::path& directory);
+};
+
+} // namespace tim2
@@ -0,0 +1,250 @@
+#include "directory_watcher.h"
+#include <cerrno>
+#include <iostream>
+#include <thread>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace tim2 {
+
+namespace {
+
+// Upper bound on how long a steady stream of events can delay a batch
+constexpr auto kMaxBatchDelay = std::chrono::milliseconds(1000);
+
+// How often a blocked wait() checks the stop flag
+constexpr auto kStopCheckInterval = std::chrono::milliseconds(200);
+
+} // namespace
+
+DirectoryWatcher::DirectoryWatcher(fs::path root, std::chrono::milliseconds pollInterval)
+    : m_root(std::move(root)), m_pollInterval(pollInterval) {
+}
+
+DirectoryWatcher::~DirectoryWatcher() {
+#ifdef __linux__
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+#endif
+}
+
+void DirectoryWatcher::ignore(const fs::path& directory) {
+    m_ignored.push_back(fs::absolute(directory).lexically_normal());
+}
+
+bool DirectoryWatcher::isIgnored(const fs::path& path) const {
+    const fs::path absolute = fs::absolute(path).lexically_normal();
+    for (const auto& ignored : m_ignored) {
+        const fs::path relative = absolute.lexically_relative(ignored);
+        if (!relative.empty() && *relative.begin() != "..") return true;
+    }
+    return false;
+}
+
+/**
+ * Watch the tree with inotify if possible. Running out of watches (the
+ * per-user limit) closes the descriptor again, falling back to polling for
+ * the whole tree rather than watching only part of it.
+ */
+void DirectoryWatcher::start() {
+#ifdef __linux__
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd >= 0 && !addWatches(m_root, nullptr)) {
+        std::cerr << "Warning: Cannot watch every directory below " << m_root.string()
+                  << " (inotify limit?), polling instead\n";
+        close(m_fd);
+        m_fd = -1;
+        m_watches.clear();
+    }
+#endif
+
+    if (polling()) {
+        std::set<fs::path> none;
+        pollTree(none, true);
+    }
+}
+
+/**
+ * Add a watch for directory and every directory below it. When existing is
+ * given, regular files found along the way are added to it: they may have
+ * been written before the watch was in place.
+ */
+bool DirectoryWatcher::addWatches(const fs::path& directory, std::set<fs::path>* existing) {
+#ifdef __linux__
+    if (isIgnored(directory)) return true;
+
+    const int wd = inotify_add_watch(m_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR);
+    if (wd < 0) {
+        return errno == ENOENT || errno == ENOTDIR;  // Gone again: nothing to watch
+    }
+    m_watches[wd] = directory;
+
+    std::error_code ec;
+    for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+        std::error_code entryEc;
+        if (it->is_directory(entryEc) && !it->is_symlink(entryEc)) {
+            if (!addWatches(it->path(), existing)) return false;
+        } else if (existing && it->is_regular_file(entryEc)) {
+            existing->insert(it->path());
+        }
+    }
+    return true;
+#else
+    (void)directory;
+    (void)existing;
+    return false;
+#endif
+}
+
+/**
+ * Drain the inotify queue. Returns true if any event was read, even one that
+ * reported nothing (the caller uses it to extend the settle time).
+ */
+bool DirectoryWatcher::readEvents(std::set<fs::path>& files, bool& rescan) {
+#ifdef __linux__
+    alignas(inotify_event) char buffer[16 * 1024];
+    bool any = false;
+
+    for (;;) {
+        const ssize_t length = read(m_fd, buffer, sizeof(buffer));
+        if (length <= 0) break;
+        any = true;
+
+        for (ssize_t offset = 0; offset < length;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                rescan = true;
+                continue;
+            }
+
+            auto watch = m_watches.find(event->wd);
+            if (watch == m_watches.end()) continue;
+            if (event->mask & IN_IGNORED) {
+                m_watches.erase(watch);
+                continue;
+            }
+            if (event->len == 0) continue;
+
+            const fs::path path = watch->second / event->name;
+            if (event->mask & IN_ISDIR) {
+                if ((event->mask & (IN_CREATE | IN_MOVED_TO)) && !addWatches(path, &files)) {
+                    std::cerr << "Warning: Cannot watch " << path.string() << " (inotify limit?)\n";
+                    rescan = true;
+                }
+            } else if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) && !isIgnored(path)) {
+                files.insert(path);
+            }
+        }
+    }
+    return any;
+#else
+    (void)files;
+    (void)rescan;
+    return false;
+#endif
+}
+
+/**
+ * Polling fallback: one pass over the tree. A file is reported the first
+ * time it is seen unchanged after a change, i.e. once it has been stable for
+ * a whole poll interval. The initial pass only records what is there.
+ */
+void DirectoryWatcher::pollTree(std::set<fs::path>& files, bool initial) {
+    std::set<fs::path> seen;
+
+    std::error_code ec;
+    const auto options = fs::directory_options::skip_permission_denied;
+    for (fs::recursive_directory_iterator it(m_root, options, ec), end; !ec && it != end; it.increment(ec)) {
+        std::error_code entryEc;
+        if (it->is_directory(entryEc)) {
+            if (isIgnored(it->path())) it.disable_recursion_pending();
+            continue;
+        }
+        if (!it->is_regular_file(entryEc)) continue;
+
+        const uintmax_t size = it->file_size(entryEc);
+        const auto mtime = it->last_write_time(entryEc);
+        if (entryEc) continue;
+
+        seen.insert(it->path());
+        auto [state, added] = m_polled.try_emplace(it->path());
+        if (initial) {
+            state->second = {size, mtime, true};
+        } else if (added || state->second.size != size || state->second.mtime != mtime) {
+            state->second = {size, mtime, false};
+        } else if (!state->second.reported) {
+            state->second.reported = true;
+            files.insert(it->path());
+        }
+    }
+
+    for (auto it = m_polled.begin(); it != m_polled.end();) {
+        it = seen.count(it->first) ? std::next(it) : m_polled.erase(it);
+    }
+}
+
+/**
+ * Wait for a batch of finished files. With inotify, the first event starts a
+ * settle timer that every further event restarts (bounded by kMaxBatchDelay),
+ * so a tool writing many files produces one batch instead of one per file.
+ */
+bool DirectoryWatcher::wait(std::vector<fs::path>& files, bool& rescan, const std::atomic<bool>& stop,
+                            std::chrono::milliseconds settleTime) {
+    files.clear();
+    rescan = false;
+    std::set<fs::path> ready;
+
+    if (polling()) {
+        while (!stop && ready.empty()) {
+            const auto due = std::chrono::steady_clock::now() + m_pollInterval;
+            while (!stop && std::chrono::steady_clock::now() < due) {
+                std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+                    kStopCheckInterval, due - std::chrono::steady_clock::now()));
+            }
+            if (!stop) pollTree(ready, false);
+        }
+    }
+#ifdef __linux__
+    else {
+        bool pending = false;
+        auto firstEvent = std::chrono::steady_clock::now();
+
+        while (!stop) {
+            if (pending && std::chrono::steady_clock::now() - firstEvent > kMaxBatchDelay) break;
+
+            pollfd descriptor{m_fd, POLLIN, 0};
+            const auto timeout = pending ? settleTime : kStopCheckInterval;
+            const int result = poll(&descriptor, 1, static_cast<int>(timeout.count()));
+            if (result < 0 && errno != EINTR) {
+                std::cerr << "Error: Waiting for file events failed\n";
+                return false;
+            }
+            if (result == 0 && pending) break;
+            if (result <= 0) continue;
+
+            readEvents(ready, rescan);
+            if (!pending && (!ready.empty() || rescan)) {
+                pending = true;
+                firstEvent = std::chrono::steady_clock::now();
+            }
+        }
+    }
+#endif
+
+    for (const auto& path : ready) {
+        std::error_code ec;
+        if (fs::is_regular_file(path, ec)) files.push_back(path);
+    }
+    return !stop;
+}
+
+} // namespace tim2
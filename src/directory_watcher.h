@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace tim2 {
+
+// Reports files below a directory that have been completely written.
+//
+// On Linux this uses inotify: every directory of the tree is watched, and a
+// file is reported when it is closed after writing (IN_CLOSE_WRITE) or moved
+// into the tree (IN_MOVED_TO), so a file still being written is never picked
+// up half-done. Directories created later are watched as they appear, and
+// files already inside them are reported. Where inotify is unavailable (other
+// platforms, or the watch limit is reached) the tree is polled instead, and a
+// file is reported once its size and modification time have stayed the same
+// for one poll interval.
+class DirectoryWatcher {
+public:
+    explicit DirectoryWatcher(std::filesystem::path root,
+                              std::chrono::milliseconds pollInterval = std::chrono::milliseconds(1000));
+    ~DirectoryWatcher();
+
+    DirectoryWatcher(const DirectoryWatcher&) = delete;
+    DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+    // Never report files below this directory (e.g. an output folder inside the tree)
+    void ignore(const std::filesystem::path& directory);
+
+    // Begin watching. Files that exist at this point are not reported.
+    void start();
+    bool polling() const { return m_fd < 0; }
+
+    // Block until some files are ready or stop is set. Events are collected
+    // until none has arrived for settleTime, so a burst becomes one batch.
+    // rescan is set when events were lost (queue overflow) and the caller
+    // should look at the whole tree. Returns false once stop is set.
+    bool wait(std::vector<std::filesystem::path>& files, bool& rescan, const std::atomic<bool>& stop,
+              std::chrono::milliseconds settleTime = std::chrono::milliseconds(50));
+
+private:
+    struct FileState {
+        uintmax_t size = 0;
+        std::filesystem::file_time_type mtime;
+        bool reported = false;
+    };
+
+    std::filesystem::path m_root;
+    std::chrono::milliseconds m_pollInterval;
+    std::vector<std::filesystem::path> m_ignored;  // Absolute, normalized
+
+    int m_fd = -1;                                       // inotify descriptor
+    std::map<int, std::filesystem::path> m_watches;      // Watch descriptor -> directory
+    std::map<std::filesystem::path, FileState> m_polled; // Polling fallback state
+
+    bool isIgnored(const std::filesystem::path& path) const;
+    bool addWatches(const std::filesystem::path& directory, std::set<std::filesystem::path>* existing);
+    bool readEvents(std::set<std::filesystem::path>& files, bool& rescan);
+    void pollTree(std::set<std::filesystem::path>& files, bool initial);
+};
+
+} // namespace tim2
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace tim2 {
+
+// Fast non-cryptographic 64-bit hash (the XXH64 algorithm), for change
+// detection and content keys. Feed data in any number of pieces; the digest
+// only depends on the concatenated bytes.
+class Hash64 {
+public:
+    explicit Hash64(uint64_t seed = 0) { reset(seed); }
+
+    void reset(uint64_t seed = 0) {
+        m_acc[0] = seed + kPrime1 + kPrime2;
+        m_acc[1] = seed + kPrime2;
+        m_acc[2] = seed;
+        m_acc[3] = seed - kPrime1;
+        m_seed = seed;
+        m_total = 0;
+        m_buffered = 0;
+    }
+
+    void update(const void* data, size_t size) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        m_total += size;
+
+        if (m_buffered > 0) {
+            const size_t take = std::min(size, sizeof(m_buffer) - m_buffered);
+            std::memcpy(m_buffer + m_buffered, p, take);
+            m_buffered += take;
+            p += take;
+            size -= take;
+            if (m_buffered < sizeof(m_buffer)) return;
+            consumeStripe(m_buffer);
+            m_buffered = 0;
+        }
+
+        while (size >= sizeof(m_buffer)) {
+            consumeStripe(p);
+            p += sizeof(m_buffer);
+            size -= sizeof(m_buffer);
+        }
+
+        std::memcpy(m_buffer, p, size);
+        m_buffered = size;
+    }
+
+    // Convenience for trivially copyable values (header fields and the like)
+    template<typename T>
+    void updateValue(const T& value) { update(&value, sizeof(value)); }
+
+    uint64_t digest() const {
+        uint64_t h;
+        if (m_total >= sizeof(m_buffer)) {
+            h = rotl(m_acc[0], 1) + rotl(m_acc[1], 7) + rotl(m_acc[2], 12) + rotl(m_acc[3], 18);
+            for (uint64_t acc : m_acc) {
+                h = (h ^ round(0, acc)) * kPrime1 + kPrime4;
+            }
+        } else {
+            h = m_seed + kPrime5;
+        }
+        h += m_total;
+
+        const uint8_t* p = m_buffer;
+        size_t left = m_buffered;
+        while (left >= 8) {
+            h = rotl(h ^ round(0, read64(p)), 27) * kPrime1 + kPrime4;
+            p += 8;
+            left -= 8;
+        }
+        if (left >= 4) {
+            h = rotl(h ^ (uint64_t(read32(p)) * kPrime1), 23) * kPrime2 + kPrime3;
+            p += 4;
+            left -= 4;
+        }
+        while (left > 0) {
+            h = rotl(h ^ (*p * kPrime5), 11) * kPrime1;
+            ++p;
+            --left;
+        }
+
+        h ^= h >> 33;
+        h *= kPrime2;
+        h ^= h >> 29;
+        h *= kPrime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    // One-shot hash of a buffer
+    static uint64_t of(const void* data, size_t size, uint64_t seed = 0) {
+        Hash64 hash(seed);
+        hash.update(data, size);
+        return hash.digest();
+    }
+
+private:
+    static constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+    static constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+    static constexpr uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+    static constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+    static constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+    uint64_t m_acc[4];
+    uint64_t m_seed = 0;
+    uint64_t m_total = 0;
+    uint8_t m_buffer[32];
+    size_t m_buffered = 0;
+
+    static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+    static uint64_t round(uint64_t acc, uint64_t input) {
+        acc += input * kPrime2;
+        return rotl(acc, 31) * kPrime1;
+    }
+
+    // Little-endian loads, as the algorithm specifies
+    static uint64_t read64(const uint8_t* p) {
+        uint64_t v = 0;
+        for (int i = 7; i >= 0; --i) v = (v << 8) | p[i];
+        return v;
+    }
+
+    static uint32_t read32(const uint8_t* p) {
+        return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+    }
+
+    void consumeStripe(const uint8_t* p) {
+        for (int i = 0; i < 4; ++i) {
+            m_acc[i] = round(m_acc[i], read64(p + i * 8));
+        }
+    }
+};
+
+} // namespace tim2
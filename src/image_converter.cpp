@@ -1,9 +1,18 @@
 #include "image_converter.h"
+#include "alloc_stats.h"
+#include "phase_stats.h"
+#include "trace_recorder.h"
 #include <fstream>
 #include <iostream>
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 
+// The PNG encoder's buffers go through malloc, not operator new; count them
+// with the Encode phase
+#define STBIW_MALLOC(sz)       tim2::alloc::countedMalloc(sz)
+#define STBIW_REALLOC(p, newsz) tim2::alloc::countedRealloc(p, newsz)
+#define STBIW_FREE(p)          tim2::alloc::countedFree(p)
 #include "stb_image_write.h"
 
 namespace tim2 {
@@ -20,8 +29,62 @@ bool ImageConverter::exportBMP(const Picture& pic, const std::string& filename,
         return false;
     }
 
-    size_t width = std::max<size_t>(1, pic.header.imageWidth >> mipLevel);
-    size_t height = std::max<size_t>(1, pic.header.imageHeight >> mipLevel);
+    return writeBMP(imageData, pic.getMipMapWidth(mipLevel), pic.getMipMapHeight(mipLevel), filename);
+}
+
+bool ImageConverter::exportPNG(const Picture& pic, const std::string& filename, size_t mipLevel) {
+    if (mipLevel >= pic.header.mipMapTextures) {
+        std::cerr << "Invalid MIP level\n";
+        return false;
+    }
+
+    auto imageData = pic.decodeImage(mipLevel);
+    if (imageData.empty()) {
+        std::cerr << "Failed to decode image\n";
+        return false;
+    }
+
+    return writePNG(imageData, pic.getMipMapWidth(mipLevel), pic.getMipMapHeight(mipLevel), filename);
+}
+
+bool ImageConverter::writeBMP(const std::vector<Color32>& imageData, size_t width, size_t height,
+                              const std::string& filename) {
+    std::vector<uint8_t> encoded;
+    if (!encodeBMP(imageData, width, height, encoded)) {
+        return false;
+    }
+
+    stats::Scope scope(stats::Phase::Write);
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to create file: " << filename << "\n";
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+    return file.good();
+}
+
+bool ImageConverter::writePNG(const std::vector<Color32>& imageData, size_t width, size_t height,
+                              const std::string& filename) {
+    std::vector<uint8_t> encoded;
+    if (!encodePNG(imageData, width, height, encoded)) {
+        return false;
+    }
+
+    stats::Scope scope(stats::Phase::Write);
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+    return file.good();
+}
+
+bool ImageConverter::encodeBMP(const std::vector<Color32>& imageData, size_t width, size_t height,
+                               std::vector<uint8_t>& out) {
+    stats::Scope scope(stats::Phase::Encode);
 
     // BMP row size must be multiple of 4 bytes
     size_t rowSize = ((width * 3 + 3) / 4) * 4;
@@ -35,45 +98,34 @@ bool ImageConverter::exportBMP(const Picture& pic, const std::string& filename,
     infoHeader.height = height;
     infoHeader.imageSize = imageSize;
 
-    std::ofstream file(filename, std::ios::binary);
-    if (!file) {
-        std::cerr << "Failed to create file: " << filename << "\n";
-        return false;
-    }
+    out.resize(sizeof(BMPHeader) + sizeof(BMPInfoHeader) + imageSize);
+    uint8_t* dst = out.data();
 
     // Write headers
-    file.write(reinterpret_cast<const char*>(&bmpHeader), sizeof(bmpHeader));
-    file.write(reinterpret_cast<const char*>(&infoHeader), sizeof(infoHeader));
+    std::memcpy(dst, &bmpHeader, sizeof(bmpHeader));
+    dst += sizeof(bmpHeader);
+    std::memcpy(dst, &infoHeader, sizeof(infoHeader));
+    dst += sizeof(infoHeader);
 
     // Write pixel data (BMP stores bottom-to-top, BGR format)
-    std::vector<uint8_t> row(rowSize, 0);
     for (int y = height - 1; y >= 0; --y) {
+        uint8_t* row = dst;
         for (size_t x = 0; x < width; ++x) {
             const Color32& pixel = imageData[y * width + x];
             row[x * 3 + 0] = pixel.b;
             row[x * 3 + 1] = pixel.g;
             row[x * 3 + 2] = pixel.r;
         }
-        file.write(reinterpret_cast<const char*>(row.data()), rowSize);
+        std::fill(row + width * 3, row + rowSize, 0);
+        dst += rowSize;
     }
 
-    return file.good();
+    return true;
 }
 
-bool ImageConverter::exportPNG(const Picture& pic, const std::string& filename, size_t mipLevel) {
-    if (mipLevel >= pic.header.mipMapTextures) {
-        std::cerr << "Invalid MIP level\n";
-        return false;
-    }
-
-    auto imageData = pic.decodeImage(mipLevel);
-    if (imageData.empty()) {
-        std::cerr << "Failed to decode image\n";
-        return false;
-    }
-
-    size_t width = std::max<size_t>(1, pic.header.imageWidth >> mipLevel);
-    size_t height = std::max<size_t>(1, pic.header.imageHeight >> mipLevel);
+bool ImageConverter::encodePNG(const std::vector<Color32>& imageData, size_t width, size_t height,
+                               std::vector<uint8_t>& out) {
+    stats::Scope scope(stats::Phase::Encode);
 
     // Convert to RGBA format for stb_image_write
     std::vector<uint8_t> rgbaData(width * height * 4);
@@ -84,8 +136,15 @@ bool ImageConverter::exportPNG(const Picture& pic, const std::string& filename,
         rgbaData[i * 4 + 3] = imageData[i].a;
     }
 
-    int result = stbi_write_png(filename.c_str(), width, height, 4,
-                                rgbaData.data(), width * 4);
+    out.clear();
+    auto append = [](void* context, void* data, int size) {
+        auto* buffer = static_cast<std::vector<uint8_t>*>(context);
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        buffer->insert(buffer->end(), bytes, bytes + size);
+    };
+
+    int result = stbi_write_png_to_func(append, &out, width, height, 4,
+                                        rgbaData.data(), width * 4);
 
     return result != 0;
 }
@@ -99,6 +158,7 @@ bool ImageConverter::exportAll(const TIM2Parser& parser, const std::string& base
         if (!pic) continue;
 
         for (size_t mip = 0; mip < pic->header.mipMapTextures; ++mip) {
+            trace::Item item(nullptr, static_cast<int>(i), static_cast<int>(mip));
             std::string filename = baseFilename + "_pic" + std::to_string(i);
             if (pic->header.mipMapTextures > 1) {
                 filename += "_mip" + std::to_string(mip);
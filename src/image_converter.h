@@ -3,6 +3,7 @@
 #include "tim2_parser.h"
 #include <string>
 #include <cstdint> // Good practice to include for uint types
+#include <vector>
 
 namespace tim2 {
 
@@ -14,6 +15,18 @@ namespace tim2 {
         // Export picture to PNG (requires stb_image_write.h)
         static bool exportPNG(const Picture& pic, const std::string& filename, size_t mipLevel = 0);
 
+        // Write already-decoded RGBA pixels (width * height) to BMP / PNG
+        static bool writeBMP(const std::vector<Color32>& pixels, size_t width, size_t height,
+                             const std::string& filename);
+        static bool writePNG(const std::vector<Color32>& pixels, size_t width, size_t height,
+                             const std::string& filename);
+
+        // Encode already-decoded RGBA pixels into an in-memory BMP / PNG file image
+        static bool encodeBMP(const std::vector<Color32>& pixels, size_t width, size_t height,
+                              std::vector<uint8_t>& out);
+        static bool encodePNG(const std::vector<Color32>& pixels, size_t width, size_t height,
+                              std::vector<uint8_t>& out);
+
         // Export all pictures from a TIM2 file
         static bool exportAll(const TIM2Parser& parser, const std::string& baseFilename,
                              const std::string& format = "bmp");
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <concepts>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tim2 {
+
+// Minimal JSON builder for machine-readable output.
+//
+// Calls follow the document structure: beginObject(), then key()/value()
+// pairs, then endObject(). Commas are inserted automatically; strings are
+// escaped. Nothing is validated, so unbalanced calls produce invalid JSON.
+class JsonWriter {
+public:
+    JsonWriter& beginObject() { return open('{'); }
+    JsonWriter& endObject() { return close('}'); }
+    JsonWriter& beginArray() { return open('['); }
+    JsonWriter& endArray() { return close(']'); }
+
+    JsonWriter& key(std::string_view name) {
+        separate();
+        appendString(name);
+        m_out += ':';
+        m_afterKey = true;
+        return *this;
+    }
+
+    JsonWriter& value(std::string_view text) {
+        separate();
+        appendString(text);
+        return *this;
+    }
+    JsonWriter& value(const char* text) { return value(std::string_view(text)); }
+
+    JsonWriter& value(bool flag) {
+        separate();
+        m_out += flag ? "true" : "false";
+        return *this;
+    }
+
+    template<std::integral T>
+    JsonWriter& value(T number) {
+        separate();
+        m_out += std::to_string(number);
+        return *this;
+    }
+
+    JsonWriter& value(double number) {
+        separate();
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.6g", number);
+        m_out += text;
+        return *this;
+    }
+
+    // Fixed number of decimals, for values %.6g would round (timestamps)
+    JsonWriter& value(double number, int decimals) {
+        separate();
+        char text[48];
+        std::snprintf(text, sizeof(text), "%.*f", decimals, number);
+        m_out += text;
+        return *this;
+    }
+
+    // key(name).value(v) in one call
+    template<typename T>
+    JsonWriter& field(std::string_view name, const T& v) {
+        key(name);
+        return value(v);
+    }
+
+    const std::string& str() const { return m_out; }
+
+private:
+    std::string m_out;
+    std::vector<bool> m_hasItems;  // Per open container: whether a comma is needed
+    bool m_afterKey = false;
+
+    void separate() {
+        if (m_afterKey) {
+            m_afterKey = false;
+            return;
+        }
+        if (!m_hasItems.empty()) {
+            if (m_hasItems.back()) m_out += ',';
+            m_hasItems.back() = true;
+        }
+    }
+
+    JsonWriter& open(char bracket) {
+        separate();
+        m_out += bracket;
+        m_hasItems.push_back(false);
+        return *this;
+    }
+
+    JsonWriter& close(char bracket) {
+        m_out += bracket;
+        if (!m_hasItems.empty()) m_hasItems.pop_back();
+        return *this;
+    }
+
+    void appendString(std::string_view text) {
+        m_out += '"';
+        for (char c : text) {
+            switch (c) {
+                case '"':  m_out += "\\\""; break;
+                case '\\': m_out += "\\\\"; break;
+                case '\n': m_out += "\\n"; break;
+                case '\r': m_out += "\\r"; break;
+                case '\t': m_out += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        char escaped[8];
+                        std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+                        m_out += escaped;
+                    } else {
+                        m_out += c;
+                    }
+            }
+        }
+        m_out += '"';
+    }
+};
+
+} // namespace tim2
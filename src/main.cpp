@@ -1,13 +1,20 @@
+#include <atomic>
+#include <chrono>
+#include <csignal>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <filesystem>
-#include <map>
+#include <fstream>
 #include <algorithm>
 #include <cctype>
 #include "tim2_parser.h"
 #include "table_formatter.h"
 #include "image_converter.h"
+#include "batch_processor.h"
+#include "conversion_server.h"
+#include "phase_stats.h"
+#include "trace_recorder.h"
 
 namespace fs = std::filesystem;
 
@@ -17,6 +24,12 @@ void printUsage(const char* programName) {
     std::cout << "Commands:\n";
     std::cout << "  info <file>           Display detailed information about TIM2 file\n";
     std::cout << "  export <file> [fmt]   Export images (fmt: bmp or png, default: bmp)\n";
+    std::cout << "  batch <dir> [fmt]     Export every TIM2 file below a directory\n";
+    std::cout << "  batch @<list> [fmt]   Export the files named in a list (- = stdin)\n";
+    std::cout << "  watch <dir> [fmt]     Batch-export a directory, then new files as they are written\n";
+    std::cout << "  serve <socket>        Run a conversion server on a Unix domain socket\n";
+    std::cout << "  client <file> [fmt]   Ask a server to export a picture (or --info)\n";
+    std::cout << "  merge <dir>           Combine the shard summaries/manifests of a batch output\n";
     std::cout << "  viewc <file> [pic]    Display image with colors (ANSI terminal)\n";
     std::cout << "\nOptions:\n";
     std::cout << "  -v, --verbose         Show detailed information\n";
@@ -25,6 +38,37 @@ void printUsage(const char* programName) {
     std::cout << "  -p, --picture <n>     Select specific picture (0-based index)\n";
     std::cout << "  -m, --miplevel <n>    Select MIP level (default: 0)\n";
     std::cout << "  -w, --width <n>       Max width for terminal display (default: 80)\n";
+    std::cout << "  -j, --jobs <n>        Decode/encode threads for batch (default: CPU count)\n";
+    std::cout << "  --scan-threads <n>    Batch directory scan threads (default: 4)\n";
+    std::cout << "  --read-threads <n>    Batch reader stage threads (default: 2)\n";
+    std::cout << "  --write-threads <n>   Batch writer stage threads (default: 2)\n";
+    std::cout << "  --queue-depth <n>     Batch stage queue capacity (default: 2 x jobs)\n";
+    std::cout << "  --band-pixels <n>     Split batch decodes into bands of ~n pixels (0 = off)\n";
+    std::cout << "  --mem-budget <n>      Batch: limit estimated memory of files in flight (K/M/G)\n";
+    std::cout << "  --progress            Batch: live progress, throughput and ETA on stderr\n";
+    std::cout << "  --progress-json <f>   Batch: append JSON progress lines to f (- = stderr)\n";
+    std::cout << "  --stats               Info/export/batch: print time and heap use per phase\n";
+    std::cout << "  --stats-json <f>      Write the phase statistics as JSON to f (- = stdout)\n";
+    std::cout << "  --counters            Hardware cycles, instructions and misses per phase/format (Linux)\n";
+    std::cout << "  --trace <f>           Info/export/batch: write a Chrome trace timeline to f\n";
+    std::cout << "  --plan                Print the estimated batch work and exit (dry run)\n";
+    std::cout << "  --detect              Batch: find TIM2 files by header, not extension\n";
+    std::cout << "  --min-size <n>        Batch: skip files smaller than n bytes (K/M/G suffix)\n";
+    std::cout << "  --max-size <n>        Batch: skip files larger than n bytes (K/M/G suffix)\n";
+    std::cout << "  --include <glob>      Batch: only paths matching glob (repeatable)\n";
+    std::cout << "  --exclude <glob>      Batch: skip paths matching glob (repeatable)\n";
+    std::cout << "  --incremental         Batch: skip sources unchanged since the last run\n";
+    std::cout << "  --resume              Batch: continue an interrupted run\n";
+    std::cout << "  --base <dir>          Batch list: output paths are relative to dir (default: .)\n";
+    std::cout << "  -0, --null            Batch list: entries end in NUL, not newline\n";
+    std::cout << "  --shard <i>/<n>       Batch: process only shard i (0-based) of n\n";
+    std::cout << "  --dedup               Batch: export identical pictures once, link the copies\n";
+    std::cout << "  --cache <dir>         Batch: reuse encoded exports stored in dir\n";
+    std::cout << "  --cache-size <n>      Batch: cache size limit (K/M/G suffix, default: 1G)\n";
+    std::cout << "                        Serve: memory cache size limit (default: 256M)\n";
+    std::cout << "  --socket <path>       Client: server socket to connect to\n";
+    std::cout << "  --info                Client: request file information as JSON\n";
+    std::cout << "  --inline              Client: send the file's bytes instead of its path\n";
     std::cout << "\nExamples:\n";
     std::cout << "  " << programName << " info texture.tim2\n";
     std::cout << "  " << programName << " export texture.tim2 png\n";
@@ -36,13 +80,75 @@ struct Options {
     std::string inputPath;  // Can be file or folder
     std::string format = "bmp";
     std::string outputFolder;  // For batch processing
+    std::string basePath;      // Batch file list: root of the relative output structure
+    bool nullSeparated = false;
+    std::string socketPath;    // Client: server to talk to
+    bool requestInfo = false;  // Client: info instead of export
+    bool sendInline = false;   // Client: send file bytes, not the path
     bool verbose = false;
     bool showGsRegisters = false;
     int pictureIndex = -1;
     int mipLevel = 0;
     int maxWidth = 80;
+    size_t threads = 0;  // 0 = hardware concurrency
+    long bandPixels = -1;  // -1 = batch default
+    bool planOnly = false;
+    uint64_t memoryBudget = 0;
+    bool progress = false;
+    std::string progressJson;
+    bool stats = false;
+    std::string statsJson;
+    std::string tracePath;
+    bool counters = false;
+    bool incremental = false;
+    bool resume = false;
+    size_t shardIndex = 0;
+    size_t shardCount = 1;
+    bool dedup = false;
+    std::string cacheDir;
+    uintmax_t cacheMaxBytes = 0;  // 0 = batch default
+    size_t readThreads = 0;   // 0 = batch default
+    size_t writeThreads = 0;  // 0 = batch default
+    size_t queueDepth = 0;    // 0 = batch default
+    size_t scanThreads = 0;   // 0 = batch default
+    bool detectContent = false;
+    uintmax_t minFileSize = 0;
+    uintmax_t maxFileSize = 0;
+    std::vector<std::string> includePatterns;
+    std::vector<std::string> excludePatterns;
 };
 
+// Parse a byte count with an optional K/M/G suffix (powers of 1024)
+uintmax_t parseByteSize(const std::string& text) {
+    size_t pos = 0;
+    uintmax_t value = std::stoull(text, &pos);
+
+    if (pos < text.size()) {
+        switch (std::toupper(static_cast<unsigned char>(text[pos]))) {
+            case 'K': value <<= 10; break;
+            case 'M': value <<= 20; break;
+            case 'G': value <<= 30; break;
+            default: break;
+        }
+    }
+    return value;
+}
+
+// Parse "<i>/<n>": two unsigned numbers and nothing else
+bool parseShard(const std::string& spec, size_t& index, size_t& count) {
+    const size_t slash = spec.find('/');
+    if (slash == std::string::npos) return false;
+    const std::string first = spec.substr(0, slash);
+    const std::string second = spec.substr(slash + 1);
+    auto isNumber = [](const std::string& text) {
+        return !text.empty() && text.size() <= 9 && text.find_first_not_of("0123456789") == std::string::npos;
+    };
+    if (!isNumber(first) || !isNumber(second)) return false;
+    index = std::stoul(first);
+    count = std::stoul(second);
+    return true;
+}
+
 Options parseArguments(int argc, char* argv[]) {
     Options opts;
 
@@ -68,7 +174,71 @@ Options parseArguments(int argc, char* argv[]) {
             opts.mipLevel = std::stoi(argv[++i]);
         } else if ((arg == "-w" || arg == "--width") && i + 1 < argc) {
             opts.maxWidth = std::stoi(argv[++i]);
-        } else if ((opts.command == "export" || opts.command == "batch") && i == 3) {
+        } else if ((arg == "-j" || arg == "--jobs") && i + 1 < argc) {
+            opts.threads = static_cast<size_t>(std::max(1, std::stoi(argv[++i])));
+        } else if (arg == "--read-threads" && i + 1 < argc) {
+            opts.readThreads = static_cast<size_t>(std::max(1, std::stoi(argv[++i])));
+        } else if (arg == "--write-threads" && i + 1 < argc) {
+            opts.writeThreads = static_cast<size_t>(std::max(1, std::stoi(argv[++i])));
+        } else if (arg == "--scan-threads" && i + 1 < argc) {
+            opts.scanThreads = static_cast<size_t>(std::max(1, std::stoi(argv[++i])));
+        } else if (arg == "--queue-depth" && i + 1 < argc) {
+            opts.queueDepth = static_cast<size_t>(std::max(1, std::stoi(argv[++i])));
+        } else if (arg == "--detect") {
+            opts.detectContent = true;
+        } else if (arg == "--min-size" && i + 1 < argc) {
+            opts.minFileSize = parseByteSize(argv[++i]);
+        } else if (arg == "--max-size" && i + 1 < argc) {
+            opts.maxFileSize = parseByteSize(argv[++i]);
+        } else if (arg == "--include" && i + 1 < argc) {
+            opts.includePatterns.push_back(argv[++i]);
+        } else if (arg == "--exclude" && i + 1 < argc) {
+            opts.excludePatterns.push_back(argv[++i]);
+        } else if (arg == "--cache" && i + 1 < argc) {
+            opts.cacheDir = argv[++i];
+        } else if (arg == "--cache-size" && i + 1 < argc) {
+            opts.cacheMaxBytes = parseByteSize(argv[++i]);
+        } else if (arg == "--dedup") {
+            opts.dedup = true;
+        } else if (arg == "--shard" && i + 1 < argc) {
+            // Anything but "i/n" leaves a count of 0, which main() rejects
+            if (!parseShard(argv[++i], opts.shardIndex, opts.shardCount)) {
+                opts.shardCount = 0;
+            }
+        } else if (arg == "--base" && i + 1 < argc) {
+            opts.basePath = argv[++i];
+        } else if (arg == "-0" || arg == "--null") {
+            opts.nullSeparated = true;
+        } else if (arg == "--socket" && i + 1 < argc) {
+            opts.socketPath = argv[++i];
+        } else if (arg == "--info") {
+            opts.requestInfo = true;
+        } else if (arg == "--inline") {
+            opts.sendInline = true;
+        } else if (arg == "--resume") {
+            opts.resume = true;
+        } else if (arg == "--incremental") {
+            opts.incremental = true;
+        } else if (arg == "--mem-budget" && i + 1 < argc) {
+            opts.memoryBudget = parseByteSize(argv[++i]);
+        } else if (arg == "--progress") {
+            opts.progress = true;
+        } else if (arg == "--progress-json" && i + 1 < argc) {
+            opts.progressJson = argv[++i];
+        } else if (arg == "--stats") {
+            opts.stats = true;
+        } else if (arg == "--stats-json" && i + 1 < argc) {
+            opts.statsJson = argv[++i];
+        } else if (arg == "--counters") {
+            opts.counters = true;
+        } else if (arg == "--trace" && i + 1 < argc) {
+            opts.tracePath = argv[++i];
+        } else if (arg == "--plan") {
+            opts.planOnly = true;
+        } else if (arg == "--band-pixels" && i + 1 < argc) {
+            opts.bandPixels = std::max(0L, std::stol(argv[++i]));
+        } else if ((opts.command == "export" || opts.command == "batch" || opts.command == "watch" ||
+                    opts.command == "client") && i == 3) {
             opts.format = arg;
         }
     }
@@ -76,192 +246,159 @@ Options parseArguments(int argc, char* argv[]) {
     return opts;
 }
 
-// Find all TIM2 files recursively
-std::vector<fs::path> findTIM2Files(const fs::path& rootPath) {
-    std::vector<fs::path> tim2Files;
+// "batch -" reads the file list from stdin, "batch @file" from a file
+bool isFileList(const std::string& input) {
+    return input == "-" || (input.size() > 1 && input[0] == '@');
+}
 
-    try {
-        for (const auto& entry : fs::recursive_directory_iterator(rootPath)) {
-            if (entry.is_regular_file()) {
-                auto ext = entry.path().extension().string();
-                std::transform(ext.begin(), ext.end(), ext.begin(),
-                             [](unsigned char c){ return std::tolower(c); });
+// Set by SIGINT/SIGTERM to end watch mode after the current round
+std::atomic<bool> g_stopRequested{false};
 
-                if (ext == ".tim2" || ext == ".tm2") {
-                    tim2Files.push_back(entry.path());
-                }
-            }
-        }
-    } catch (const std::exception& e) {
-        std::cerr << "Error scanning directory: " << e.what() << "\n";
+void requestStop(int) {
+    g_stopRequested = true;
+}
+
+int handleBatch(const Options& opts) {
+    tim2::BatchOptions batchOpts;
+    batchOpts.inputPath = opts.inputPath;
+    if (isFileList(opts.inputPath)) {
+        batchOpts.fileList = opts.inputPath == "-" ? "-" : opts.inputPath.substr(1);
+        batchOpts.inputPath = opts.basePath.empty() ? "." : opts.basePath;
+        batchOpts.nullSeparated = opts.nullSeparated;
+    }
+    batchOpts.format = opts.format;
+    batchOpts.outputFolder = opts.outputFolder;
+    batchOpts.threads = opts.threads;
+    batchOpts.planOnly = opts.planOnly;
+    batchOpts.memoryBudget = opts.memoryBudget;
+    batchOpts.progress = opts.progress;
+    batchOpts.progressJson = opts.progressJson;
+    batchOpts.incremental = opts.incremental;
+    batchOpts.resume = opts.resume;
+    batchOpts.shardIndex = opts.shardIndex;
+    batchOpts.shardCount = opts.shardCount;
+    batchOpts.dedup = opts.dedup;
+    batchOpts.cacheDir = opts.cacheDir;
+    if (opts.cacheMaxBytes > 0) batchOpts.cacheMaxBytes = opts.cacheMaxBytes;
+    if (opts.readThreads > 0) batchOpts.readThreads = opts.readThreads;
+    if (opts.writeThreads > 0) batchOpts.writeThreads = opts.writeThreads;
+    if (opts.queueDepth > 0) batchOpts.queueDepth = opts.queueDepth;
+    if (opts.scanThreads > 0) batchOpts.scanThreads = opts.scanThreads;
+    batchOpts.detectContent = opts.detectContent;
+    batchOpts.minFileSize = opts.minFileSize;
+    batchOpts.maxFileSize = opts.maxFileSize;
+    batchOpts.includePatterns = opts.includePatterns;
+    batchOpts.excludePatterns = opts.excludePatterns;
+    batchOpts.verbose = opts.verbose;
+    if (opts.bandPixels >= 0) {
+        batchOpts.bandPixels = static_cast<size_t>(opts.bandPixels);
     }
 
-    return tim2Files;
+    tim2::BatchProcessor processor(batchOpts);
+    if (opts.command == "watch") {
+        std::signal(SIGINT, requestStop);
+        std::signal(SIGTERM, requestStop);
+        return processor.watch(g_stopRequested);
+    }
+    return processor.run();
 }
 
-// Generate output filename handling conflicts
-std::string generateOutputFilename(const fs::path& outputDir, const fs::path& sourceFile,
-                                  const std::string& format, std::map<std::string, int>& nameCounter) {
-    std::string baseName = sourceFile.stem().string();
-    fs::path outputPath = outputDir / (baseName + "." + format);
+int handleServe(const Options& opts) {
+    tim2::ServerOptions serverOpts;
+    serverOpts.socketPath = opts.inputPath;
+    serverOpts.threads = opts.threads;
+    serverOpts.verbose = opts.verbose;
+    if (opts.cacheMaxBytes > 0) serverOpts.cacheMaxBytes = opts.cacheMaxBytes;
+    if (opts.bandPixels >= 0) serverOpts.bandPixels = static_cast<size_t>(opts.bandPixels);
 
-    // Handle filename conflicts
-    if (fs::exists(outputPath) || nameCounter[baseName] > 0) {
-        int counter = ++nameCounter[baseName];
-        outputPath = outputDir / (baseName + "_" + std::to_string(counter) + "." + format);
-    }
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
 
-    return outputPath.string();
+    tim2::ConversionServer server(serverOpts);
+    return server.run(g_stopRequested);
 }
 
-int handleBatch(const Options& opts) {
-    fs::path inputPath(opts.inputPath);
+int handleClient(const Options& opts) {
+    namespace protocol = tim2::protocol;
 
-    if (!fs::exists(inputPath)) {
-        std::cerr << "Error: Input path does not exist: " << opts.inputPath << "\n";
-        return 1;
+    protocol::Request request;
+    request.op = opts.requestInfo ? protocol::Op::Info : protocol::Op::Export;
+    request.format = opts.format == "png" ? protocol::Format::PNG : protocol::Format::BMP;
+    request.picture = static_cast<uint32_t>(std::max(0, opts.pictureIndex));
+    request.mip = static_cast<uint32_t>(std::max(0, opts.mipLevel));
+
+    if (opts.sendInline) {
+        request.source = protocol::Source::Inline;
+        std::ifstream file(opts.inputPath, std::ios::binary);
+        request.data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    } else {
+        // The server may run in another directory
+        const std::string path = fs::absolute(opts.inputPath).string();
+        request.data.assign(path.begin(), path.end());
     }
 
-    if (!fs::is_directory(inputPath)) {
-        std::cerr << "Error: Input path is not a directory: " << opts.inputPath << "\n";
+    protocol::Response response;
+    std::string error;
+    if (!tim2::sendServerRequest(opts.socketPath, request, response, error)) {
+        std::cerr << "Error: " << error << "\n";
         return 1;
     }
 
-    // Find all TIM2 files
-    auto tim2Files = findTIM2Files(inputPath);
-
-    if (tim2Files.empty()) {
-        std::cout << "No TIM2 files found in " << opts.inputPath << "\n";
+    const std::string body(response.body.begin(), response.body.end());
+    if (response.status != protocol::Status::Ok) {
+        std::cerr << "Error: " << body << "\n";
+        return 1;
+    }
+    if (opts.requestInfo) {
+        std::cout << body << "\n";
         return 0;
     }
 
-    std::cout << "Found " << tim2Files.size() << " TIM2 file(s) to process.\n\n";
-
-    // Prepare output directory if specified
-    fs::path outputRoot;
-    bool useOutputFolder = !opts.outputFolder.empty();
-
-    if (useOutputFolder) {
-        outputRoot = fs::path(opts.outputFolder);
-        try {
-            fs::create_directories(outputRoot);
-        } catch (const std::exception& e) {
-            std::cerr << "Error creating output directory: " << e.what() << "\n";
-            return 1;
-        }
+    const std::string filename = !opts.outputFolder.empty()
+                                     ? opts.outputFolder
+                                     : fs::path(opts.inputPath).stem().string() + "." + opts.format;
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    if (!out.write(body.data(), static_cast<std::streamsize>(body.size()))) {
+        std::cerr << "Failed to export: " << filename << "\n";
+        return 1;
     }
+    std::cout << "Exported: " << filename << "\n";
+    return 0;
+}
 
-    // Process each file
-    int successCount = 0;
-    int failCount = 0;
-    std::map<std::string, int> nameCounter;  // Track filename conflicts
-
-    for (const auto& tim2Path : tim2Files) {
-        std::cout << "Processing: " << tim2Path.string() << "\n";
-
-        tim2::TIM2Parser parser;
-        if (!parser.loadFile(tim2Path.string())) {
-            std::cerr << "  Error: " << parser.getLastError() << "\n";
-            failCount++;
-            continue;
-        }
-
-        // Determine output directory
-        fs::path outputDir;
-        if (useOutputFolder) {
-            // Preserve relative directory structure in output folder
-            auto relativePath = fs::relative(tim2Path.parent_path(), inputPath);
-            outputDir = outputRoot / relativePath;
-
-            try {
-                fs::create_directories(outputDir);
-            } catch (const std::exception& e) {
-                std::cerr << "  Error creating directory: " << e.what() << "\n";
-                failCount++;
-                continue;
-            }
-        } else {
-            // Save alongside source file
-            outputDir = tim2Path.parent_path();
-        }
-
-        // Export all pictures from this TIM2 file
-        bool fileSuccess = true;
-        for (size_t i = 0; i < parser.getPictureCount(); ++i) {
-            const auto* pic = parser.getPicture(i);
-            if (!pic) continue;
-
-            for (size_t mip = 0; mip < pic->header.mipMapTextures; ++mip) {
-                std::string outputFilename;
-
-                if (useOutputFolder) {
-                    // Generate unique filename in output folder for pic and mip level
-                    std::string baseName = tim2Path.stem().string();
-                    if (parser.getPictureCount() > 1) {
-                        baseName += "_pic" + std::to_string(i);
-                    }
-                    if (pic->header.mipMapTextures > 1) {
-                        baseName += "_mip" + std::to_string(mip);
-                    }
-
-                    outputFilename = (outputDir / (baseName + "." + opts.format)).string();
-
-                    // Handle conflicts in case different files happen to have the same name
-                    if (fs::exists(outputFilename)) {
-                        int counter = 1;
-                        do {
-                            outputFilename = (outputDir / (baseName + "_" + std::to_string(counter++) + "." + opts.format)).string();
-                        } while (fs::exists(outputFilename));
-                    }
-                } else {
-                    // Save alongside source with standard naming
-                    std::string baseName = tim2Path.stem().string();
-                    if (parser.getPictureCount() > 1) {
-                        baseName += "_pic" + std::to_string(i);
-                    }
-                    if (pic->header.mipMapTextures > 1) {
-                        baseName += "_mip" + std::to_string(mip);
-                    }
-                    outputFilename = (outputDir / (baseName + "." + opts.format)).string();
-                }
-
-                bool result = false;
-                if (opts.format == "png") {
-                    result = tim2::ImageConverter::exportPNG(*pic, outputFilename, mip);
-                } else {
-                    result = tim2::ImageConverter::exportBMP(*pic, outputFilename, mip);
-                }
-
-                if (result) {
-                    std::cout << "  -> " << outputFilename << "\n";
-                } else {
-                    std::cerr << "  Failed to export: " << outputFilename << "\n";
-                    fileSuccess = false;
-                }
-            }
-        }
-
-        if (fileSuccess) {
-            successCount++;
-        } else {
-            failCount++;
+// Phase times, heap use (and counters) since start as tables and/or JSON,
+// and the --trace file; passes the command's exit code through
+int finishCommand(const Options& opts, std::chrono::steady_clock::time_point start, int exitCode) {
+    if (!opts.tracePath.empty()) {
+        std::string error;
+        if (!tim2::trace::write(opts.tracePath, error)) {
+            std::cerr << "Warning: " << error << "\n";
+        } else if (const uint64_t dropped = tim2::trace::droppedEvents()) {
+            std::cerr << "Warning: Trace buffers were full, " << dropped << " event(s) were not recorded\n";
         }
     }
 
-    // Summary
-    std::cout << "\n" << std::string(60, '-') << "\n";
-    std::cout << "Batch conversion complete!\n";
-    std::cout << "  Processed: " << tim2Files.size() << " file(s)\n";
-    std::cout << "  Success: " << successCount << "\n";
-    std::cout << "  Failed: " << failCount << "\n";
+    if (!opts.stats && opts.statsJson.empty() && !opts.counters) return exitCode;
 
-    if (useOutputFolder) {
-        std::cout << "  Output directory: " << outputRoot.string() << "\n";
-    } else {
-        std::cout << "  Files saved alongside source files\n";
+    const auto report = tim2::stats::collect();
+    const auto elapsed = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                   std::chrono::steady_clock::now() - start).count());
+    if (opts.stats) {
+        tim2::TableFormatter::displayPhaseStats(report, elapsed);
+        tim2::TableFormatter::displayMemoryStats(report);
     }
-
-    return (failCount > 0) ? 1 : 0;
+    if (opts.counters && tim2::perf::enabled()) {
+        tim2::TableFormatter::displayCounterStats(report, tim2::perf::collectFormats());
+    }
+    if (opts.statsJson == "-") {
+        std::cout << tim2::stats::reportJson(report, elapsed) << "\n";
+    } else if (!opts.statsJson.empty()) {
+        std::ofstream out(opts.statsJson, std::ios::trunc);
+        if (!(out << tim2::stats::reportJson(report, elapsed) << "\n")) {
+            std::cerr << "Warning: Cannot write statistics to " << opts.statsJson << "\n";
+        }
+    }
+    return exitCode;
 }
 
 int handleInfo(const Options& opts) {
@@ -304,6 +441,8 @@ int handleInfo(const Options& opts) {
 }
 
 int handleExport(const Options& opts) {
+    const fs::path inputFile(opts.inputPath);
+    tim2::trace::Item item(&inputFile);
     tim2::TIM2Parser parser;
 
     if (!parser.loadFile(opts.inputPath)) {
@@ -314,7 +453,6 @@ int handleExport(const Options& opts) {
     std::cout << "Exporting images from " << opts.inputPath << "...\n";
 
     // Generate output base name from input filename
-    fs::path inputFile(opts.inputPath);
     std::string outputBase = inputFile.stem().string();
 
     if (opts.pictureIndex >= 0) {
@@ -391,30 +529,74 @@ int main(int argc, char* argv[]) {
     Options opts = parseArguments(argc, argv);
 
     // Check if input exists (file or directory depending on command)
-    if (!fs::exists(opts.inputPath)) {
+    const bool fileList = opts.command == "batch" && isFileList(opts.inputPath);
+    if (opts.command == "serve") {
+        return handleServe(opts);
+    }
+    if (fileList && opts.inputPath != "-" && !fs::is_regular_file(opts.inputPath.substr(1))) {
+        std::cerr << "Error: File list not found: " << opts.inputPath.substr(1) << "\n";
+        return 1;
+    }
+    if (!fileList && !fs::exists(opts.inputPath)) {
         std::cerr << "Error: Path not found: " << opts.inputPath << "\n";
         return 1;
     }
 
+    // Tracing records the phase scopes too, so it needs them enabled
+    const bool tracing = !opts.tracePath.empty();
+    if (tracing) {
+        tim2::trace::start();
+        tim2::trace::setThreadName("main");
+    }
+    std::string counterError;
+    if (opts.counters && !tim2::perf::start(counterError)) {
+        std::cerr << "Warning: " << counterError << "; continuing without them\n";
+    }
+    tim2::stats::enable(opts.stats || !opts.statsJson.empty() || opts.counters || tracing);
+    if (opts.stats || !opts.statsJson.empty()) tim2::alloc::enable();
+    const auto start = std::chrono::steady_clock::now();
+
     // Handle commands
     if (opts.command == "info") {
         if (!fs::is_regular_file(opts.inputPath)) {
             std::cerr << "Error: 'info' command requires a file, not a directory\n";
             return 1;
         }
-        return handleInfo(opts);
+        return finishCommand(opts, start, handleInfo(opts));
     } else if (opts.command == "export") {
         if (!fs::is_regular_file(opts.inputPath)) {
             std::cerr << "Error: 'export' command requires a file, not a directory\n";
             return 1;
         }
-        return handleExport(opts);
+        return finishCommand(opts, start, handleExport(opts));
     } else if (opts.command == "batch") {
+        if (!fileList && !fs::is_directory(opts.inputPath)) {
+            std::cerr << "Error: 'batch' command requires a directory or a file list, not a file\n";
+            return 1;
+        }
+        if (opts.shardCount == 0 || opts.shardIndex >= opts.shardCount) {
+            std::cerr << "Error: --shard expects i/n with 0 <= i < n\n";
+            return 1;
+        }
+        return finishCommand(opts, start, handleBatch(opts));
+    } else if (opts.command == "watch") {
+        if (!fs::is_directory(opts.inputPath)) {
+            std::cerr << "Error: 'watch' command requires a directory, not a file\n";
+            return 1;
+        }
+        return finishCommand(opts, start, handleBatch(opts));
+    } else if (opts.command == "client") {
+        if (opts.socketPath.empty()) {
+            std::cerr << "Error: 'client' command requires --socket <path>\n";
+            return 1;
+        }
+        return handleClient(opts);
+    } else if (opts.command == "merge") {
         if (!fs::is_directory(opts.inputPath)) {
-            std::cerr << "Error: 'batch' command requires a directory, not a file\n";
+            std::cerr << "Error: 'merge' command requires a batch output directory\n";
             return 1;
         }
-        return handleBatch(opts);
+        return tim2::BatchProcessor::mergeShards(opts.inputPath);
     } else if (opts.command == "viewc") {
         if (!fs::is_regular_file(opts.inputPath)) {
             std::cerr << "Error: 'viewc' command requires a file, not a directory\n";
@@ -0,0 +1,44 @@
+#include "memory_budget.h"
+#include <algorithm>
+
+namespace tim2 {
+
+MemoryBudget::MemoryBudget(uint64_t limit)
+    : m_limit(limit) {
+}
+
+/**
+ * Ticket queue: each caller waits for its turn, then for the reservation to
+ * fit, and only then lets the next caller in. Everyone behind a blocked
+ * reservation therefore waits too, which keeps admission in order.
+ */
+uint64_t MemoryBudget::acquire(uint64_t bytes) {
+    bytes = std::min(bytes, m_limit);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const uint64_t ticket = m_nextTicket++;
+    m_changed.wait(lock, [&] { return m_serving == ticket && m_reserved + bytes <= m_limit; });
+
+    m_reserved += bytes;
+    m_peak = std::max(m_peak, m_reserved);
+    m_serving++;
+    lock.unlock();
+
+    m_changed.notify_all();
+    return bytes;
+}
+
+void MemoryBudget::release(uint64_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_reserved -= std::min(bytes, m_reserved);
+    }
+    m_changed.notify_all();
+}
+
+uint64_t MemoryBudget::peak() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_peak;
+}
+
+} // namespace tim2
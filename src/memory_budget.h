@@ -0,0 +1,40 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+namespace tim2 {
+
+// Batch-wide limit on estimated memory use.
+//
+// Work reserves its estimated peak before it starts and releases it when it
+// is done; acquire() blocks while the reservation would not fit. Waiters are
+// served in arrival order, so a large reservation is not starved by a stream
+// of small ones. A reservation larger than the whole budget is admitted once
+// nothing else is reserved, so it runs alone instead of deadlocking.
+class MemoryBudget {
+public:
+    explicit MemoryBudget(uint64_t limit);
+
+    // Block until bytes can be reserved; returns the amount actually reserved
+    // (clamped to the limit), which must be passed to release()
+    uint64_t acquire(uint64_t bytes);
+    void release(uint64_t bytes);
+
+    uint64_t limit() const { return m_limit; }
+
+    // Highest total reserved at any time
+    uint64_t peak() const;
+
+private:
+    const uint64_t m_limit;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_changed;
+    uint64_t m_reserved = 0;
+    uint64_t m_peak = 0;
+    uint64_t m_nextTicket = 0;
+    uint64_t m_serving = 0;
+};
+
+} // namespace tim2
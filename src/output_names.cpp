@@ -0,0 +1,129 @@
+#include "output_names.h"
+#include <chrono>
+#include <iterator>
+
+namespace fs = std::filesystem;
+
+namespace tim2 {
+
+namespace {
+
+// Temp files older than this are leftovers from a killed process, as in
+// TextureCache; younger ones may still be being written
+constexpr auto kStaleTempAge = std::chrono::hours(1);
+
+} // namespace
+
+OutputNameTable::Directory& OutputNameTable::directoryFor(const fs::path& dir) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& slot = m_directories[dir.lexically_normal().string()];
+    if (!slot) {
+        slot = std::make_unique<Directory>();
+    }
+    return *slot;
+}
+
+// One directory_iterator pass, the first time a directory is used
+void OutputNameTable::list(Directory& directory, const fs::path& dir) const {
+    if (directory.listed) return;
+
+    const auto now = fs::file_time_type::clock::now();
+
+    std::error_code ec;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        std::string name = it->path().filename().string();
+
+        if (!m_tempSuffix.empty() && name.size() > m_tempSuffix.size() &&
+            name.compare(name.size() - m_tempSuffix.size(), m_tempSuffix.size(), m_tempSuffix) == 0) {
+            std::error_code entryEc;
+            const auto mtime = it->last_write_time(entryEc);
+            if (!entryEc && now - mtime > kStaleTempAge) fs::remove(it->path(), entryEc);
+            continue;
+        }
+
+        directory.taken.insert(std::move(name));
+    }
+    directory.listed = true;
+}
+
+/**
+ * Same naming rule the batch has always used ("_1", "_2", ... appended to
+ * the base name), but checked against the directory's one-time listing and
+ * earlier reservations instead of fs::exists. The next suffix to try is
+ * remembered per base name, since the taken set only ever grows.
+ */
+std::string OutputNameTable::reserve(const fs::path& dir, const std::string& baseName,
+                                     const std::string& ext) {
+    Directory& directory = directoryFor(dir);
+    std::lock_guard<std::mutex> lock(directory.mutex);
+    list(directory, dir);
+
+    std::string name = baseName + "." + ext;
+    if (directory.taken.count(name) > 0) {
+        int& counter = directory.nextSuffix[name];
+        if (counter == 0) counter = 1;
+
+        do {
+            name = baseName + "_" + std::to_string(counter++) + "." + ext;
+        } while (directory.taken.count(name) > 0);
+    }
+
+    directory.taken.insert(name);
+    directory.reserved.insert(name);
+    return (dir / name).string();
+}
+
+bool OutputNameTable::claim(const fs::path& file) {
+    Directory& directory = directoryFor(file.parent_path());
+    std::lock_guard<std::mutex> lock(directory.mutex);
+    list(directory, file.parent_path());
+
+    const std::string name = file.filename().string();
+    if (!directory.reserved.insert(name).second) return false;
+    directory.taken.insert(name);
+    return true;
+}
+
+/**
+ * One pass over the listing: a name matches when, without ".<ext>", it is
+ * a base name itself or one followed by "_<digits>".
+ */
+void OutputNameTable::release(const fs::path& dir, const std::unordered_set<std::string>& baseNames,
+                              const std::string& ext) {
+    Directory& directory = directoryFor(dir);
+    std::lock_guard<std::mutex> lock(directory.mutex);
+    list(directory, dir);
+
+    const std::string suffix = "." + ext;
+    for (auto it = directory.taken.begin(); it != directory.taken.end();) {
+        const std::string& name = *it;
+        bool matches = false;
+        if (name.size() > suffix.size() && directory.reserved.count(name) == 0 &&
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+            const std::string stem = name.substr(0, name.size() - suffix.size());
+            matches = baseNames.count(stem) > 0;
+
+            const size_t underscore = stem.rfind('_');
+            if (!matches && underscore != std::string::npos && underscore + 1 < stem.size() &&
+                stem.find_first_not_of("0123456789", underscore + 1) == std::string::npos) {
+                matches = baseNames.count(stem.substr(0, underscore)) > 0;
+            }
+        }
+        it = matches ? directory.taken.erase(it) : std::next(it);
+    }
+}
+
+bool OutputNameTable::exists(const fs::path& file) {
+    Directory& directory = directoryFor(file.parent_path());
+    std::lock_guard<std::mutex> lock(directory.mutex);
+    list(directory, file.parent_path());
+
+    return directory.taken.count(file.filename().string()) > 0;
+}
+
+void OutputNameTable::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_directories.clear();
+}
+
+} // namespace tim2
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace tim2 {
+
+// In-memory registry of output file names for a batch run.
+//
+// Each output directory is listed once, the first time a name is requested in
+// it; after that, conflicts are resolved entirely in memory against what was
+// on disk plus everything handed out so far. No per-file stat calls, and safe
+// to use from several threads (one lock per directory).
+class OutputNameTable {
+public:
+    // Reserve "<dir>/<baseName>.<ext>", or "<dir>/<baseName>_N.<ext>" with the
+    // smallest N >= 1 that is free. Returns the full path.
+    std::string reserve(const std::filesystem::path& dir, const std::string& baseName,
+                        const std::string& ext);
+
+    // Reserve an exact path (e.g. a name recorded by an earlier run). Fails if
+    // this run already handed it out; being on disk is fine.
+    bool claim(const std::filesystem::path& file);
+
+    // Forget the on-disk files in dir named "<base>.<ext>" or "<base>_N.<ext>"
+    // for any of baseNames, so they are reused rather than avoided. Names this
+    // run handed out stay taken.
+    void release(const std::filesystem::path& dir, const std::unordered_set<std::string>& baseNames,
+                 const std::string& ext);
+
+    // Whether a path was on disk when its directory was listed, or is reserved
+    bool exists(const std::filesystem::path& file);
+
+    // Files ending in this suffix are temp files, not taken names. Stale ones
+    // are leftovers of an interrupted run and are deleted when their
+    // directory is listed; recent ones may belong to a process still writing
+    // (a shard sharing the directory) and are left alone.
+    void setTempSuffix(std::string suffix) { m_tempSuffix = std::move(suffix); }
+
+    // Drop all cached listings and reservations
+    void clear();
+
+private:
+    struct Directory {
+        std::mutex mutex;
+        bool listed = false;
+        std::unordered_set<std::string> taken;             // File names only
+        std::unordered_set<std::string> reserved;          // Handed out by this run
+        std::unordered_map<std::string, int> nextSuffix;   // Per "<base>.<ext>"
+    };
+
+    std::mutex m_mutex;
+    std::unordered_map<std::string, std::unique_ptr<Directory>> m_directories;
+    std::string m_tempSuffix;
+
+    // Find (or create) a directory's state; lock its mutex, then call list()
+    Directory& directoryFor(const std::filesystem::path& dir);
+    void list(Directory& directory, const std::filesystem::path& dir) const;
+};
+
+} // namespace tim2
@@ -0,0 +1,245 @@
+#include "perf_counters.h"
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace tim2 {
+namespace perf {
+
+std::atomic<bool> g_enabled{false};
+
+namespace {
+
+std::atomic<uint32_t> g_availableMask{0};
+std::atomic<bool> g_multiplexed{false};
+
+struct ThreadTotals {
+    std::array<std::atomic<uint64_t>, kFormatSlots> calls{};
+    std::array<std::atomic<uint64_t>, kFormatSlots> pixels{};
+    std::array<std::array<std::atomic<uint64_t>, kCounterCount>, kFormatSlots> counters{};
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadTotals>> threads;
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+thread_local ThreadTotals* t_totals = nullptr;
+
+ThreadTotals& threadTotals() {
+    if (!t_totals) {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.threads.push_back(std::make_unique<ThreadTotals>());
+        t_totals = reg.threads.back().get();
+    }
+    return *t_totals;
+}
+
+// Only the owning thread writes
+void add(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+#ifdef __linux__
+
+uint64_t eventConfig(Counter counter) {
+    switch (counter) {
+        case Counter::Cycles:       return PERF_COUNT_HW_CPU_CYCLES;
+        case Counter::Instructions: return PERF_COUNT_HW_INSTRUCTIONS;
+        case Counter::CacheMisses:  return PERF_COUNT_HW_CACHE_MISSES;
+        default:                    return PERF_COUNT_HW_BRANCH_MISSES;
+    }
+}
+
+// One counter group per thread, user space only, read in a single read()
+// (PERF_FORMAT_GROUP). Closed when the thread exits.
+struct CounterGroup {
+    int leader = -1;
+    std::array<int, kCounterCount> fds;
+    std::array<int, kCounterCount> slots;  // Position in the group read, -1 if not open
+    size_t opened = 0;
+    bool tried = false;
+    int firstError = 0;
+
+    CounterGroup() {
+        fds.fill(-1);
+        slots.fill(-1);
+    }
+
+    ~CounterGroup() {
+        for (int fd : fds) {
+            if (fd >= 0) close(fd);
+        }
+    }
+
+    // Open the counters in mask; returns the mask of those that opened
+    uint32_t open(uint32_t mask) {
+        tried = true;
+        uint32_t openedMask = 0;
+
+        for (size_t c = 0; c < kCounterCount; ++c) {
+            if (!(mask & (1u << c))) continue;
+
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = eventConfig(static_cast<Counter>(c));
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+
+            const long fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC);
+            if (fd < 0) {
+                if (!firstError) firstError = errno;
+                continue;
+            }
+
+            fds[c] = static_cast<int>(fd);
+            slots[c] = static_cast<int>(opened++);
+            if (leader < 0) leader = fds[c];
+            openedMask |= 1u << c;
+        }
+        return openedMask;
+    }
+
+    // Layout: nr, time enabled, time running, then one value per counter.
+    // The group is scheduled as a whole, so one ratio scales every counter.
+    bool read(Values& values) const {
+        if (leader < 0) return false;
+
+        uint64_t buffer[3 + kCounterCount];
+        const ssize_t size = ::read(leader, buffer, sizeof(buffer));
+        if (size < static_cast<ssize_t>(sizeof(uint64_t) * (3 + opened))) return false;
+
+        const uint64_t enabled = buffer[1];
+        const uint64_t running = buffer[2];
+        const bool scaled = running < enabled;
+        if (scaled) g_multiplexed.store(true, std::memory_order_relaxed);
+
+        for (size_t c = 0; c < kCounterCount; ++c) {
+            uint64_t value = slots[c] >= 0 ? buffer[3 + slots[c]] : 0;
+            if (scaled) {
+                value = running > 0 ? static_cast<uint64_t>(static_cast<double>(value) * enabled / running) : 0;
+            }
+            values[c] = value;
+        }
+        return true;
+    }
+};
+
+thread_local CounterGroup t_group;
+
+#endif
+
+} // namespace
+
+const char* counterName(Counter counter) {
+    switch (counter) {
+        case Counter::Cycles:       return "Cycles";
+        case Counter::Instructions: return "Instructions";
+        case Counter::CacheMisses:  return "Cache misses";
+        case Counter::BranchMisses: return "Branch misses";
+        default:                    return "?";
+    }
+}
+
+#ifdef __linux__
+
+bool start(std::string& error) {
+    const uint32_t mask = t_group.open((1u << kCounterCount) - 1);
+    if (mask == 0) {
+        error = std::string("Hardware counters unavailable (perf_event_open: ") + std::strerror(t_group.firstError);
+        if (t_group.firstError == EACCES || t_group.firstError == EPERM) {
+            error += "; see /proc/sys/kernel/perf_event_paranoid";
+        } else if (t_group.firstError == ENOENT || t_group.firstError == EOPNOTSUPP) {
+            error += "; no PMU, e.g. in a virtual machine";
+        }
+        error += ")";
+        return false;
+    }
+
+    g_availableMask.store(mask, std::memory_order_relaxed);
+    g_enabled.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+bool read(Values& values) {
+    if (!t_group.tried) {
+        t_group.open(g_availableMask.load(std::memory_order_relaxed));
+    }
+    return t_group.read(values);
+}
+
+#else
+
+bool start(std::string& error) {
+    error = "Hardware counters need Linux perf_event and are not available on this platform";
+    return false;
+}
+
+bool read(Values&) {
+    return false;
+}
+
+#endif
+
+bool multiplexed() {
+    return g_multiplexed.load(std::memory_order_relaxed);
+}
+
+bool available(Counter counter) {
+    return (g_availableMask.load(std::memory_order_relaxed) >> static_cast<size_t>(counter)) & 1;
+}
+
+FormatReport collectFormats() {
+    FormatReport report{};
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    for (const auto& totals : reg.threads) {
+        for (size_t f = 0; f < kFormatSlots; ++f) {
+            report[f].calls += totals->calls[f].load(std::memory_order_relaxed);
+            report[f].pixels += totals->pixels[f].load(std::memory_order_relaxed);
+            for (size_t c = 0; c < kCounterCount; ++c) {
+                report[f].counters[c] += totals->counters[f][c].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    return report;
+}
+
+void FormatScope::begin(uint8_t format, size_t pixelCount) {
+    m_active = read(m_start);
+    m_format = format < kOtherFormat ? format : kOtherFormat;
+    m_pixels = pixelCount;
+}
+
+void FormatScope::end() {
+    Values now;
+    if (!read(now)) return;
+
+    ThreadTotals& totals = threadTotals();
+    add(totals.calls[m_format], 1);
+    add(totals.pixels[m_format], m_pixels);
+    for (size_t c = 0; c < kCounterCount; ++c) {
+        add(totals.counters[m_format][c], now[c] > m_start[c] ? now[c] - m_start[c] : 0);
+    }
+}
+
+} // namespace perf
+} // namespace tim2
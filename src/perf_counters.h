@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace tim2 {
+namespace perf {
+
+// Hardware performance counters for --counters (Linux perf_event).
+//
+// Every thread that records opens its own counter group on first use and
+// reads it with one read() at the start and end of each measured region.
+// stats::Scope charges the deltas to its phase (exclusive of nested scopes,
+// like its times); FormatScope charges decodes to their pixel format. Where
+// perf_event is missing or not permitted (containers, perf_event_paranoid,
+// VMs without a PMU, other platforms) start() fails and nothing is counted.
+
+enum class Counter : uint8_t {
+    Cycles,
+    Instructions,
+    CacheMisses,
+    BranchMisses,
+    Count
+};
+
+constexpr size_t kCounterCount = static_cast<size_t>(Counter::Count);
+constexpr size_t kFormatSlots = 7;  // PixelFormat values 0..5, then any other value
+constexpr size_t kOtherFormat = kFormatSlots - 1;
+
+using Values = std::array<uint64_t, kCounterCount>;
+
+const char* counterName(Counter counter);
+
+extern std::atomic<bool> g_enabled;
+
+inline bool enabled() {
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+// Probe the counters on the calling thread and enable counting. False with
+// a reason if no counter can be opened; counters the CPU lacks are skipped.
+bool start(std::string& error);
+
+// Whether a counter opened in start() (the others always read 0)
+bool available(Counter counter);
+
+// The calling thread's running totals; false if its group could not be opened.
+// When the kernel had to multiplex the group with other events, the counts
+// are scaled up by enabled/running time and so are estimates.
+bool read(Values& values);
+
+// Whether any group read so far was multiplexed (scaled counts)
+bool multiplexed();
+
+struct FormatTotals {
+    uint64_t calls = 0;
+    uint64_t pixels = 0;
+    Values counters{};
+};
+
+using FormatReport = std::array<FormatTotals, kFormatSlots>;
+
+// Decode totals per pixel format, summed over all threads
+FormatReport collectFormats();
+
+// Count the enclosing block as decoding pixelCount pixels of a format
+class FormatScope {
+public:
+    FormatScope(uint8_t format, size_t pixelCount) {
+        if (enabled()) begin(format, pixelCount);
+    }
+    ~FormatScope() {
+        if (m_active) end();
+    }
+
+    FormatScope(const FormatScope&) = delete;
+    FormatScope& operator=(const FormatScope&) = delete;
+
+private:
+    bool m_active = false;
+    uint8_t m_format = 0;
+    size_t m_pixels = 0;
+    Values m_start{};
+
+    void begin(uint8_t format, size_t pixelCount);
+    void end();
+};
+
+} // namespace perf
+} // namespace tim2
@@ -0,0 +1,244 @@
+#include "phase_stats.h"
+#include "json_writer.h"
+#include "trace_recorder.h"
+#include "tim2_types.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace tim2 {
+namespace stats {
+
+std::atomic<bool> g_enabled{false};
+
+static_assert(alloc::kOutside == kPhaseCount, "alloc slots must be the phases plus one");
+
+namespace {
+
+struct ThreadTotals {
+    std::array<std::atomic<uint64_t>, kPhaseCount> calls{};
+    std::array<std::atomic<uint64_t>, kPhaseCount> wallNanos{};
+    std::array<std::atomic<uint64_t>, kPhaseCount> cpuNanos{};
+    std::array<std::array<std::atomic<uint64_t>, perf::kCounterCount>, kPhaseCount> counters{};
+};
+
+// Accumulators of every thread that has recorded a scope. They are owned
+// here rather than by the thread, so the totals of pool threads that have
+// already exited still count.
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadTotals>> threads;
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+thread_local ThreadTotals* t_totals = nullptr;
+thread_local Scope* t_current = nullptr;
+
+ThreadTotals& threadTotals() {
+    if (!t_totals) {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.threads.push_back(std::make_unique<ThreadTotals>());
+        t_totals = reg.threads.back().get();
+    }
+    return *t_totals;
+}
+
+// Only the owning thread writes, so a plain load/store pair is enough
+void add(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+uint64_t wallNow() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+uint64_t cpuNow() {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user)) return 0;
+    auto ticks = [](const FILETIME& t) {
+        return (static_cast<uint64_t>(t.dwHighDateTime) << 32) | t.dwLowDateTime;
+    };
+    return (ticks(kernel) + ticks(user)) * 100;  // 100 ns units
+#else
+    timespec now;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0) return 0;
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+#endif
+}
+
+// Available hardware counters as camelCase fields
+void addCounters(JsonWriter& json, const perf::Values& values) {
+    static constexpr const char* kKeys[perf::kCounterCount] = {
+        "cycles", "instructions", "cacheMisses", "branchMisses"};
+    for (size_t c = 0; c < perf::kCounterCount; ++c) {
+        if (perf::available(static_cast<perf::Counter>(c))) json.field(kKeys[c], values[c]);
+    }
+}
+
+} // namespace
+
+const char* phaseName(Phase phase) {
+    switch (phase) {
+        case Phase::Scan:   return "Scan";
+        case Phase::Read:   return "Read";
+        case Phase::Parse:  return "Parse";
+        case Phase::Clut:   return "CLUT decode";
+        case Phase::Decode: return "Pixel decode";
+        case Phase::Encode: return "Encode";
+        case Phase::Write:  return "Write";
+        default:            return "?";
+    }
+}
+
+void enable(bool on) {
+    g_enabled.store(on, std::memory_order_relaxed);
+}
+
+Report collect() {
+    Report report{};
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    for (const auto& totals : reg.threads) {
+        for (size_t p = 0; p < kPhaseCount; ++p) {
+            report[p].calls += totals->calls[p].load(std::memory_order_relaxed);
+            report[p].wallNanos += totals->wallNanos[p].load(std::memory_order_relaxed);
+            report[p].cpuNanos += totals->cpuNanos[p].load(std::memory_order_relaxed);
+            for (size_t c = 0; c < perf::kCounterCount; ++c) {
+                report[p].counters[c] += totals->counters[p][c].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    const alloc::Report heap = alloc::collect();
+    for (size_t p = 0; p < kPhaseCount; ++p) {
+        report[p].heap = heap[p];
+    }
+    return report;
+}
+
+std::string reportJson(const Report& report, uint64_t elapsedNanos) {
+    JsonWriter json;
+    json.beginObject()
+        .field("elapsedSeconds", elapsedNanos / 1e9)
+        .key("phases").beginArray();
+
+    for (size_t p = 0; p < kPhaseCount; ++p) {
+        json.beginObject()
+            .field("phase", std::string_view(phaseName(static_cast<Phase>(p))))
+            .field("calls", report[p].calls)
+            .field("wallSeconds", report[p].wallNanos / 1e9)
+            .field("cpuSeconds", report[p].cpuNanos / 1e9);
+        if (perf::enabled()) {
+            addCounters(json, report[p].counters);
+        }
+        if (alloc::enabled()) {
+            json.field("allocations", report[p].heap.allocations)
+                .field("allocatedBytes", report[p].heap.bytes)
+                .field("peakLiveBytes", report[p].heap.peakLiveBytes);
+        }
+        json.endObject();
+    }
+    json.endArray();
+
+    json.key("memory").beginObject();
+    if (alloc::enabled()) {
+        const alloc::PhaseTotals outside = alloc::collect()[alloc::kOutside];
+        json.field("outsidePhaseAllocations", outside.allocations)
+            .field("outsidePhaseBytes", outside.bytes)
+            .field("heapPeakBytes", alloc::heapPeakBytes());
+    }
+    json.field("peakRssBytes", alloc::peakRssBytes()).endObject();
+
+    if (perf::enabled()) {
+        const perf::FormatReport formats = perf::collectFormats();
+        json.field("countersMultiplexed", perf::multiplexed());
+        json.key("formats").beginArray();
+        for (size_t f = 0; f < perf::kFormatSlots; ++f) {
+            if (formats[f].calls == 0) continue;
+            json.beginObject()
+                .field("format", f == perf::kOtherFormat ? std::string("Other")
+                                                         : pixelFormatToString(static_cast<PixelFormat>(f)))
+                .field("calls", formats[f].calls)
+                .field("pixels", formats[f].pixels);
+            addCounters(json, formats[f].counters);
+            json.endObject();
+        }
+        json.endArray();
+    }
+
+    json.endObject();
+    return json.str();
+}
+
+void Scope::begin(Phase phase) {
+    m_active = true;
+    m_phase = phase;
+    m_parent = t_current;
+    t_current = this;
+    m_allocating = alloc::enabled();
+    if (m_allocating) m_allocSaved = alloc::enterPhase(static_cast<size_t>(phase));
+    m_counting = perf::enabled() && perf::read(m_counterStart);
+    m_cpuStart = cpuNow();
+    m_wallStart = wallNow();
+}
+
+/**
+ * Charge this scope's time minus its children's to its phase, and report
+ * the full time to the parent so it can do the same.
+ */
+void Scope::end() {
+    const uint64_t wall = wallNow() - m_wallStart;
+    // The CPU reads bracket the wall reads; clamp so clock overhead cannot
+    // make a thread look more than 100% busy
+    const uint64_t cpu = std::min(cpuNow() - m_cpuStart, wall);
+    perf::Values counters{};
+    if (m_counting && perf::read(counters)) {
+        for (size_t c = 0; c < perf::kCounterCount; ++c) {
+            // Scaled (multiplexed) counts can step back slightly
+            counters[c] = counters[c] > m_counterStart[c] ? counters[c] - m_counterStart[c] : 0;
+        }
+    }
+
+    if (m_allocating) alloc::leavePhase(m_allocSaved);
+
+    ThreadTotals& totals = threadTotals();
+    const size_t p = static_cast<size_t>(m_phase);
+    add(totals.calls[p], 1);
+    add(totals.wallNanos[p], wall > m_childWall ? wall - m_childWall : 0);
+    add(totals.cpuNanos[p], cpu > m_childCpu ? cpu - m_childCpu : 0);
+    for (size_t c = 0; c < perf::kCounterCount; ++c) {
+        add(totals.counters[p][c], counters[c] > m_childCounters[c] ? counters[c] - m_childCounters[c] : 0);
+    }
+
+    if (trace::enabled()) {
+        trace::record(phaseName(m_phase), "phase", m_wallStart, wall);
+    }
+
+    if (m_parent) {
+        m_parent->m_childWall += wall;
+        m_parent->m_childCpu += cpu;
+        for (size_t c = 0; c < perf::kCounterCount; ++c) {
+            m_parent->m_childCounters[c] += counters[c];
+        }
+    }
+    t_current = m_parent;
+}
+
+} // namespace stats
+} // namespace tim2
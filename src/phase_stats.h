@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "alloc_stats.h"
+#include "perf_counters.h"
+
+namespace tim2 {
+namespace stats {
+
+// Pipeline phases that --stats reports on
+enum class Phase : uint8_t {
+    Scan,    // Directory walk, filtering and planning
+    Read,    // Reading source files
+    Parse,   // TIM2 headers and data blocks
+    Clut,    // Palette decode
+    Decode,  // Pixel decode
+    Encode,  // BMP/PNG encode
+    Write,   // Writing output files
+    Count
+};
+
+constexpr size_t kPhaseCount = static_cast<size_t>(Phase::Count);
+
+const char* phaseName(Phase phase);
+
+struct PhaseTotals {
+    uint64_t calls = 0;
+    uint64_t wallNanos = 0;  // Exclusive: time in nested scopes is not counted twice
+    uint64_t cpuNanos = 0;   // Thread CPU time, also exclusive
+    perf::Values counters{}; // Hardware counters with --counters, also exclusive
+    alloc::PhaseTotals heap{}; // Heap use with alloc::enabled(), see alloc_stats.h
+};
+
+using Report = std::array<PhaseTotals, kPhaseCount>;
+
+// Off by default; when off, a Scope costs one relaxed load. Scopes also
+// feed --trace, which therefore turns this on too.
+extern std::atomic<bool> g_enabled;
+
+inline bool enabled() {
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+void enable(bool on);
+
+// Sum of every thread's totals so far
+Report collect();
+
+// One JSON object: elapsed time, calls/wall/CPU seconds per phase (plus
+// allocations when alloc::enabled()) and the memory peaks
+std::string reportJson(const Report& report, uint64_t elapsedNanos);
+
+// Time one phase on the current thread until the end of the enclosing block.
+//
+// Scopes nest: a Decode scope opened inside a Parse scope is charged to
+// Decode only, and the Parse scope's time (and hardware counts, when
+// perf::enabled()) excludes it; heap use is charged the same way when
+// alloc::enabled(). Totals go to
+// per-thread accumulators that only their owner writes, so there is no
+// contention between workers; collect() reads them from any thread.
+class Scope {
+public:
+    explicit Scope(Phase phase) {
+        if (enabled()) begin(phase);
+    }
+    ~Scope() {
+        if (m_active) end();
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    bool m_active = false;
+    Phase m_phase = Phase::Count;
+    Scope* m_parent = nullptr;
+    uint64_t m_wallStart = 0;
+    uint64_t m_cpuStart = 0;
+    uint64_t m_childWall = 0;
+    uint64_t m_childCpu = 0;
+    bool m_counting = false;
+    perf::Values m_counterStart{};
+    perf::Values m_childCounters{};
+    bool m_allocating = false;
+    alloc::ScopeState m_allocSaved{};
+
+    void begin(Phase phase);
+    void end();
+};
+
+} // namespace stats
+} // namespace tim2
@@ -0,0 +1,176 @@
+#include "reference_decoder.h"
+#include <cstring>
+
+namespace tim2 {
+namespace reference {
+
+namespace {
+
+// Byte offset of a mip level: the sum of the sizes of the levels before it
+size_t levelOffset(const Picture& pic, size_t mipLevel) {
+    if (!pic.mipMapHeader) return 0;
+
+    size_t offset = 0;
+    for (size_t i = 0; i < mipLevel && i < pic.mipMapHeader->sizes.size(); ++i) {
+        offset += pic.mipMapHeader->sizes[i];
+    }
+    return offset;
+}
+
+// Whether bytes [index, index + size) of a mip level are inside imageData
+bool hasBytes(const Picture& pic, size_t offset, size_t index, size_t size) {
+    return offset + index + size <= pic.imageData.size();
+}
+
+Color32 pixelColor(const Picture& pic, size_t x, size_t y, size_t mipLevel, const std::vector<Color32>& colors) {
+    const size_t offset = levelOffset(pic, mipLevel);
+    const size_t width  = pic.getMipMapWidth(mipLevel);
+    const size_t pixel  = y * width + x;
+    const uint8_t* data = pic.imageData.data() + offset;
+
+    Color32 result{};
+
+    switch (pic.header.getImagePixelFormat()) {
+        case TIM2_RGB32: {
+            const size_t idx = pixel * 4;
+            if (!hasBytes(pic, offset, idx, 4)) break;
+            result.r = data[idx + 0];
+            result.g = data[idx + 1];
+            result.b = data[idx + 2];
+            result.a = data[idx + 3];
+            break;
+        }
+        case TIM2_RGB24: {
+            // Packed 3 bytes per pixel, no padding between pixels
+            const size_t idx = pixel * 3;
+            if (!hasBytes(pic, offset, idx, 3)) break;
+            result.r = data[idx + 0];
+            result.g = data[idx + 1];
+            result.b = data[idx + 2];
+            result.a = 255;
+            break;
+        }
+        case TIM2_RGB16: {
+            const size_t idx = pixel * 2;
+            if (!hasBytes(pic, offset, idx, 2)) break;
+            uint16_t val;
+            std::memcpy(&val, &data[idx], sizeof(val));
+            result = Color16{val}.toColor32();
+            break;
+        }
+        case TIM2_IDTEX8: {
+            if (!pic.header.hasClut() || !hasBytes(pic, offset, pixel, 1)) break;
+            const uint8_t colorIdx = data[pixel];
+            if (colorIdx < colors.size()) {
+                result = colors[colorIdx];
+            }
+            break;
+        }
+        case TIM2_IDTEX4: {
+            if (!pic.header.hasClut() || !hasBytes(pic, offset, pixel / 2, 1)) break;
+            // Even pixel = low nibble, odd pixel = high nibble.
+            const uint8_t packed   = data[pixel / 2];
+            const uint8_t colorIdx = (pixel & 1) ? (packed >> 4) : (packed & 0x0F);
+            if (colorIdx < colors.size()) {
+                result = colors[colorIdx];
+            }
+            break;
+        }
+        default:
+            // Unknown / unsupported format: transparent black
+            break;
+    }
+
+    return result;
+}
+
+bool isIndexed(const Picture& pic) {
+    const PixelFormat format = pic.header.getImagePixelFormat();
+    return format == TIM2_IDTEX4 || format == TIM2_IDTEX8;
+}
+
+} // namespace
+
+/**
+ * Entry i is read from position i of clutData, except in CSM1 compound
+ * mode, where entries 8..15 and 16..23 of every 32-entry block trade places
+ * (TIM2 spec §4.5).
+ */
+std::vector<Color32> clutColors(const Picture& pic) {
+    std::vector<Color32> colors;
+    if (!pic.header.hasClut()) return colors;
+
+    const PixelFormat fmt = pic.header.getClutPixelFormat();
+    const bool compound = !pic.header.isClutCSM2() && pic.header.isClutCompound();
+    const uint8_t* data = pic.clutData.data();
+
+    for (size_t i = 0; i < pic.header.clutColors; ++i) {
+        size_t index = i;
+        if (compound) {
+            const size_t block = i / 32;
+            size_t localIdx = i % 32;
+            if (localIdx >= 8 && localIdx < 16) {
+                localIdx += 8;
+            } else if (localIdx >= 16 && localIdx < 24) {
+                localIdx -= 8;
+            }
+            index = block * 32 + localIdx;
+        }
+
+        Color32 color{};
+        switch (fmt) {
+            case TIM2_RGB16: {
+                if ((index + 1) * 2 > pic.clutData.size()) break;
+                uint16_t val;
+                std::memcpy(&val, &data[index * 2], sizeof(val));
+                color = Color16{val}.toColor32();
+                break;
+            }
+            case TIM2_RGB24: {
+                if ((index + 1) * 3 > pic.clutData.size()) break;
+                color = Color32(data[index * 3], data[index * 3 + 1], data[index * 3 + 2], 255);
+                break;
+            }
+            case TIM2_RGB32: {
+                if ((index + 1) * 4 > pic.clutData.size()) break;
+                color = Color32(data[index * 4], data[index * 4 + 1], data[index * 4 + 2], data[index * 4 + 3]);
+                break;
+            }
+            default:
+                // Unknown CLUT format: transparent black
+                break;
+        }
+        colors.push_back(color);
+    }
+
+    return colors;
+}
+
+/**
+ * Decodes the CLUT for this one pixel, as the original per-pixel decoder
+ * did; decodeImage() below shares one CLUT between all pixels instead.
+ */
+Color32 pixelColor(const Picture& pic, size_t x, size_t y, size_t mipLevel) {
+    const std::vector<Color32> colors = isIndexed(pic) ? clutColors(pic) : std::vector<Color32>{};
+    return pixelColor(pic, x, y, mipLevel, colors);
+}
+
+std::vector<Color32> decodeImage(const Picture& pic, size_t mipLevel) {
+    if (mipLevel >= pic.header.mipMapTextures) return {};
+
+    const size_t width  = pic.getMipMapWidth(mipLevel);
+    const size_t height = pic.getMipMapHeight(mipLevel);
+    const std::vector<Color32> colors = isIndexed(pic) ? clutColors(pic) : std::vector<Color32>{};
+
+    std::vector<Color32> pixels;
+    pixels.reserve(width * height);
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            pixels.push_back(pixelColor(pic, x, y, mipLevel, colors));
+        }
+    }
+    return pixels;
+}
+
+} // namespace reference
+} // namespace tim2
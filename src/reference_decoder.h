@@ -0,0 +1,29 @@
+#pragma once
+
+#include "tim2_parser.h"
+#include <vector>
+
+namespace tim2 {
+namespace reference {
+
+// The straightforward decoder that Picture's optimized paths must match.
+//
+// This is the original per-pixel logic, kept as ground truth rather than
+// for speed: every pixel is located from scratch and nothing is shared
+// between pixels except the CLUT. tim2conform runs the optimized kernels
+// (decodeImage, banded decodeRows, getClutColors) against it. Change the
+// decoding rules here first, then in the kernels.
+
+// CLUT entries in index order, with the CSM1 compound order resolved.
+// Entries whose bytes lie past clutData are default Color32.
+std::vector<Color32> clutColors(const Picture& pic);
+
+// Pixel (x, y) of a mip level. Pixels whose bytes lie past imageData
+// (truncated files), or whose index has no CLUT entry, are default Color32.
+Color32 pixelColor(const Picture& pic, size_t x, size_t y, size_t mipLevel = 0);
+
+// A whole mip level, pixel by pixel; empty if the level does not exist
+std::vector<Color32> decodeImage(const Picture& pic, size_t mipLevel = 0);
+
+} // namespace reference
+} // namespace tim2
@@ -0,0 +1,169 @@
+#include "server_protocol.h"
+#include "utils.h"
+#include <cstring>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace tim2 {
+namespace protocol {
+
+namespace {
+
+void putU32(uint8_t* out, uint32_t value) {
+    value = utils::fromLittleEndian(value);
+    std::memcpy(out, &value, sizeof(value));
+}
+
+uint32_t getU32(const uint8_t* in) {
+    uint32_t value;
+    std::memcpy(&value, in, sizeof(value));
+    return utils::fromLittleEndian(value);
+}
+
+#ifndef _WIN32
+bool readExact(int fd, uint8_t* data, size_t size) {
+    while (size > 0) {
+        const ssize_t count = read(fd, data, size);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return false;
+        data += count;
+        size -= static_cast<size_t>(count);
+    }
+    return true;
+}
+#endif
+
+} // namespace
+
+Response Response::error(const std::string& message) {
+    Response response;
+    response.status = Status::Error;
+    response.kind = Kind::Text;
+    response.body.assign(message.begin(), message.end());
+    return response;
+}
+
+#ifndef _WIN32
+
+bool readFrame(int fd, std::vector<uint8_t>& payload) {
+    uint8_t length[4];
+    if (!readExact(fd, length, sizeof(length))) return false;
+
+    const uint32_t size = getU32(length);
+    if (size > kMaxFrameSize) return false;
+
+    payload.resize(size);
+    return readExact(fd, payload.data(), size);
+}
+
+/**
+ * Write length, header and body with writev(), so a large encoded image is
+ * not copied into one buffer first. Partial writes are continued.
+ */
+bool writeFrame(int fd, const uint8_t* header, size_t headerSize, const uint8_t* body, size_t bodySize) {
+    const size_t total = headerSize + bodySize;
+    if (total > kMaxFrameSize) return false;
+
+    uint8_t length[4];
+    putU32(length, static_cast<uint32_t>(total));
+
+    iovec parts[3] = {
+        {length, sizeof(length)},
+        {const_cast<uint8_t*>(header), headerSize},
+        {const_cast<uint8_t*>(body), bodySize},
+    };
+    iovec* next = parts;
+    int remaining = 3;
+
+    while (remaining > 0) {
+        const ssize_t count = writev(fd, next, remaining);
+        if (count < 0 && errno == EINTR) continue;
+        if (count < 0) return false;
+
+        size_t written = static_cast<size_t>(count);
+        while (remaining > 0 && written >= next->iov_len) {
+            written -= next->iov_len;
+            ++next;
+            --remaining;
+        }
+        if (remaining > 0) {
+            next->iov_base = static_cast<uint8_t*>(next->iov_base) + written;
+            next->iov_len -= written;
+        }
+    }
+    return true;
+}
+
+#else
+
+bool readFrame(int, std::vector<uint8_t>&) {
+    return false;
+}
+
+bool writeFrame(int, const uint8_t*, size_t, const uint8_t*, size_t) {
+    return false;
+}
+
+#endif
+
+bool sendRequest(int fd, const Request& request) {
+    uint8_t header[kRequestHeaderSize] = {};
+    header[0] = static_cast<uint8_t>(request.op);
+    header[1] = static_cast<uint8_t>(request.source);
+    header[2] = static_cast<uint8_t>(request.format);
+    putU32(header + 4, request.picture);
+    putU32(header + 8, request.mip);
+    return writeFrame(fd, header, sizeof(header), request.data.data(), request.data.size());
+}
+
+/**
+ * Read one request. A frame that arrives intact but does not decode sets
+ * malformed and still returns true, so the server can answer with an error
+ * instead of dropping the connection.
+ */
+bool receiveRequest(int fd, Request& request, bool& malformed) {
+    std::vector<uint8_t> payload;
+    if (!readFrame(fd, payload)) return false;
+
+    malformed = payload.size() < kRequestHeaderSize;
+    if (malformed) return true;
+
+    const uint8_t op = payload[0], source = payload[1], format = payload[2];
+    malformed = op < 1 || op > 2 || source > 1 || format > 1;
+    if (malformed) return true;
+
+    request.op = static_cast<Op>(op);
+    request.source = static_cast<Source>(source);
+    request.format = static_cast<Format>(format);
+    request.picture = getU32(payload.data() + 4);
+    request.mip = getU32(payload.data() + 8);
+    payload.erase(payload.begin(), payload.begin() + kRequestHeaderSize);
+    request.data = std::move(payload);
+    return true;
+}
+
+bool sendResponse(int fd, const Response& response) {
+    uint8_t header[kResponseHeaderSize] = {};
+    header[0] = static_cast<uint8_t>(response.status);
+    header[1] = static_cast<uint8_t>(response.kind);
+    return writeFrame(fd, header, sizeof(header), response.body.data(), response.body.size());
+}
+
+bool receiveResponse(int fd, Response& response) {
+    std::vector<uint8_t> payload;
+    if (!readFrame(fd, payload) || payload.size() < kResponseHeaderSize) return false;
+
+    response.status = static_cast<Status>(payload[0]);
+    response.kind = static_cast<Kind>(payload[1]);
+    payload.erase(payload.begin(), payload.begin() + kResponseHeaderSize);
+    response.body = std::move(payload);
+    return true;
+}
+
+} // namespace protocol
+} // namespace tim2
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace tim2 {
+namespace protocol {
+
+// Wire format shared by `serve` and `client`.
+//
+// Every message is a frame: a little-endian uint32 payload length followed by
+// the payload. A connection carries any number of request/response pairs, in
+// order.
+//
+//   Request payload:  op u8 | source u8 | format u8 | 0 u8 | picture u32 | mip u32 | data
+//   Response payload: status u8 | kind u8 | 0 u16 | body
+//
+// data is a path (resolved by the server) or the TIM2 file itself. body is
+// JSON for info, the encoded image for export, or an error message.
+
+constexpr uint32_t kMaxFrameSize = 512u << 20;
+constexpr size_t kRequestHeaderSize = 12;
+constexpr size_t kResponseHeaderSize = 4;
+
+enum class Op : uint8_t { Info = 1, Export = 2 };
+enum class Source : uint8_t { Path = 0, Inline = 1 };
+enum class Format : uint8_t { BMP = 0, PNG = 1 };
+enum class Status : uint8_t { Ok = 0, Error = 1 };
+enum class Kind : uint8_t { Json = 0, Image = 1, Text = 2 };
+
+struct Request {
+    Op op = Op::Info;
+    Source source = Source::Path;
+    Format format = Format::BMP;
+    uint32_t picture = 0;
+    uint32_t mip = 0;
+    std::vector<uint8_t> data;
+};
+
+struct Response {
+    Status status = Status::Ok;
+    Kind kind = Kind::Text;
+    std::vector<uint8_t> body;
+
+    static Response error(const std::string& message);
+};
+
+// Blocking frame I/O on a connected socket; false on EOF, error or oversize frame
+bool readFrame(int fd, std::vector<uint8_t>& payload);
+bool writeFrame(int fd, const uint8_t* header, size_t headerSize, const uint8_t* body, size_t bodySize);
+
+bool sendRequest(int fd, const Request& request);
+bool receiveRequest(int fd, Request& request, bool& malformed);
+bool sendResponse(int fd, const Response& response);
+bool receiveResponse(int fd, Response& response);
+
+} // namespace protocol
+} // namespace tim2
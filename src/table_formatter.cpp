@@ -1,5 +1,6 @@
 #include "table_formatter.h"
 #include <vector>
+#include <algorithm>
 
 namespace tim2 {
 
@@ -151,6 +152,222 @@ void TableFormatter::displaySummary(const TIM2Parser& parser) {
     printSeparator(60);
 }
 
+void TableFormatter::displayBatchPlan(const std::vector<PlannedFile>& files, size_t threads, bool listAll) {
+    printHeader("BATCH PLAN");
+
+    size_t unreadable = 0;
+    size_t pictures = 0;
+    size_t exports = 0;
+    uint64_t inputBytes = 0;
+    uint64_t pixels = 0;
+    uint64_t readCost = 0;
+    uint64_t decodeCost = 0;
+    uint64_t encodeCost = 0;
+    uint64_t largestTask = 0;
+
+    for (const auto& file : files) {
+        if (!file.headersValid) unreadable++;
+        pictures += file.pictureCount;
+        exports += file.exports.size();
+        inputBytes += file.fileSize;
+        readCost += file.readCost;
+        for (const auto& e : file.exports) {
+            pixels += static_cast<uint64_t>(e.width) * e.height;
+            decodeCost += e.decodeCost;
+            encodeCost += e.encodeCost;
+            largestTask = std::max(largestTask, e.cost());
+        }
+    }
+
+    printRow("Files", std::to_string(files.size()));
+    if (unreadable > 0) {
+        printRow("Unreadable Headers", std::to_string(unreadable));
+    }
+    printRow("Pictures", std::to_string(pictures));
+    printRow("Exports (picture x mip)", std::to_string(exports));
+    printRow("Input Size", formatSize(inputBytes));
+    printRow("Output Pixels", std::to_string(pixels));
+    printRow("Estimated Read", formatDuration(readCost));
+    printRow("Estimated Decode", formatDuration(decodeCost));
+    printRow("Estimated Encode", formatDuration(encodeCost));
+    printRow("Estimated Total Work", formatDuration(readCost + decodeCost + encodeCost));
+    printRow("Largest Single Export", formatDuration(largestTask));
+    uint64_t peakMemory = 0;
+    for (const auto& file : files) {
+        peakMemory = std::max(peakMemory, file.peakMemory);
+    }
+    printRow("Largest File Memory", formatSize(static_cast<size_t>(peakMemory)));
+    printRow("Workers", std::to_string(threads));
+    printRow("Estimated Makespan (LPT)", formatDuration(BatchPlanner::estimateMakespan(files, threads)));
+    printSeparator(60);
+
+    // Dispatch order, largest first
+    const auto order = BatchPlanner::largestFirst(files);
+    const size_t shown = listAll ? order.size() : std::min<size_t>(order.size(), 10);
+
+    std::cout << "Dispatch order (largest first):\n";
+    for (size_t i = 0; i < shown; ++i) {
+        const auto& file = files[order[i]];
+        std::cout << "  " << std::right << std::setw(12) << formatDuration(file.cost())
+                  << std::left << "  " << file.path.string() << "\n";
+    }
+    if (shown < order.size()) {
+        std::cout << "  ... " << (order.size() - shown) << " more (use -v to list all)\n";
+    }
+
+    printSeparator(60);
+}
+
+/**
+ * Per-phase time table for --stats. Wall times are summed over all threads,
+ * so in a parallel batch they can add up to more than the elapsed time; the
+ * share column compares phases with each other, and CPU/wall shows how much
+ * of a phase was spent waiting (mostly I/O).
+ */
+void TableFormatter::displayPhaseStats(const stats::Report& report, uint64_t elapsedNanos) {
+    printHeader("PHASE STATISTICS");
+
+    uint64_t totalWall = 0;
+    uint64_t totalCpu = 0;
+    for (const auto& phase : report) {
+        totalWall += phase.wallNanos;
+        totalCpu += phase.cpuNanos;
+    }
+
+    auto printLine = [](const std::string& name, const std::string& calls, const std::string& wall,
+                        const std::string& cpu, const std::string& busy, const std::string& share) {
+        std::cout << std::left << std::setw(14) << name << std::right << std::setw(9) << calls
+                  << std::setw(12) << wall << std::setw(12) << cpu << std::setw(7) << busy
+                  << std::setw(7) << share << "\n";
+    };
+    auto percent = [](uint64_t part, uint64_t whole) {
+        if (whole == 0) return std::string("-");
+        std::ostringstream ss;
+        ss << std::fixed << std::setprecision(1) << 100.0 * part / whole << "%";
+        return ss.str();
+    };
+
+    printLine("Phase", "Calls", "Wall", "CPU", "CPU%", "Share");
+    printSeparator(61);
+    for (size_t p = 0; p < report.size(); ++p) {
+        const auto& phase = report[p];
+        if (phase.calls == 0) continue;
+        printLine(stats::phaseName(static_cast<stats::Phase>(p)), std::to_string(phase.calls),
+                  formatDuration(phase.wallNanos), formatDuration(phase.cpuNanos),
+                  percent(phase.cpuNanos, phase.wallNanos), percent(phase.wallNanos, totalWall));
+    }
+    printSeparator(61);
+    printLine("Total", "", formatDuration(totalWall), formatDuration(totalCpu), percent(totalCpu, totalWall), "");
+    printRow("Elapsed", formatDuration(elapsedNanos));
+    printSeparator(60);
+}
+
+/**
+ * Hardware counters for --counters: per phase (exclusive, like the times),
+ * then pixel decode per format with cycles per pixel. Counters the CPU does
+ * not provide show as "-"; decodes of unknown formats are listed as Other.
+ */
+void TableFormatter::displayCounterStats(const stats::Report& report, const perf::FormatReport& formats) {
+    using perf::Counter;
+    auto count = [](Counter counter, uint64_t value) {
+        return perf::available(counter) ? formatCount(static_cast<double>(value)) : std::string("-");
+    };
+    auto ratio = [](Counter a, Counter b, double numerator, double denominator, double scale) {
+        if (!perf::available(a) || (b != Counter::Count && !perf::available(b)) || denominator <= 0) {
+            return std::string("-");
+        }
+        std::ostringstream ss;
+        ss << std::fixed << std::setprecision(2) << numerator * scale / denominator;
+        return ss.str();
+    };
+    auto printLine = [](const std::string& name, const std::string& a, const std::string& b, const std::string& c,
+                        const std::string& d, const std::string& e) {
+        std::cout << std::left << std::setw(14) << name << std::right << std::setw(10) << a << std::setw(10) << b
+                  << std::setw(8) << c << std::setw(12) << d << std::setw(10) << e << "\n";
+    };
+
+    printHeader("HARDWARE COUNTERS");
+    printLine("Phase", "Cycles", "Instr", "IPC", "Cache miss", "Br. miss");
+    printSeparator(64);
+    for (size_t p = 0; p < report.size(); ++p) {
+        const auto& v = report[p].counters;
+        if (report[p].calls == 0) continue;
+        printLine(stats::phaseName(static_cast<stats::Phase>(p)),
+                  count(Counter::Cycles, v[0]), count(Counter::Instructions, v[1]),
+                  ratio(Counter::Instructions, Counter::Cycles, v[1], v[0], 1),
+                  count(Counter::CacheMisses, v[2]), count(Counter::BranchMisses, v[3]));
+    }
+    printSeparator(64);
+
+    std::cout << "Pixel decode by format (per pixel; misses per 1000 pixels):\n";
+    printLine("Format", "Pixels", "Cycles", "IPC", "Cache miss", "Br. miss");
+    printSeparator(64);
+    for (size_t f = 0; f < formats.size(); ++f) {
+        const auto& format = formats[f];
+        if (format.calls == 0) continue;
+        const auto& v = format.counters;
+        const double pixels = static_cast<double>(format.pixels);
+        const std::string name = f == perf::kOtherFormat ? std::string("Other")
+                                                         : pixelFormatToString(static_cast<PixelFormat>(f));
+        printLine(name.substr(0, name.find(' ')), formatCount(pixels),
+                  ratio(Counter::Cycles, Counter::Count, v[0], pixels, 1),
+                  ratio(Counter::Instructions, Counter::Cycles, v[1], v[0], 1),
+                  ratio(Counter::CacheMisses, Counter::Count, v[2], pixels, 1000),
+                  ratio(Counter::BranchMisses, Counter::Count, v[3], pixels, 1000));
+    }
+    printSeparator(64);
+    if (perf::multiplexed()) {
+        std::cout << "Note: the counters were multiplexed with other events; counts are scaled estimates\n";
+    }
+}
+
+/**
+ * Heap use for --stats: allocations and bytes per phase (exclusive, like
+ * the times) and the largest live heap growth of one scope of the phase,
+ * then the process-wide heap and RSS peaks. Blocks freed on another thread
+ * than the one that allocated them make the per-phase peaks approximate.
+ * Without the operator new hook only the peak RSS is known.
+ */
+void TableFormatter::displayMemoryStats(const stats::Report& report) {
+    auto printLine = [](const std::string& name, const std::string& allocs, const std::string& bytes,
+                        const std::string& average, const std::string& peak) {
+        std::cout << std::left << std::setw(14) << name << std::right << std::setw(10) << allocs
+                  << std::setw(12) << bytes << std::setw(12) << average << std::setw(13) << peak << "\n";
+    };
+    auto average = [](uint64_t bytes, uint64_t allocations) {
+        return allocations == 0 ? std::string("-") : formatBytes(bytes / allocations);
+    };
+
+    printHeader("MEMORY");
+    if (alloc::enabled()) {
+        printLine("Phase", "Allocs", "Bytes", "Avg", "Peak live");
+        printSeparator(61);
+        uint64_t allocations = 0;
+        uint64_t bytes = 0;
+        for (size_t p = 0; p < report.size(); ++p) {
+            const auto& heap = report[p].heap;
+            allocations += heap.allocations;
+            bytes += heap.bytes;
+            if (report[p].calls == 0) continue;
+            printLine(stats::phaseName(static_cast<stats::Phase>(p)),
+                      formatCount(static_cast<double>(heap.allocations)), formatBytes(heap.bytes),
+                      average(heap.bytes, heap.allocations), formatBytes(heap.peakLiveBytes));
+        }
+        const alloc::PhaseTotals outside = alloc::collect()[alloc::kOutside];
+        printLine("Other", formatCount(static_cast<double>(outside.allocations)), formatBytes(outside.bytes),
+                  average(outside.bytes, outside.allocations), "-");
+        printSeparator(61);
+        allocations += outside.allocations;
+        bytes += outside.bytes;
+        printLine("Total", formatCount(static_cast<double>(allocations)), formatBytes(bytes),
+                  average(bytes, allocations), "");
+        printRow("Heap peak", formatSize(alloc::heapPeakBytes()));
+    }
+    const uint64_t rss = alloc::peakRssBytes();
+    printRow("Peak RSS", rss ? formatSize(rss) : std::string("-"));
+    printSeparator(60);
+}
+
 void TableFormatter::printSeparator(size_t width) {
     std::cout << std::string(width, '-') << "\n";
 }
@@ -191,4 +408,47 @@ std::string TableFormatter::formatSize(size_t bytes) {
     return ss.str();
 }
 
+std::string TableFormatter::formatBytes(uint64_t bytes) {
+    std::ostringstream ss;
+    if (bytes >= 1024ULL * 1024 * 1024) {
+        ss << std::fixed << std::setprecision(2) << bytes / (1024.0 * 1024.0 * 1024.0) << " GB";
+    } else if (bytes >= 1024 * 1024) {
+        ss << std::fixed << std::setprecision(1) << bytes / (1024.0 * 1024.0) << " MB";
+    } else if (bytes >= 1024) {
+        ss << std::fixed << std::setprecision(1) << bytes / 1024.0 << " KB";
+    } else {
+        ss << bytes << " B";
+    }
+    return ss.str();
+}
+
+std::string TableFormatter::formatDuration(uint64_t nanoseconds) {
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(2);
+
+    if (nanoseconds >= 1000000000ULL) {
+        ss << (double)nanoseconds / 1e9 << " s";
+    } else if (nanoseconds >= 1000000ULL) {
+        ss << (double)nanoseconds / 1e6 << " ms";
+    } else {
+        ss << (double)nanoseconds / 1e3 << " us";
+    }
+
+    return ss.str();
+}
+
+// Large counts with a K/M/G suffix (powers of 1000)
+std::string TableFormatter::formatCount(double count) {
+    static constexpr const char* kSuffixes[] = {"", "K", "M", "G", "T"};
+    size_t suffix = 0;
+    while (count >= 1000 && suffix + 1 < std::size(kSuffixes)) {
+        count /= 1000;
+        suffix++;
+    }
+
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(suffix == 0 ? 0 : 2) << count << kSuffixes[suffix];
+    return ss.str();
+}
+
 } // namespace tim2
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include "tim2_types.h"
 #include "tim2_parser.h"
+#include "batch_planner.h"
+#include "phase_stats.h"
 #include <iostream>
 #include <iomanip>
 #include <sstream>
@@ -19,6 +21,10 @@ namespace tim2 {
         static void displayExtendedHeader(const ExtendedHeader& header);
         static void displayGsRegisters(const PictureHeader& header);
         static void displaySummary(const TIM2Parser& parser);
+        static void displayBatchPlan(const std::vector<PlannedFile>& files, size_t threads, bool listAll);
+        static void displayPhaseStats(const stats::Report& report, uint64_t elapsedNanos);
+        static void displayCounterStats(const stats::Report& report, const perf::FormatReport& formats);
+        static void displayMemoryStats(const stats::Report& report);
 
     private:
         static void printSeparator(size_t width);
@@ -26,6 +32,9 @@ namespace tim2 {
         static void printHeader(const std::string& title);
         static std::string formatHex(uint64_t value, int width = 0);
         static std::string formatSize(size_t bytes);
+        static std::string formatDuration(uint64_t nanoseconds);
+        static std::string formatCount(double count);
+        static std::string formatBytes(uint64_t bytes);
     };
 
 } // namespace tim2
\ No newline at end of file
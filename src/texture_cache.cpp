@@ -0,0 +1,147 @@
+#include "texture_cache.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+
+#ifndef TIM2DUMP_VERSION
+#define TIM2DUMP_VERSION "unknown"
+#endif
+
+namespace fs = std::filesystem;
+
+namespace tim2 {
+
+namespace {
+
+constexpr const char* kTempSuffix = ".tmp";
+
+// Temp files older than this are leftovers from a crashed process
+constexpr auto kStaleTempAge = std::chrono::hours(1);
+
+} // namespace
+
+TextureCache::TextureCache(fs::path dir, uintmax_t maxBytes)
+    : m_dir(std::move(dir)),
+      m_root(m_dir / (std::string("v1-") + TIM2DUMP_VERSION)),
+      m_maxBytes(maxBytes) {
+    std::random_device random;
+    char tag[32];
+    std::snprintf(tag, sizeof(tag), "%08x%08x", random(), random());
+    m_tempTag = tag;
+}
+
+fs::path TextureCache::entryPath(uint64_t key, const std::string& format) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+    return m_root / std::string(name, 2) / (std::string(name) + "." + format);
+}
+
+bool TextureCache::lookup(uint64_t key, const std::string& format, std::vector<uint8_t>& bytes) {
+    const fs::path path = entryPath(key, format);
+
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        m_misses++;
+        return false;
+    }
+
+    const std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    bytes.resize(static_cast<size_t>(std::max<std::streamsize>(0, size)));
+    if (size <= 0 || !file.read(reinterpret_cast<char*>(bytes.data()), size)) {
+        bytes.clear();
+        m_misses++;
+        return false;
+    }
+
+    // LRU: a hit makes the entry the newest
+    std::error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+
+    m_hits++;
+    return true;
+}
+
+/**
+ * Write to "<entry>.<tag>-<n>.tmp" and rename it over the entry. rename() is
+ * atomic, so readers in other processes see either no entry or a whole one;
+ * two processes storing the same key simply replace each other's identical
+ * bytes.
+ */
+void TextureCache::store(uint64_t key, const std::string& format, const std::vector<uint8_t>& bytes) {
+    const fs::path path = entryPath(key, format);
+    const fs::path temp = path.string() + "." + m_tempTag + "-" +
+                          std::to_string(m_tempCounter.fetch_add(1)) + kTempSuffix;
+
+    std::error_code ec;
+    fs::create_directories(path.parent_path(), ec);
+
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        if (!file) return;
+        file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        if (!file.good()) {
+            file.close();
+            fs::remove(temp, ec);
+            return;
+        }
+    }
+
+    fs::rename(temp, path, ec);
+    if (ec) {
+        fs::remove(temp, ec);
+    }
+}
+
+/**
+ * One pass over the cache: collect entries with size and mtime, drop stale
+ * temp files, and if the total is over the limit delete oldest-first down to
+ * 90% of it, leaving some headroom before the next eviction is needed.
+ */
+void TextureCache::evict() {
+    struct Item {
+        fs::path path;
+        uintmax_t size;
+        fs::file_time_type mtime;
+    };
+
+    std::vector<Item> items;
+    uintmax_t total = 0;
+    const auto now = fs::file_time_type::clock::now();
+
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(m_dir, ec), end; !ec && it != end; it.increment(ec)) {
+        std::error_code entryEc;
+        if (!it->is_regular_file(entryEc)) continue;
+
+        const auto mtime = it->last_write_time(entryEc);
+        if (entryEc) continue;
+
+        if (it->path().extension() == kTempSuffix) {
+            if (now - mtime > kStaleTempAge) fs::remove(it->path(), entryEc);
+            continue;
+        }
+
+        const uintmax_t size = it->file_size(entryEc);
+        if (entryEc) continue;
+
+        items.push_back({it->path(), size, mtime});
+        total += size;
+    }
+
+    if (total <= m_maxBytes) return;
+
+    std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) { return a.mtime < b.mtime; });
+
+    const uintmax_t target = m_maxBytes / 10 * 9;
+    for (const auto& item : items) {
+        if (total <= target) break;
+        if (fs::remove(item.path, ec)) {
+            total -= item.size;
+        }
+    }
+}
+
+} // namespace tim2
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace tim2 {
+
+// Persistent cache of encoded exports, shared by batch runs and processes.
+//
+// Entries are the exact BMP/PNG bytes of one picture/mip level, stored as
+// "<dir>/v1-<version>/<xx>/<key>.<fmt>" under the export's content key (see
+// Picture::contentHash()). The tool version keeps a build whose decoders or
+// encoders changed from serving older output; entries of other versions are
+// never hit and age out through evict(). Writes go to a temp file that is
+// renamed into place, so concurrent processes only ever see whole entries.
+// Hits refresh the entry's mtime, and evict() removes the least recently used
+// entries until the cache fits its size limit.
+class TextureCache {
+public:
+    TextureCache(std::filesystem::path dir, uintmax_t maxBytes);
+
+    // Load an entry; false on a miss
+    bool lookup(uint64_t key, const std::string& format, std::vector<uint8_t>& bytes);
+
+    // Add an entry (best effort: failures only cost a future miss)
+    void store(uint64_t key, const std::string& format, const std::vector<uint8_t>& bytes);
+
+    // Trim to the size limit, oldest mtime first. Also removes stale temp files.
+    void evict();
+
+    size_t hits() const { return m_hits; }
+    size_t misses() const { return m_misses; }
+
+private:
+    std::filesystem::path m_dir;   // All versions, for evict()
+    std::filesystem::path m_root;  // This version's entries
+    uintmax_t m_maxBytes;
+    std::string m_tempTag;  // Unique per process, for temp file names
+    std::atomic<size_t> m_tempCounter{0};
+    std::atomic<size_t> m_hits{0};
+    std::atomic<size_t> m_misses{0};
+
+    std::filesystem::path entryPath(uint64_t key, const std::string& format) const;
+};
+
+} // namespace tim2
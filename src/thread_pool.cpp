@@ -0,0 +1,142 @@
+#include "thread_pool.h"
+#include "trace_recorder.h"
+#include <exception>
+#include <iostream>
+
+namespace tim2 {
+
+namespace {
+// Identifies the pool and deque of the current worker thread (if any)
+thread_local const ThreadPool* t_currentPool = nullptr;
+thread_local size_t t_workerIndex = 0;
+}
+
+ThreadPool::ThreadPool(size_t threadCount, std::string name)
+    : m_name(std::move(name)) {
+    if (threadCount == 0) threadCount = 1;
+
+    m_localQueues.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        m_localQueues.push_back(std::make_unique<TaskQueue>());
+    }
+
+    m_workers.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        m_workers.emplace_back([this, i] { workerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stopping = true;
+    }
+    m_taskAvailable.notify_all();
+
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    m_pendingTasks.fetch_add(1);
+
+    TaskQueue& queue = (t_currentPool == this) ? *m_localQueues[t_workerIndex] : m_injectionQueue;
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    m_queuedTasks.fetch_add(1);
+
+    // Taking the sleep mutex orders this wake-up after any worker's
+    // "nothing queued" check, so the notification cannot be lost.
+    { std::lock_guard<std::mutex> lock(m_sleepMutex); }
+    m_taskAvailable.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(m_sleepMutex);
+    m_idle.wait(lock, [this] { return m_pendingTasks.load() == 0; });
+}
+
+size_t ThreadPool::defaultThreadCount() {
+    const unsigned int hw = std::thread::hardware_concurrency();
+    return hw > 0 ? hw : 1;
+}
+
+/**
+ * Find the next task for worker `index`:
+ *   1) newest task in its own deque (LIFO)
+ *   2) oldest task in the injection queue (FIFO)
+ *   3) oldest task in another worker's deque (steal)
+ */
+bool ThreadPool::tryPop(size_t index, std::function<void()>& task) {
+    auto popFront = [&task](TaskQueue& queue) {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) return false;
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        return true;
+    };
+
+    bool found = false;
+    {
+        TaskQueue& own = *m_localQueues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            found = true;
+        }
+    }
+
+    if (!found) {
+        found = popFront(m_injectionQueue);
+    }
+
+    for (size_t i = 1; !found && i < m_localQueues.size(); ++i) {
+        found = popFront(*m_localQueues[(index + i) % m_localQueues.size()]);
+    }
+
+    if (found) {
+        m_queuedTasks.fetch_sub(1);
+    }
+    return found;
+}
+
+/**
+ * Worker body: run tasks until the pool is being destroyed and nothing is
+ * queued. Tasks are expected to catch and report their own errors; one that
+ * still escapes is logged rather than taking the whole pool down.
+ */
+void ThreadPool::workerLoop(size_t index) {
+    t_currentPool = this;
+    t_workerIndex = index;
+    trace::setThreadName(m_name + " " + std::to_string(index));
+
+    for (;;) {
+        std::function<void()> task;
+        if (tryPop(index, task)) {
+            try {
+                task();
+            } catch (const std::exception& e) {
+                std::cerr << "Error: unhandled exception in " << m_name << " task: " << e.what() << std::endl;
+            } catch (...) {
+                std::cerr << "Error: unhandled exception in " << m_name << " task" << std::endl;
+            }
+            task = nullptr;
+
+            if (m_pendingTasks.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(m_sleepMutex);
+                m_idle.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_taskAvailable.wait(lock, [this] { return m_stopping || m_queuedTasks.load() > 0; });
+        if (m_stopping && m_queuedTasks.load() == 0) return;
+    }
+}
+
+} // namespace tim2
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace tim2 {
+
+// Work-stealing worker pool used by batch processing.
+//
+// Each worker owns a deque. Tasks submitted from inside a worker go to the
+// back of that worker's deque and are popped LIFO by their owner, so a task
+// that fans out keeps its children cache-warm. Tasks submitted from outside
+// the pool go to a shared FIFO injection queue. An idle worker takes from its
+// own deque, then the injection queue, then steals from the front of the
+// other workers' deques.
+class ThreadPool {
+public:
+    // name labels the workers in --trace output ("worker 0", ...)
+    explicit ThreadPool(size_t threadCount, std::string name = "worker");
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Queue a task; may be called from worker threads
+    void submit(std::function<void()> task);
+
+    // Block until every submitted task (including ones spawned by tasks) has finished
+    void wait();
+
+    // Number of worker threads
+    size_t size() const { return m_workers.size(); }
+
+    // Hardware concurrency, never less than 1
+    static size_t defaultThreadCount();
+
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<TaskQueue>> m_localQueues;
+    TaskQueue m_injectionQueue;
+    std::vector<std::thread> m_workers;
+    std::string m_name;
+
+    std::mutex m_sleepMutex;
+    std::condition_variable m_taskAvailable;
+    std::condition_variable m_idle;
+    std::atomic<size_t> m_queuedTasks{0};   // Sitting in some queue
+    std::atomic<size_t> m_pendingTasks{0};  // Submitted and not yet finished
+    bool m_stopping = false;
+
+    void workerLoop(size_t index);
+    bool tryPop(size_t index, std::function<void()>& task);
+};
+
+} // namespace tim2
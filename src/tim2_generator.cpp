@@ -0,0 +1,308 @@
+#include "tim2_generator.h"
+#include "tim2_writer.h"
+#include <algorithm>
+
+namespace tim2 {
+
+namespace {
+
+constexpr size_t kMaxMipLevels = 7;          // GS limit (LV0..LV6)
+constexpr size_t kMaxUserDataSize = 16384;   // headerSize is 16-bit
+
+// splitmix64 finalizer: a well-mixed hash of one 64-bit value
+uint64_t mix(uint64_t value) {
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+size_t bytesForPixels(PixelFormat format, size_t pixels) {
+    return (getBitsPerPixel(format) * pixels + 7) / 8;
+}
+
+size_t log2Ceil(size_t value) {
+    size_t bits = 0;
+    while ((size_t(1) << bits) < value) bits++;
+    return bits;
+}
+
+// GS pixel storage mode codes (TEX0.PSM / CPSM)
+uint64_t gsPsm(PixelFormat format) {
+    switch (format) {
+        case TIM2_RGB32:  return 0x00;  // PSMCT32
+        case TIM2_RGB24:  return 0x01;  // PSMCT24
+        case TIM2_RGB16:  return 0x02;  // PSMCT16
+        case TIM2_IDTEX8: return 0x13;  // PSMT8
+        case TIM2_IDTEX4: return 0x14;  // PSMT4
+        default:          return 0x00;
+    }
+}
+
+// RGBA to the 5:5:5:1 layout Color16 decodes
+uint16_t packRGB16(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    return static_cast<uint16_t>((r >> 3) | ((g >> 3) << 5) | ((b >> 3) << 10) | (a ? 0x8000 : 0));
+}
+
+void storeColor(PixelFormat format, uint8_t r, uint8_t g, uint8_t b, uint8_t a, uint8_t* out) {
+    switch (format) {
+        case TIM2_RGB32:
+            out[0] = r; out[1] = g; out[2] = b; out[3] = a;
+            break;
+        case TIM2_RGB24:
+            out[0] = r; out[1] = g; out[2] = b;
+            break;
+        case TIM2_RGB16: {
+            const uint16_t value = packRGB16(r, g, b, a);
+            std::memcpy(out, &value, sizeof(value));
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+uint8_t clampByte(int value) {
+    return static_cast<uint8_t>(std::clamp(value, 0, 255));
+}
+
+} // namespace
+
+TIM2Generator::TIM2Generator(uint64_t seed)
+    : m_state(mix(seed)) {
+}
+
+uint64_t TIM2Generator::next() {
+    m_state += 0x9E3779B97F4A7C15ull;
+    return mix(m_state);
+}
+
+size_t TIM2Generator::below(size_t bound) {
+    return bound > 0 ? static_cast<size_t>(next() % bound) : 0;
+}
+
+bool TIM2Generator::chance(double probability) {
+    return static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0) < probability;
+}
+
+size_t TIM2Generator::pickWeighted(const std::vector<double>& weights) {
+    double total = 0;
+    for (double weight : weights) total += weight;
+
+    double point = static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0) * total;
+    for (size_t i = 0; i < weights.size(); ++i) {
+        if (point < weights[i]) return i;
+        point -= weights[i];
+    }
+    return weights.size() - 1;
+}
+
+/**
+ * Draw a file layout. The weights approximate what texture archives from
+ * PS2 games contain: indexed pictures dominate, CLUTs are nearly always
+ * 32-bit and CSM1, sides are powers of two between 16 and 512 (sometimes
+ * trimmed to a non-power-of-two), and mip chains, multiple pictures and
+ * user data each show up in a minority of files.
+ */
+GeneratedFile TIM2Generator::randomFile(const CorpusParams& params) {
+    GeneratedFile file;
+    file.formatId = params.formatId.value_or(chance(0.7) ? TIM2_ALIGN_128 : TIM2_ALIGN_16);
+
+    static const std::vector<uint16_t> pictureCounts = {1, 2, 3, 4, 6, 8};
+    const uint16_t pictures = params.pictures.value_or(pictureCounts[pickWeighted({85, 6, 3, 2, 2, 2})]);
+
+    static const std::vector<PixelFormat> imageFormats = {TIM2_RGB16, TIM2_RGB24, TIM2_RGB32,
+                                                          TIM2_IDTEX4, TIM2_IDTEX8};
+    static const std::vector<PixelFormat> clutFormats = {TIM2_RGB16, TIM2_RGB24, TIM2_RGB32};
+    static const std::vector<uint16_t> sides = {16, 32, 64, 128, 256, 512};
+    static const std::vector<double> sideWeights = {5, 15, 20, 25, 25, 10};
+
+    auto randomSide = [this]() {
+        uint16_t side = sides[pickWeighted(sideWeights)];
+        if (chance(0.08)) side = static_cast<uint16_t>(side - 2 * below(side / 4));
+        return side;
+    };
+
+    for (uint16_t i = 0; i < pictures; ++i) {
+        GeneratedPicture pic;
+        pic.imageFormat = params.imageFormat.value_or(imageFormats[pickWeighted({7, 3, 15, 30, 45})]);
+        pic.clutFormat = params.clutFormat.value_or(clutFormats[pickWeighted({14, 1, 85})]);
+        pic.clutMode = params.clutMode.value_or(chance(0.05) ? CLUT_CSM2 : CLUT_CSM1);
+        pic.compound = params.compound.value_or(chance(0.5));
+        pic.width = params.width.value_or(randomSide());
+        pic.height = params.height.value_or(chance(0.6) ? pic.width : randomSide());
+
+        static const std::vector<uint8_t> mipCounts = {1, 2, 3, 4};
+        pic.mipLevels = params.mipLevels.value_or(mipCounts[pickWeighted({85, 5, 5, 5})]);
+
+        static const std::vector<size_t> userSizes = {0, 8, 32, 128, 512};
+        pic.userDataSize = params.userDataSize.value_or(userSizes[pickWeighted({75, 10, 8, 5, 2})]);
+
+        file.pictures.push_back(pic);
+    }
+    return file;
+}
+
+Picture TIM2Generator::makePicture(const GeneratedPicture& spec) {
+    Picture pic{};
+    PictureHeader& h = pic.header;
+    const uint16_t width = std::max<uint16_t>(1, spec.width);
+    const uint16_t height = std::max<uint16_t>(1, spec.height);
+
+    size_t levels = std::clamp<size_t>(spec.mipLevels, 1, kMaxMipLevels);
+    levels = std::min(levels, log2Ceil(std::min(width, height)) + 1);
+
+    h.imageType = spec.imageFormat;
+    h.imageWidth = width;
+    h.imageHeight = height;
+    h.mipMapTextures = static_cast<uint8_t>(levels);
+
+    // Mip levels are stored back to back, each padded to 16 bytes
+    MipMapHeader mipmap{};
+    for (size_t level = 0; level < levels; ++level) {
+        const size_t w = std::max<size_t>(1, width >> level);
+        const size_t hgt = std::max<size_t>(1, height >> level);
+        const size_t bytes = (bytesForPixels(spec.imageFormat, w * hgt) + 15) / 16 * 16;
+
+        const size_t offset = pic.imageData.size();
+        pic.imageData.resize(offset + bytes, 0);
+        fillImageLevel(spec, w, hgt, pic.imageData.data() + offset);
+        mipmap.sizes.push_back(static_cast<uint32_t>(bytes));
+    }
+    if (levels > 1) pic.mipMapHeader = mipmap;
+
+    uint64_t tex0 = gsPsm(spec.imageFormat) << 20;
+    tex0 |= static_cast<uint64_t>(log2Ceil(width)) << 26;
+    tex0 |= static_cast<uint64_t>(log2Ceil(height)) << 30;
+    tex0 |= uint64_t(1) << 34;  // TCC: use texture alpha
+
+    const bool indexed = spec.imageFormat == TIM2_IDTEX4 || spec.imageFormat == TIM2_IDTEX8;
+    if (indexed && spec.clutFormat != TIM2_NONE) {
+        const size_t colors = spec.imageFormat == TIM2_IDTEX4 ? 16 : 256;
+        const bool compound = spec.compound && colors == 256 && spec.clutMode == CLUT_CSM1;
+
+        h.clutColors = static_cast<uint16_t>(colors);
+        h.clutType = static_cast<uint8_t>(spec.clutFormat | spec.clutMode | (compound ? 0x40 : 0));
+        fillClut(spec, colors, pic.clutData);
+
+        tex0 |= gsPsm(spec.clutFormat) << 51;
+        tex0 |= static_cast<uint64_t>(spec.clutMode == CLUT_CSM2 ? 1 : 0) << 55;
+        tex0 |= uint64_t(1) << 61;  // CLD: load the CLUT
+    }
+    h.gsTex0 = tex0;
+    h.imageSize = static_cast<uint32_t>(pic.imageData.size());
+    h.clutSize = static_cast<uint32_t>(pic.clutData.size());
+
+    if (spec.userDataSize > 0) {
+        std::vector<uint8_t> userData(std::min(spec.userDataSize, kMaxUserDataSize));
+        for (auto& byte : userData) byte = static_cast<uint8_t>(next());
+        pic.userData = TIM2Writer::makeUserSpace(userData, "tim2gen");
+    }
+    return pic;
+}
+
+std::vector<uint8_t> TIM2Generator::makeFile(const GeneratedFile& spec) {
+    std::vector<Picture> pictures;
+    pictures.reserve(spec.pictures.size());
+    for (const GeneratedPicture& pic : spec.pictures) {
+        pictures.push_back(makePicture(pic));
+    }
+    return TIM2Writer::serialize(pictures, spec.formatId);
+}
+
+std::vector<uint8_t> TIM2Generator::corpusFile(uint64_t seed, size_t index, const CorpusParams& params) {
+    TIM2Generator generator(mix(seed) ^ mix(index + 1));
+    return generator.makeFile(generator.randomFile(params));
+}
+
+/**
+ * Texture-like content rather than noise, so encoders and compressors see
+ * realistic input: the level is split into cells of a random size, each
+ * with its own base color or palette range, overlaid with a gradient
+ * across the level and a little per-pixel noise.
+ */
+void TIM2Generator::fillImageLevel(const GeneratedPicture& spec, size_t width, size_t height, uint8_t* out) {
+    const size_t cell = size_t(4) << below(4);  // 4..32 pixels
+    const uint64_t salt = next();
+    const int noise = 1 + static_cast<int>(below(12));
+
+    auto cellHash = [salt, cell](size_t x, size_t y) {
+        return mix(salt ^ ((x / cell) << 32) ^ (y / cell));
+    };
+
+    switch (spec.imageFormat) {
+        case TIM2_IDTEX4:
+        case TIM2_IDTEX8: {
+            const size_t colors = spec.imageFormat == TIM2_IDTEX4 ? 16 : 256;
+            for (size_t y = 0; y < height; ++y) {
+                for (size_t x = 0; x < width; ++x) {
+                    // A cell picks one of fillClut()'s 16-entry ramps and
+                    // shades along it with the gradient
+                    const uint64_t base = cellHash(x, y);
+                    const size_t ramp = (base % (colors / 16)) * 16;
+                    const size_t shade = ((x + y) * 16 / (width + height) + (base >> 8) % 4) % 16;
+                    size_t index = ramp + shade;
+                    if (below(100) < static_cast<size_t>(noise)) index = below(colors);
+
+                    const size_t p = y * width + x;
+                    if (colors == 256) {
+                        out[p] = static_cast<uint8_t>(index);
+                    } else if (p & 1) {
+                        out[p / 2] = static_cast<uint8_t>(out[p / 2] | (index << 4));
+                    } else {
+                        out[p / 2] = static_cast<uint8_t>(index);
+                    }
+                }
+            }
+            break;
+        }
+        case TIM2_RGB16:
+        case TIM2_RGB24:
+        case TIM2_RGB32: {
+            const size_t pixelBytes = getBitsPerPixel(spec.imageFormat) / 8;
+            for (size_t y = 0; y < height; ++y) {
+                for (size_t x = 0; x < width; ++x) {
+                    const uint64_t base = cellHash(x, y);
+                    const int jitter = static_cast<int>(below(2 * noise + 1)) - noise;
+                    const uint8_t r = clampByte(static_cast<int>(base & 0x7F) + static_cast<int>(x * 128 / width) + jitter);
+                    const uint8_t g = clampByte(static_cast<int>((base >> 8) & 0x7F) + static_cast<int>(y * 128 / height) + jitter);
+                    const uint8_t b = clampByte(static_cast<int>((base >> 16) & 0xFF) + jitter);
+                    // PS2 alpha: 0x80 is opaque; some cells are cut out
+                    const uint8_t a = ((base >> 24) & 0xF) == 0 ? 0 : 0x80;
+                    storeColor(spec.imageFormat, r, g, b, a, out + (y * width + x) * pixelBytes);
+                }
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/**
+ * Palettes made of 16-entry ramps between two random colors, as artists'
+ * palettes tend to be. Alpha is the PS2's opaque 0x80, and entry 0 is often
+ * the transparent color.
+ */
+void TIM2Generator::fillClut(const GeneratedPicture& spec, size_t colors, std::vector<uint8_t>& out) {
+    const size_t entryBytes = getBitsPerPixel(spec.clutFormat) / 8;
+    out.assign(colors * entryBytes, 0);
+    const bool transparentZero = chance(0.5);
+
+    for (size_t ramp = 0; ramp < colors; ramp += 16) {
+        const uint64_t from = next();
+        const uint64_t to = next();
+        for (size_t i = 0; i < 16 && ramp + i < colors; ++i) {
+            auto lerp = [i](uint64_t a, uint64_t b, int shift) {
+                const int start = static_cast<int>((a >> shift) & 0xFF);
+                const int end = static_cast<int>((b >> shift) & 0xFF);
+                return static_cast<uint8_t>(start + (end - start) * static_cast<int>(i) / 15);
+            };
+            const size_t entry = ramp + i;
+            const uint8_t a = (entry == 0 && transparentZero) ? 0 : 0x80;
+            storeColor(spec.clutFormat, lerp(from, to, 0), lerp(from, to, 8), lerp(from, to, 16), a,
+                       out.data() + entry * entryBytes);
+        }
+    }
+}
+
+} // namespace tim2
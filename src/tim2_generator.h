@@ -0,0 +1,85 @@
+#pragma once
+
+#include "tim2_parser.h"
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace tim2 {
+
+// Synthetic TIM2 content for benchmarks and bug reports.
+//
+// Output depends only on the seed, never on the platform or standard
+// library (the generator has its own PRNG), so a seed and a parameter list
+// reproduce a corpus byte for byte anywhere.
+
+// One picture to generate
+struct GeneratedPicture {
+    PixelFormat imageFormat = TIM2_IDTEX8;
+    PixelFormat clutFormat = TIM2_RGB32;  // Indexed formats only
+    uint8_t clutMode = CLUT_CSM1;         // CLUT_CSM1 or CLUT_CSM2
+    bool compound = false;                // CSM1 256-color CLUTs only
+    uint16_t width = 128;
+    uint16_t height = 128;
+    uint8_t mipLevels = 1;
+    size_t userDataSize = 0;              // > 0 adds an ExtendedHeader and comment
+};
+
+// One file to generate
+struct GeneratedFile {
+    uint8_t formatId = TIM2_ALIGN_128;    // TIM2_ALIGN_16 or TIM2_ALIGN_128
+    std::vector<GeneratedPicture> pictures;
+};
+
+// Fixed values for corpus generation; anything unset is drawn from a
+// distribution modelled on PS2 game texture archives (mostly single
+// IDTEX8/IDTEX4 pictures with RGB32 CLUTs, power-of-two sizes up to 512,
+// occasional mip chains, multi-picture files and user data)
+struct CorpusParams {
+    std::optional<PixelFormat> imageFormat;
+    std::optional<PixelFormat> clutFormat;
+    std::optional<uint8_t> clutMode;
+    std::optional<bool> compound;
+    std::optional<uint16_t> width;
+    std::optional<uint16_t> height;
+    std::optional<uint8_t> mipLevels;
+    std::optional<uint16_t> pictures;
+    std::optional<uint8_t> formatId;
+    std::optional<size_t> userDataSize;
+};
+
+class TIM2Generator {
+public:
+    explicit TIM2Generator(uint64_t seed);
+
+    // Draw a file layout from the corpus distribution, honoring params
+    GeneratedFile randomFile(const CorpusParams& params);
+
+    // Picture with image, CLUT and user data filled in. Impossible
+    // combinations are adjusted: mip levels are capped by the size, and
+    // compound is dropped for 16-color CLUTs.
+    Picture makePicture(const GeneratedPicture& spec);
+
+    // Whole TIM2 file image
+    std::vector<uint8_t> makeFile(const GeneratedFile& spec);
+
+    // File number index of the corpus for seed. Each file has its own
+    // generator, so files do not change when the corpus grows.
+    static std::vector<uint8_t> corpusFile(uint64_t seed, size_t index, const CorpusParams& params);
+
+    // Uniform random value
+    uint64_t next();
+    // Uniform in [0, bound)
+    size_t below(size_t bound);
+
+private:
+    uint64_t m_state;
+
+    bool chance(double probability);
+    size_t pickWeighted(const std::vector<double>& weights);
+
+    void fillImageLevel(const GeneratedPicture& spec, size_t width, size_t height, uint8_t* out);
+    void fillClut(const GeneratedPicture& spec, size_t colors, std::vector<uint8_t>& out);
+};
+
+} // namespace tim2
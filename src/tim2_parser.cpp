@@ -1,9 +1,52 @@
 #include "tim2_parser.h"
+#include "hash.h"
+#include "phase_stats.h"
+#include "perf_counters.h"
 #include <iostream>
 #include <algorithm>
+#include <cstring>
 
 namespace tim2 {
 
+namespace {
+
+std::vector<Color32> timedClutColors(const Picture& pic) {
+    stats::Scope scope(stats::Phase::Clut);
+    return pic.getClutColors();
+}
+
+// Read-only, seekable streambuf over a caller-owned byte range, so the same
+// istream-based parser can run on file contents that are already in memory.
+class MemoryStreamBuf : public std::streambuf {
+public:
+    MemoryStreamBuf(const uint8_t* data, size_t size) {
+        char* begin = const_cast<char*>(reinterpret_cast<const char*>(data));
+        setg(begin, begin, begin + size);
+    }
+
+protected:
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                     std::ios_base::openmode which = std::ios_base::in) override {
+        if (!(which & std::ios_base::in)) return pos_type(off_type(-1));
+
+        off_type base = 0;
+        if (dir == std::ios_base::cur) base = gptr() - eback();
+        else if (dir == std::ios_base::end) base = egptr() - eback();
+
+        const off_type target = base + off;
+        if (target < 0 || target > egptr() - eback()) return pos_type(off_type(-1));
+
+        setg(eback(), eback() + target, egptr());
+        return pos_type(target);
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which = std::ios_base::in) override {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+};
+
+} // namespace
+
 // ─────────────────────────────────────────────────────────────
 // Picture implementation
 // ─────────────────────────────────────────────────────────────
@@ -16,9 +59,6 @@ namespace tim2 {
  * - We decode according to header.imageType. For indexed formats we fetch the CLUT,
  *   apply the right ordering rules (CSM1/compound), and output Color32.
  * - On invalid input (e.g., mipLevel out of range), we return an empty vector.
- *
- * NOTE: This method reads pixels one by one via getPixelColor(). That’s simple,
- * but not the fastest. If you need speed, consider a scanline decoder.
  */
 std::vector<Color32> Picture::decodeImage(size_t mipLevel) const {
     if (mipLevel >= header.mipMapTextures) {
@@ -29,14 +69,94 @@ std::vector<Color32> Picture::decodeImage(size_t mipLevel) const {
     const size_t height = getMipMapHeight(mipLevel);
 
     std::vector<Color32> result(width * height);
+    decodeRows(mipLevel, 0, height, result.data());
 
-    for (size_t y = 0; y < height; ++y) {
-        for (size_t x = 0; x < width; ++x) {
-            result[y * width + x] = getPixelColor(x, y, mipLevel);
-        }
+    return result;
+}
+
+/**
+ * Scanline decoder behind decodeImage().
+ *
+ * Produces exactly what reference::pixelColor() would for every pixel in the
+ * band (tim2conform checks this), but decodes the CLUT once per call instead
+ * of once per pixel and keeps the format switch out of the inner loop.
+ * Pixels whose bytes lie past the end of imageData (truncated files) are
+ * left as default Color32.
+ */
+void Picture::decodeRows(size_t mipLevel, size_t firstRow, size_t rowCount, Color32* out) const {
+    if (mipLevel >= header.mipMapTextures || rowCount == 0) {
+        return;
     }
 
-    return result;
+    stats::Scope scope(stats::Phase::Decode);
+
+    const size_t width  = getMipMapWidth(mipLevel);
+    const size_t offset = getImageOffset(mipLevel);
+    const size_t available = offset < imageData.size() ? imageData.size() - offset : 0;
+    const uint8_t* data = imageData.data() + (available > 0 ? offset : 0);
+
+    const size_t firstPixel = firstRow * width;
+    const size_t pixelCount = rowCount * width;
+    perf::FormatScope counters(header.getImagePixelFormat(), pixelCount);
+
+    std::fill(out, out + pixelCount, Color32{});
+
+    switch (header.getImagePixelFormat()) {
+        case TIM2_RGB32: {
+            const size_t end = std::min(firstPixel + pixelCount, available / 4);
+            for (size_t p = firstPixel; p < end; ++p) {
+                const uint8_t* src = data + p * 4;
+                out[p - firstPixel] = Color32(src[0], src[1], src[2], src[3]);
+            }
+            break;
+        }
+        case TIM2_RGB24: {
+            const size_t end = std::min(firstPixel + pixelCount, available / 3);
+            for (size_t p = firstPixel; p < end; ++p) {
+                const uint8_t* src = data + p * 3;
+                out[p - firstPixel] = Color32(src[0], src[1], src[2], 255);
+            }
+            break;
+        }
+        case TIM2_RGB16: {
+            const size_t end = std::min(firstPixel + pixelCount, available / 2);
+            for (size_t p = firstPixel; p < end; ++p) {
+                uint16_t val;
+                std::memcpy(&val, data + p * 2, sizeof(val));
+                out[p - firstPixel] = Color16{val}.toColor32();
+            }
+            break;
+        }
+        case TIM2_IDTEX8: {
+            if (!header.hasClut()) break;
+            const auto colors = timedClutColors(*this);
+            const size_t end = std::min(firstPixel + pixelCount, available);
+            for (size_t p = firstPixel; p < end; ++p) {
+                const uint8_t colorIdx = data[p];
+                if (colorIdx < colors.size()) {
+                    out[p - firstPixel] = colors[colorIdx];
+                }
+            }
+            break;
+        }
+        case TIM2_IDTEX4: {
+            if (!header.hasClut()) break;
+            const auto colors = timedClutColors(*this);
+            const size_t end = std::min(firstPixel + pixelCount, available * 2);
+            for (size_t p = firstPixel; p < end; ++p) {
+                // Even pixel = low nibble, odd pixel = high nibble.
+                const uint8_t packed   = data[p / 2];
+                const uint8_t colorIdx = (p & 1) ? (packed >> 4) : (packed & 0x0F);
+                if (colorIdx < colors.size()) {
+                    out[p - firstPixel] = colors[colorIdx];
+                }
+            }
+            break;
+        }
+        default:
+            // Unknown / unsupported format: leave transparent black
+            break;
+    }
 }
 
 /**
@@ -85,16 +205,20 @@ std::vector<Color32> Picture::getClutColors() const {
 
         Color32 color{};
 
+        // Entries whose bytes lie past clutData (clutSize smaller than the
+        // header's color count, or a truncated file) stay transparent black
         switch (fmt) {
             case TIM2_RGB16: {
                 const size_t byteIdx = index * 2;
-                const uint16_t val = *reinterpret_cast<const uint16_t*>(&data[byteIdx]);
-                Color16 c16{val};
-                color = c16.toColor32();
+                if (byteIdx + 2 > clutData.size()) break;
+                uint16_t val;
+                std::memcpy(&val, &data[byteIdx], sizeof(val));
+                color = Color16{val}.toColor32();
                 break;
             }
             case TIM2_RGB24: {
                 const size_t byteIdx = index * 3;
+                if (byteIdx + 3 > clutData.size()) break;
                 color.r = data[byteIdx + 0];
                 color.g = data[byteIdx + 1];
                 color.b = data[byteIdx + 2];
@@ -103,6 +227,7 @@ std::vector<Color32> Picture::getClutColors() const {
             }
             case TIM2_RGB32: {
                 const size_t byteIdx = index * 4;
+                if (byteIdx + 4 > clutData.size()) break;
                 color.r = data[byteIdx + 0];
                 color.g = data[byteIdx + 1];
                 color.b = data[byteIdx + 2];
@@ -120,84 +245,6 @@ std::vector<Color32> Picture::getClutColors() const {
     return colors;
 }
 
-/**
- * Return the color of a single pixel at (x, y) for a given mip level.
- *
- * - True-color formats read directly from imageData.
- * - Indexed formats first read the index, then look up into the decoded CLUT.
- *
- * NOTE on RGB24:
- *   The GS stores RGB24 in a packed layout. The code below treats pixels as tightly
- *   packed 3-byte triplets laid sequentially. If you run into RGB24 TIM2s that look
- *   scrambled, you likely need to implement the exact GS swizzle/packing for 24-bit
- *   textures as described in the spec (§4.6). Consider that a future optimization.
- */
-Color32 Picture::getPixelColor(size_t x, size_t y, size_t mipLevel) const {
-    const size_t offset = getImageOffset(mipLevel);
-    const size_t width  = getMipMapWidth(mipLevel);
-    const uint8_t* data = imageData.data() + offset;
-
-    Color32 result{};
-
-    switch (header.getImagePixelFormat()) {
-        case TIM2_RGB32: {
-            const size_t idx = (y * width + x) * 4;
-            result.r = data[idx + 0];
-            result.g = data[idx + 1];
-            result.b = data[idx + 2];
-            result.a = data[idx + 3];
-            break;
-        }
-        case TIM2_RGB24: {
-            // Packed 3 bytes per pixel, no padding between pixels here.
-            // See note above if you encounter layout mismatches.
-            const size_t idx = (y * width + x) * 3;
-            result.r = data[idx + 0];
-            result.g = data[idx + 1];
-            result.b = data[idx + 2];
-            result.a = 255;
-            break;
-        }
-        case TIM2_RGB16: {
-            const size_t idx = (y * width + x) * 2;
-            const uint16_t val = *reinterpret_cast<const uint16_t*>(&data[idx]);
-            Color16 c16{val};
-            result = c16.toColor32();
-            break;
-        }
-        case TIM2_IDTEX8: {
-            if (header.hasClut()) {
-                const size_t idx = y * width + x;
-                const uint8_t colorIdx = data[idx];
-                const auto colors = getClutColors();
-                if (colorIdx < colors.size()) {
-                    result = colors[colorIdx];
-                }
-            }
-            break;
-        }
-        case TIM2_IDTEX4: {
-            if (header.hasClut()) {
-                const size_t pixelIdx = y * width + x;
-                const size_t byteIdx  = pixelIdx / 2;
-                // Even pixel = low nibble, odd pixel = high nibble.
-                const uint8_t packed  = data[byteIdx];
-                const uint8_t colorIdx = (pixelIdx & 1) ? (packed >> 4) : (packed & 0x0F);
-                const auto colors = getClutColors();
-                if (colorIdx < colors.size()) {
-                    result = colors[colorIdx];
-                }
-            }
-            break;
-        }
-        default:
-            // Unknown / unsupported format: return transparent black
-            break;
-    }
-
-    return result;
-}
-
 /**
  * Compute the byte offset to the start of a given mip level within imageData.
  *
@@ -228,6 +275,34 @@ size_t Picture::getMipMapHeight(size_t level) const {
     return std::max<size_t>(1, header.imageHeight >> level);
 }
 
+/**
+ * Content key for deduplication. Covers exactly the inputs of decodeRows()
+ * and getClutColors(); GS register values, user data and comments are left
+ * out, since they do not change the decoded pixels.
+ */
+uint64_t Picture::contentHash() const {
+    Hash64 hash;
+    hash.updateValue(header.imageType);
+    hash.updateValue(header.clutType);
+    hash.updateValue(header.clutSize);
+    hash.updateValue(header.clutColors);
+    hash.updateValue(header.imageWidth);
+    hash.updateValue(header.imageHeight);
+    hash.updateValue(header.mipMapTextures);
+
+    const uint64_t mipSizes = mipMapHeader ? mipMapHeader->sizes.size() : 0;
+    hash.updateValue(mipSizes);
+    if (mipMapHeader) {
+        hash.update(mipMapHeader->sizes.data(), mipMapHeader->sizes.size() * sizeof(uint32_t));
+    }
+
+    const uint64_t imageBytes = imageData.size();
+    hash.updateValue(imageBytes);
+    hash.update(imageData.data(), imageData.size());
+    hash.update(clutData.data(), clutData.size());
+    return hash.digest();
+}
+
 // ─────────────────────────────────────────────────────────────
 // TIM2Parser implementation
 // ─────────────────────────────────────────────────────────────
@@ -246,7 +321,38 @@ size_t Picture::getMipMapHeight(size_t level) const {
  *      - Align, then read CLUT data
  */
 bool TIM2Parser::loadFile(const std::string& filename) {
+    return load(filename, false);
+}
+
+/**
+ * Same walk as loadFile(), but seek over image and CLUT data instead of
+ * reading it. Used by the batch planner to size work before loading anything.
+ */
+bool TIM2Parser::loadHeaders(const std::string& filename) {
+    return load(filename, true);
+}
+
+/**
+ * Decide whether a file is TIM2 by content rather than extension, for dumps
+ * that name textures .bin/.dat or nothing at all. One 16-byte read.
+ */
+bool TIM2Parser::probeFile(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) return false;
+
+    FileHeader header{};
+    file.read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+    if (!file) return false;
+
+    return header.isValid()
+        && (header.formatId == TIM2_ALIGN_16 || header.formatId == TIM2_ALIGN_128)
+        && header.pictures > 0;
+}
+
+bool TIM2Parser::load(const std::string& filename, bool headersOnly) {
     m_valid = false;
+    m_headersOnly = headersOnly;
+    m_fromFile = true;
     m_pictures.clear();
     m_lastError.clear();
 
@@ -256,6 +362,34 @@ bool TIM2Parser::loadFile(const std::string& filename) {
         return false;
     }
 
+    if (m_headersOnly) {
+        file.seekg(0, std::ios::end);
+        m_fileSize = static_cast<size_t>(file.tellg());
+        file.seekg(0, std::ios::beg);
+    }
+
+    return parse(file);
+}
+
+/**
+ * Parse a whole file image held in memory. Used by the batch pipeline, where
+ * reader threads do the I/O and workers only parse and decode.
+ */
+bool TIM2Parser::loadFromMemory(const uint8_t* data, size_t size) {
+    m_valid = false;
+    m_headersOnly = false;
+    m_fromFile = false;
+    m_pictures.clear();
+    m_lastError.clear();
+
+    MemoryStreamBuf buffer(data, size);
+    std::istream stream(&buffer);
+    return parse(stream);
+}
+
+bool TIM2Parser::parse(std::istream& file) {
+    stats::Scope scope(stats::Phase::Parse);
+
     // (1) File header
     if (!parseFileHeader(file)) {
         return false;
@@ -285,7 +419,7 @@ bool TIM2Parser::loadFile(const std::string& filename) {
  * Read and sanity-check the 16-byte FileHeader.
  * We accept version != 0x04 with a warning, but continue anyway (many tools do).
  */
-bool TIM2Parser::parseFileHeader(std::ifstream& file) {
+bool TIM2Parser::parseFileHeader(std::istream& file) {
     file.read(reinterpret_cast<char*>(&m_fileHeader), sizeof(FileHeader));
 
     if (!file) {
@@ -317,7 +451,7 @@ bool TIM2Parser::parseFileHeader(std::ifstream& file) {
  *
  * The “alignment” parameter comes from the file header (16 or 128).
  */
-bool TIM2Parser::parsePicture(std::ifstream& file, Picture& pic, size_t alignment) {
+bool TIM2Parser::parsePicture(std::istream& file, Picture& pic, size_t alignment) {
     // Picture header (fixed 48 bytes)
     file.read(reinterpret_cast<char*>(&pic.header), sizeof(PictureHeader));
     if (!file) {
@@ -382,7 +516,7 @@ bool TIM2Parser::parsePicture(std::ifstream& file, Picture& pic, size_t alignmen
  * - Two 64-bit GS registers (MIPTBP1/MIPTBP2)
  * - An array of level sizes (LV0..LVn), then pad to 16 bytes.
  */
-bool TIM2Parser::parseMipMapHeader(std::ifstream& file, Picture& pic) {
+bool TIM2Parser::parseMipMapHeader(std::istream& file, Picture& pic) {
     pic.mipMapHeader = MipMapHeader{};
     auto& mipmap = *pic.mipMapHeader;
 
@@ -414,7 +548,7 @@ bool TIM2Parser::parseMipMapHeader(std::ifstream& file, Picture& pic) {
  *
  * If not present, we keep the whole blob as opaque userData.
  */
-bool TIM2Parser::parseUserSpace(std::ifstream& file, Picture& pic) {
+bool TIM2Parser::parseUserSpace(std::istream& file, Picture& pic) {
     size_t headerDataSize = sizeof(PictureHeader);
     if (pic.mipMapHeader) {
         size_t mipHeaderSize = 16 + pic.header.mipMapTextures * 4;
@@ -458,7 +592,12 @@ bool TIM2Parser::parseUserSpace(std::ifstream& file, Picture& pic) {
 /**
  * Read raw image bytes (GS layout, not decoded).
  */
-bool TIM2Parser::parseImageData(std::ifstream& file, Picture& pic) {
+bool TIM2Parser::parseImageData(std::istream& file, Picture& pic) {
+    if (m_headersOnly) return skipData(file, pic.header.imageSize);
+
+    std::optional<stats::Scope> read;
+    if (m_fromFile) read.emplace(stats::Phase::Read);
+
     pic.imageData.resize(pic.header.imageSize);
     file.read(reinterpret_cast<char*>(pic.imageData.data()), pic.header.imageSize);
     return file.good();
@@ -467,12 +606,30 @@ bool TIM2Parser::parseImageData(std::ifstream& file, Picture& pic) {
 /**
  * Read raw CLUT bytes (not decoded).
  */
-bool TIM2Parser::parseClutData(std::ifstream& file, Picture& pic) {
+bool TIM2Parser::parseClutData(std::istream& file, Picture& pic) {
+    if (m_headersOnly) return skipData(file, pic.header.clutSize);
+
+    std::optional<stats::Scope> read;
+    if (m_fromFile) read.emplace(stats::Phase::Read);
+
     pic.clutData.resize(pic.header.clutSize);
     file.read(reinterpret_cast<char*>(pic.clutData.data()), pic.header.clutSize);
     return file.good();
 }
 
+/**
+ * Headers-only mode: step over a data block, failing (like a short read
+ * would) if the block runs past the end of the file.
+ */
+bool TIM2Parser::skipData(std::istream& file, size_t size) {
+    const size_t end = static_cast<size_t>(file.tellg()) + size;
+    if (end > m_fileSize) {
+        return false;
+    }
+    file.seekg(static_cast<std::streamoff>(end), std::ios::beg);
+    return file.good();
+}
+
 /**
  * Round “offset” up to the next multiple of “alignment”.
  * e.g., alignOffset(17, 16) == 32.
@@ -485,7 +642,7 @@ size_t TIM2Parser::alignOffset(size_t offset, size_t alignment) {
  * Move the file cursor forward to the next aligned position.
  * Safe to call even if already aligned.
  */
-void TIM2Parser::skipAlignment(std::ifstream& file, size_t alignment) {
+void TIM2Parser::skipAlignment(std::istream& file, size_t alignment) {
     const size_t currentPos = static_cast<size_t>(file.tellg());
     const size_t alignedPos = alignOffset(currentPos, alignment);
     if (alignedPos > currentPos) {
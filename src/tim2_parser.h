@@ -3,6 +3,7 @@
 #include "tim2_types.h"
 #include <memory>
 #include <fstream>
+#include <istream>
 #include <optional>
 
 namespace tim2 {
@@ -20,14 +21,23 @@ public:
     // Get decoded image as RGBA
     std::vector<Color32> decodeImage(size_t mipLevel = 0) const;
 
+    // Decode rows [firstRow, firstRow + rowCount) of a mip level into out
+    // (rowCount * width pixels). Lets callers split large images into bands.
+    void decodeRows(size_t mipLevel, size_t firstRow, size_t rowCount, Color32* out) const;
+
     // Get CLUT colors
     std::vector<Color32> getClutColors() const;
 
-private:
-    Color32 getPixelColor(size_t x, size_t y, size_t mipLevel = 0) const;
-    size_t getImageOffset(size_t mipLevel) const;
+    // Dimensions of a mip level (clamped to at least 1)
     size_t getMipMapWidth(size_t level) const;
     size_t getMipMapHeight(size_t level) const;
+
+    // Hash of everything decodeImage() depends on: pixel/CLUT formats, size,
+    // mip layout, image and CLUT bytes. Equal hashes mean equal decoded pixels.
+    uint64_t contentHash() const;
+
+private:
+    size_t getImageOffset(size_t mipLevel) const;
 };
 
 class TIM2Parser {
@@ -38,6 +48,18 @@ public:
     // Load TIM2 file
     bool loadFile(const std::string& filename);
 
+    // Load only the headers (file, picture, mipmap, user space). Image and
+    // CLUT data are skipped, so pictures have empty imageData/clutData, but a
+    // file too short to hold that data is still rejected.
+    bool loadHeaders(const std::string& filename);
+
+    // Cheap content sniff: read only the 16-byte FileHeader and check that it
+    // looks like TIM2 (signature, alignment mode, at least one picture)
+    static bool probeFile(const std::string& filename);
+
+    // Parse a TIM2 file that is already in memory
+    bool loadFromMemory(const uint8_t* data, size_t size);
+
     // Check if file is loaded and valid
     bool isValid() const { return m_valid; }
 
@@ -63,18 +85,24 @@ private:
     FileHeader m_fileHeader;
     std::vector<Picture> m_pictures;
     bool m_valid = false;
+    bool m_headersOnly = false;
+    bool m_fromFile = false;  // Data blocks are read from disk (--stats counts them as Read)
+    size_t m_fileSize = 0;
     std::string m_lastError;
 
     // Helper methods
-    bool parseFileHeader(std::ifstream& file);
-    bool parsePicture(std::ifstream& file, Picture& pic, size_t alignment);
-    bool parseMipMapHeader(std::ifstream& file, Picture& pic);
-    bool parseUserSpace(std::ifstream& file, Picture& pic);
-    bool parseImageData(std::ifstream& file, Picture& pic);
-    bool parseClutData(std::ifstream& file, Picture& pic);
+    bool load(const std::string& filename, bool headersOnly);
+    bool parse(std::istream& file);
+    bool parseFileHeader(std::istream& file);
+    bool parsePicture(std::istream& file, Picture& pic, size_t alignment);
+    bool parseMipMapHeader(std::istream& file, Picture& pic);
+    bool parseUserSpace(std::istream& file, Picture& pic);
+    bool parseImageData(std::istream& file, Picture& pic);
+    bool parseClutData(std::istream& file, Picture& pic);
+    bool skipData(std::istream& file, size_t size);
 
     size_t alignOffset(size_t offset, size_t alignment);
-    void skipAlignment(std::ifstream& file, size_t alignment);
+    void skipAlignment(std::istream& file, size_t alignment);
 };
 
 } // namespace tim2
\ No newline at end of file
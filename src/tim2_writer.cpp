@@ -0,0 +1,124 @@
+#include "tim2_writer.h"
+#include <fstream>
+
+namespace tim2 {
+
+namespace {
+
+void appendBytes(std::vector<uint8_t>& out, const void* bytes, size_t size) {
+    if (size == 0) return;
+    const size_t offset = out.size();
+    out.resize(offset + size);
+    std::memcpy(out.data() + offset, bytes, size);
+}
+
+void appendBytes(std::vector<uint8_t>& out, const std::vector<uint8_t>& bytes) {
+    appendBytes(out, bytes.data(), bytes.size());
+}
+
+template<typename T>
+void append(std::vector<uint8_t>& out, const T& value) {
+    appendBytes(out, &value, sizeof(T));
+}
+
+// Zero-pad to the next multiple of alignment
+void padTo(std::vector<uint8_t>& out, size_t alignment) {
+    out.resize((out.size() + alignment - 1) / alignment * alignment, 0);
+}
+
+} // namespace
+
+/**
+ * Lay the file out the way TIM2Parser::parse() walks it: the file header,
+ * padding to the alignment, then per picture the PictureHeader, the MIPMAP
+ * header (16-byte padded), the user space and padding up to the aligned
+ * image start, the image data, padding up to the aligned CLUT start, and the
+ * CLUT data, which the next picture follows directly.
+ *
+ * headerSize includes the padding before the image data, as in files
+ * written by the official tools, so the parser sees it as user space.
+ */
+std::vector<uint8_t> TIM2Writer::serialize(const std::vector<Picture>& pictures, uint8_t formatId) {
+    FileHeader fileHeader{};
+    std::memcpy(fileHeader.fileId, "TIM2", 4);
+    fileHeader.formatVersion = TIM2_FORMAT_VERSION;
+    fileHeader.formatId = formatId;
+    fileHeader.pictures = static_cast<uint16_t>(pictures.size());
+    const size_t alignment = fileHeader.getAlignment();
+
+    std::vector<uint8_t> out;
+    append(out, fileHeader);
+    padTo(out, alignment);
+
+    for (const Picture& pic : pictures) {
+        const size_t start = out.size();
+        PictureHeader header = pic.header;
+        append(out, header);  // Placeholder until the sizes are known
+
+        if (header.mipMapTextures > 1) {
+            const MipMapHeader mipmap = pic.mipMapHeader.value_or(MipMapHeader{});
+            append(out, mipmap.gsMiptbp1);
+            append(out, mipmap.gsMiptbp2);
+            for (size_t i = 0; i < header.mipMapTextures; ++i) {
+                append(out, i < mipmap.sizes.size() ? mipmap.sizes[i] : uint32_t{0});
+            }
+            padTo(out, 16);
+        }
+
+        appendBytes(out, pic.userData);
+        padTo(out, alignment);
+        header.headerSize = static_cast<uint16_t>(out.size() - start);
+
+        appendBytes(out, pic.imageData);
+        padTo(out, alignment);
+        appendBytes(out, pic.clutData);
+
+        header.imageSize = static_cast<uint32_t>(pic.imageData.size());
+        header.clutSize = static_cast<uint32_t>(pic.clutData.size());
+        header.totalSize = static_cast<uint32_t>(out.size() - start);
+        std::memcpy(out.data() + start, &header, sizeof(header));
+    }
+
+    return out;
+}
+
+bool TIM2Writer::writeFile(const std::string& filename, const std::vector<Picture>& pictures,
+                           uint8_t formatId, std::string& error) {
+    const std::vector<uint8_t> data = serialize(pictures, formatId);
+
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        error = "Cannot create file: " + filename;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    if (!file) {
+        error = "Failed to write file: " + filename;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * ExtendedHeader, user data, then the comment and its terminator, padded to
+ * 16 bytes. userSpaceSize excludes the padding, as the parser expects.
+ */
+std::vector<uint8_t> TIM2Writer::makeUserSpace(const std::vector<uint8_t>& userData,
+                                               const std::string& comment) {
+    ExtendedHeader ext{};
+    std::memcpy(ext.exHeaderId, "eXt\0", 4);
+    ext.userDataSize = static_cast<uint32_t>(userData.size());
+    ext.userSpaceSize = static_cast<uint32_t>(sizeof(ExtendedHeader) + userData.size() +
+                                              (comment.empty() ? 0 : comment.size() + 1));
+
+    std::vector<uint8_t> out;
+    append(out, ext);
+    appendBytes(out, userData);
+    if (!comment.empty()) {
+        appendBytes(out, comment.c_str(), comment.size() + 1);
+    }
+    padTo(out, 16);
+    return out;
+}
+
+} // namespace tim2
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "tim2_parser.h"
+#include <string>
+#include <vector>
+
+namespace tim2 {
+
+// Serializes pictures into TIM2 files laid out exactly the way TIM2Parser
+// reads them. The inverse of loadFromMemory(): parsing the output yields the
+// same pictures, except that userData gains any zero padding needed to align
+// the image data.
+class TIM2Writer {
+public:
+    // Build a whole file image. formatId is TIM2_ALIGN_16 or TIM2_ALIGN_128.
+    // The size fields of each PictureHeader (totalSize, headerSize,
+    // imageSize, clutSize) are derived from the picture's data vectors; all
+    // other header fields are written as given.
+    static std::vector<uint8_t> serialize(const std::vector<Picture>& pictures, uint8_t formatId);
+
+    // serialize() to a file
+    static bool writeFile(const std::string& filename, const std::vector<Picture>& pictures,
+                          uint8_t formatId, std::string& error);
+
+    // User space holding an ExtendedHeader, userDataSize bytes of user data
+    // and a NUL-terminated comment, for Picture::userData
+    static std::vector<uint8_t> makeUserSpace(const std::vector<uint8_t>& userData,
+                                              const std::string& comment);
+};
+
+} // namespace tim2
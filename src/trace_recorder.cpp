@@ -0,0 +1,217 @@
+#include "trace_recorder.h"
+#include "json_writer.h"
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace tim2 {
+namespace trace {
+
+std::atomic<bool> g_enabled{false};
+
+namespace {
+
+constexpr size_t kMaxEventsPerThread = size_t(1) << 20;  // ~48 MB per thread
+constexpr uint32_t kNoFile = UINT32_MAX;
+
+struct Event {
+    const char* name;
+    const char* category;
+    uint64_t start;
+    uint64_t duration;
+    int32_t picture;
+    int32_t mip;
+    uint32_t file;  // Index into ThreadBuffer::files
+};
+
+struct ThreadBuffer {
+    uint32_t id = 0;
+    std::string name;
+    std::vector<Event> events;
+    std::vector<std::string> files;  // Interned file arguments
+    const std::filesystem::path* lastFile = nullptr;
+    uint64_t dropped = 0;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> threads;
+    uint64_t origin = 0;
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+thread_local ThreadBuffer* t_buffer = nullptr;
+thread_local const Item* t_item = nullptr;
+
+ThreadBuffer& threadBuffer() {
+    if (!t_buffer) {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.threads.push_back(std::make_unique<ThreadBuffer>());
+        t_buffer = reg.threads.back().get();
+        t_buffer->id = static_cast<uint32_t>(reg.threads.size());
+        t_buffer->name = "thread " + std::to_string(t_buffer->id);
+        t_buffer->events.reserve(1024);
+    }
+    return *t_buffer;
+}
+
+// Consecutive events on a thread mostly belong to the same file, so only
+// the last path is looked up
+uint32_t internFile(ThreadBuffer& buffer, const std::filesystem::path* file) {
+    if (!file) return kNoFile;
+    if (file != buffer.lastFile) {
+        buffer.files.push_back(file->string());
+        buffer.lastFile = file;
+    }
+    return static_cast<uint32_t>(buffer.files.size() - 1);
+}
+
+// Nanoseconds since start() as Chrome's microseconds
+double micros(uint64_t nanos) {
+    return nanos / 1000.0;
+}
+
+} // namespace
+
+void start() {
+    registry().origin = now();
+    g_enabled.store(true, std::memory_order_relaxed);
+}
+
+uint64_t now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void setThreadName(const std::string& name) {
+    if (enabled()) threadBuffer().name = name;
+}
+
+void record(const char* name, const char* category, uint64_t start, uint64_t duration) {
+    ThreadBuffer& buffer = threadBuffer();
+    if (buffer.events.size() >= kMaxEventsPerThread) {
+        buffer.dropped++;
+        return;
+    }
+
+    Event event{name, category, start, duration, -1, -1, kNoFile};
+    if (t_item) {
+        event.picture = t_item->picture();
+        event.mip = t_item->mip();
+        event.file = internFile(buffer, t_item->file());
+    }
+    buffer.events.push_back(event);
+}
+
+uint64_t droppedEvents() {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    uint64_t dropped = 0;
+    for (const auto& buffer : reg.threads) {
+        dropped += buffer->dropped;
+    }
+    return dropped;
+}
+
+/**
+ * Stream the events out one JSON object at a time, so a large trace is
+ * never held in memory twice. Each thread gets a name and a sort index in
+ * the order threads first recorded, which keeps the main thread, the
+ * pipeline stages and the workers grouped in the viewer.
+ */
+bool write(const std::string& path, std::string& error) {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) {
+        error = "Cannot create trace file: " + path;
+        return false;
+    }
+
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    auto emit = [&out, &first](const JsonWriter& json) {
+        if (!first) out << ",\n";
+        out << json.str();
+        first = false;
+    };
+
+    for (const auto& buffer : reg.threads) {
+        if (buffer->events.empty()) continue;
+
+        JsonWriter name;
+        name.beginObject()
+            .field("name", "thread_name").field("ph", "M").field("pid", 1).field("tid", buffer->id)
+            .key("args").beginObject().field("name", std::string_view(buffer->name)).endObject()
+            .endObject();
+        emit(name);
+
+        JsonWriter order;
+        order.beginObject()
+            .field("name", "thread_sort_index").field("ph", "M").field("pid", 1).field("tid", buffer->id)
+            .key("args").beginObject().field("sort_index", buffer->id).endObject()
+            .endObject();
+        emit(order);
+
+        for (const Event& event : buffer->events) {
+            JsonWriter json;
+            json.beginObject()
+                .field("name", event.name)
+                .field("cat", event.category)
+                .field("ph", "X")
+                .field("pid", 1)
+                .field("tid", buffer->id)
+                .key("ts").value(micros(event.start > reg.origin ? event.start - reg.origin : 0), 3)
+                .key("dur").value(micros(event.duration), 3);
+
+            if (event.file != kNoFile || event.picture >= 0) {
+                json.key("args").beginObject();
+                if (event.file != kNoFile) json.field("file", std::string_view(buffer->files[event.file]));
+                if (event.picture >= 0) json.field("picture", event.picture);
+                if (event.mip >= 0) json.field("mip", event.mip);
+                json.endObject();
+            }
+            emit(json.endObject());
+        }
+    }
+
+    out << "\n]}\n";
+    if (!out) {
+        error = "Failed to write trace file: " + path;
+        return false;
+    }
+    return true;
+}
+
+Item::Item(const std::filesystem::path* file, int picture, int mip)
+    : m_file(file), m_picture(picture), m_mip(mip) {
+    if (enabled()) {
+        m_active = true;
+        m_parent = t_item;
+        if (!m_file && m_parent) m_file = m_parent->m_file;
+        t_item = this;
+    }
+}
+
+Item::~Item() {
+    if (m_active) t_item = m_parent;
+}
+
+void Span::end() {
+    const uint64_t duration = now() - m_start;
+    if (duration >= m_minDuration) {
+        record(m_name, m_category, m_start, duration);
+    }
+}
+
+} // namespace trace
+} // namespace tim2
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace tim2 {
+namespace trace {
+
+// Timeline recording for --trace, written in Chrome trace-event format
+// (chrome://tracing, Perfetto).
+//
+// Each thread appends complete events to its own buffer, which no other
+// thread touches until write(), so recording takes no locks and shares no
+// cache lines. Besides the explicit spans below, every stats::Scope becomes
+// an event named after its phase while tracing is on.
+
+// Off by default; when off, spans cost one relaxed load
+extern std::atomic<bool> g_enabled;
+
+inline bool enabled() {
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+// Start recording; event times are relative to this call
+void start();
+
+// Steady clock in nanoseconds, the time base of record()
+uint64_t now();
+
+// Label the calling thread in the viewer (ignored while not recording)
+void setThreadName(const std::string& name);
+
+// Add one event to the calling thread's buffer, tagged with its current Item
+void record(const char* name, const char* category, uint64_t start, uint64_t duration);
+
+// Events not recorded because a thread's buffer was full
+uint64_t droppedEvents();
+
+// Write all buffers; only call while no thread is recording
+bool write(const std::string& path, std::string& error);
+
+// What the calling thread is working on until the end of the enclosing
+// block. Events recorded meanwhile carry the file and, if given, the picture
+// and mip level as arguments. Items nest, and one without a file inherits
+// the enclosing Item's. The path must outlive the Item and not change while
+// it exists (it is recorded by address).
+class Item {
+public:
+    explicit Item(const std::filesystem::path* file, int picture = -1, int mip = -1);
+    ~Item();
+
+    Item(const Item&) = delete;
+    Item& operator=(const Item&) = delete;
+
+    const std::filesystem::path* file() const { return m_file; }
+    int picture() const { return m_picture; }
+    int mip() const { return m_mip; }
+
+private:
+    bool m_active = false;
+    const std::filesystem::path* m_file;
+    int m_picture;
+    int m_mip;
+    const Item* m_parent = nullptr;
+};
+
+// One event covering the enclosing block. Spans shorter than minDuration
+// (nanoseconds) are dropped, so waits that did not block stay out of the
+// trace.
+class Span {
+public:
+    Span(const char* name, const char* category, uint64_t minDuration = 0) {
+        if (enabled()) {
+            m_name = name;
+            m_category = category;
+            m_minDuration = minDuration;
+            m_start = now();
+        }
+    }
+    ~Span() {
+        if (m_name) end();
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    const char* m_name = nullptr;
+    const char* m_category = nullptr;
+    uint64_t m_minDuration = 0;
+    uint64_t m_start = 0;
+
+    void end();
+};
+
+} // namespace trace
+} // namespace tim2
@@ -3,6 +3,8 @@
 #include <cstdint>
 #include <algorithm>
 #include <bit>
+#include <cstdio>
+#include <string_view>
 
 namespace tim2 {
 namespace utils {
@@ -126,6 +128,52 @@ inline bool isValidDimension(int dimension, int pixelFormat, int mipLevels) {
     return (dimension % requiredMultiple) == 0;
 }
 
+// Recursive worker for globMatch (pattern and path already aligned)
+inline bool globMatchFrom(std::string_view pattern, std::string_view path) {
+    while (!pattern.empty()) {
+        if (pattern.substr(0, 2) == "**") {
+            pattern.remove_prefix(2);
+            // "**/" may also match zero directories
+            if (!pattern.empty() && pattern[0] == '/' && globMatchFrom(pattern.substr(1), path)) {
+                return true;
+            }
+            for (size_t i = 0; i <= path.size(); ++i) {
+                if (globMatchFrom(pattern, path.substr(i))) return true;
+            }
+            return false;
+        }
+
+        if (pattern[0] == '*') {
+            pattern.remove_prefix(1);
+            for (size_t i = 0; i <= path.size(); ++i) {
+                if (globMatchFrom(pattern, path.substr(i))) return true;
+                if (i < path.size() && path[i] == '/') break;
+            }
+            return false;
+        }
+
+        if (path.empty()) return false;
+        if (pattern[0] == '?' ? path[0] == '/' : pattern[0] != path[0]) return false;
+        pattern.remove_prefix(1);
+        path.remove_prefix(1);
+    }
+    return path.empty();
+}
+
+// Shell-style wildcard match on '/'-separated paths:
+//   ?   any single character except '/'
+//   *   any run of characters except '/'
+//   **  any run of characters, including '/'
+// A pattern without '/' is matched against the last path component only,
+// so "*.bin" matches "a/b/c.bin".
+inline bool globMatch(std::string_view pattern, std::string_view path) {
+    if (pattern.find('/') == std::string_view::npos) {
+        const size_t slash = path.rfind('/');
+        if (slash != std::string_view::npos) path.remove_prefix(slash + 1);
+    }
+    return globMatchFrom(pattern, path);
+}
+
 // Debug output helper
 inline void hexDump(const uint8_t* data, size_t size, size_t bytesPerLine = 16) {
     for (size_t i = 0; i < size; i += bytesPerLine) {
@@ -0,0 +1,631 @@
+// tim2batchbench - end-to-end batch throughput benchmark.
+//
+// Generates a corpus with TIM2Generator (or uses an existing directory) and
+// runs the batch engine over it in every combination of the requested cache
+// states, output formats and worker counts. Each scenario is repeated; the
+// median run's files/s, MB/s, peak RSS and per-phase times (the --stats
+// phases) are written to a JSON results file. Compare mode checks a results
+// file against a stored baseline and fails if a scenario lost more
+// throughput, or grew its peak RSS by more, than a threshold.
+
+#include "alloc_stats.h"
+#include "batch_processor.h"
+#include "phase_stats.h"
+#include "tim2_generator.h"
+#include "json_writer.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace tim2;
+namespace fs = std::filesystem;
+
+namespace {
+
+struct BenchOptions {
+    fs::path corpusDir;             // Existing corpus; empty = generate one
+    fs::path workDir = fs::temp_directory_path() / "tim2batchbench";
+    size_t count = 200;
+    uint64_t seed = 1;
+    std::vector<std::string> caches = {"warm", "cold"};
+    std::vector<std::string> formats = {"bmp", "png"};
+    std::vector<size_t> threads = {1, std::max<size_t>(1, std::thread::hardware_concurrency())};
+    size_t reps = 3;
+    std::string jsonPath = "batchbench.json";
+    std::string baselinePath;       // Compare with this after running
+    double threshold = 5.0;         // Percent
+    bool keep = false;
+};
+
+struct ScenarioResult {
+    std::string name;
+    std::string cache;
+    std::string format;
+    size_t threads = 0;
+    double seconds = 0;             // Median run
+    double bestSeconds = 0;
+    uint64_t outputBytes = 0;
+    uint64_t peakRssBytes = 0;
+    stats::Report phases{};
+};
+
+struct Corpus {
+    std::vector<fs::path> files;
+    uint64_t bytes = 0;
+};
+
+// Discards the batch's per-file console output
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+};
+
+std::vector<std::string> splitList(const std::string& text) {
+    std::vector<std::string> items;
+    std::stringstream list(text);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+// Best effort: ask the kernel to drop a file's cached pages. Dirty pages
+// cannot be dropped, so the data is flushed first.
+void evictFromCache(const fs::path& file) {
+#ifdef __linux__
+    const int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+#else
+    (void)file;
+#endif
+}
+
+bool prepareCorpus(const BenchOptions& options, Corpus& corpus) {
+    fs::path dir = options.corpusDir;
+    if (dir.empty()) {
+        dir = options.workDir / "corpus";
+        std::error_code ec;
+        fs::remove_all(dir, ec);
+        fs::create_directories(dir, ec);
+        if (ec) {
+            std::cerr << "Error: Cannot create " << dir.string() << ": " << ec.message() << "\n";
+            return false;
+        }
+
+        for (size_t i = 0; i < options.count; ++i) {
+            const auto data = TIM2Generator::corpusFile(options.seed, i, CorpusParams{});
+            std::ostringstream name;
+            name << "gen_" << std::setw(5) << std::setfill('0') << i << ".tm2";
+            std::ofstream out(dir / name.str(), std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+            if (!out) {
+                std::cerr << "Error: Failed to write corpus file " << name.str() << "\n";
+                return false;
+            }
+        }
+    }
+
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_regular_file() && BatchProcessor::hasTIM2Extension(it->path())) {
+            corpus.files.push_back(it->path());
+            corpus.bytes += it->file_size();
+        }
+    }
+    if (corpus.files.empty()) {
+        std::cerr << "Error: No TIM2 files in " << dir.string() << "\n";
+        return false;
+    }
+    return true;
+}
+
+uint64_t directoryImageBytes(const fs::path& dir) {
+    uint64_t bytes = 0;
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        const auto ext = it->path().extension();
+        if (it->is_regular_file() && (ext == ".bmp" || ext == ".png")) bytes += it->file_size();
+    }
+    return bytes;
+}
+
+stats::Report difference(const stats::Report& after, const stats::Report& before) {
+    stats::Report delta{};
+    for (size_t p = 0; p < stats::kPhaseCount; ++p) {
+        delta[p].calls = after[p].calls - before[p].calls;
+        delta[p].wallNanos = after[p].wallNanos - before[p].wallNanos;
+        delta[p].cpuNanos = after[p].cpuNanos - before[p].cpuNanos;
+    }
+    return delta;
+}
+
+struct RunResult {
+    double seconds = 0;
+    uint64_t outputBytes = 0;
+    uint64_t peakRssBytes = 0;
+    stats::Report phases{};
+};
+
+bool runOnce(const BenchOptions& options, const Corpus& corpus, const fs::path& input,
+             const std::string& cache, const std::string& format, size_t threads, RunResult& result) {
+    const fs::path output = options.workDir / "out";
+    std::error_code ec;
+    fs::remove_all(output, ec);
+
+    if (cache == "cold") {
+        for (const auto& file : corpus.files) evictFromCache(file);
+    }
+
+    BatchOptions batch;
+    batch.inputPath = input.string();
+    batch.outputFolder = output.string();
+    batch.format = format;
+    batch.threads = threads;
+
+    alloc::resetPeakRss();
+    const stats::Report before = stats::collect();
+
+    NullBuffer null;
+    std::streambuf* console = std::cout.rdbuf(&null);
+    const auto start = std::chrono::steady_clock::now();
+    const int exitCode = BatchProcessor(batch).run();
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    std::cout.rdbuf(console);
+
+    if (exitCode != 0) {
+        std::cerr << "Error: Batch run failed (exit code " << exitCode << ")\n";
+        return false;
+    }
+
+    result.seconds = std::chrono::duration<double>(elapsed).count();
+    result.peakRssBytes = alloc::peakRssBytes();
+    result.phases = difference(stats::collect(), before);
+    result.outputBytes = directoryImageBytes(output);
+    return true;
+}
+
+bool runScenario(const BenchOptions& options, const Corpus& corpus, const fs::path& input,
+                 const std::string& cache, const std::string& format, size_t threads,
+                 ScenarioResult& scenario) {
+    scenario.cache = cache;
+    scenario.format = format;
+    scenario.threads = threads;
+    scenario.name = cache + "-" + format + "-t" + std::to_string(threads);
+
+    // A warm scenario starts from a cache the previous run has filled
+    RunResult warmup;
+    if (cache == "warm" && !runOnce(options, corpus, input, cache, format, threads, warmup)) {
+        return false;
+    }
+
+    std::vector<RunResult> runs(options.reps);
+    for (auto& run : runs) {
+        if (!runOnce(options, corpus, input, cache, format, threads, run)) return false;
+    }
+
+    std::sort(runs.begin(), runs.end(), [](const RunResult& a, const RunResult& b) { return a.seconds < b.seconds; });
+    const RunResult& median = runs[runs.size() / 2];
+    scenario.seconds = median.seconds;
+    scenario.bestSeconds = runs.front().seconds;
+    scenario.outputBytes = median.outputBytes;
+    scenario.peakRssBytes = median.peakRssBytes;
+    scenario.phases = median.phases;
+    return true;
+}
+
+std::string resultsJson(const BenchOptions& options, const Corpus& corpus, const std::vector<ScenarioResult>& results) {
+    JsonWriter json;
+    json.beginObject()
+        .field("version", TIM2DUMP_VERSION)
+        .field("hardwareThreads", std::thread::hardware_concurrency())
+        .field("reps", options.reps)
+        .key("corpus").beginObject()
+            .field("generated", options.corpusDir.empty());
+    if (options.corpusDir.empty()) {
+        json.field("seed", options.seed).field("count", options.count);
+    } else {
+        json.field("path", std::string_view(options.corpusDir.string()));
+    }
+    json.field("files", corpus.files.size())
+        .field("bytes", corpus.bytes)
+        .endObject()
+        .key("scenarios").beginArray();
+
+    const double files = static_cast<double>(corpus.files.size());
+    const double megabytes = static_cast<double>(corpus.bytes) / (1024.0 * 1024.0);
+    for (const ScenarioResult& r : results) {
+        json.beginObject()
+            .field("name", std::string_view(r.name))
+            .field("cache", std::string_view(r.cache))
+            .field("format", std::string_view(r.format))
+            .field("threads", r.threads)
+            .field("seconds", r.seconds)
+            .field("bestSeconds", r.bestSeconds)
+            .field("filesPerSecond", files / r.seconds)
+            .field("mbPerSecond", megabytes / r.seconds)
+            .field("outputBytes", r.outputBytes)
+            .field("peakRssBytes", r.peakRssBytes)
+            .key("phases").beginObject();
+        for (size_t p = 0; p < stats::kPhaseCount; ++p) {
+            json.key(stats::phaseName(static_cast<stats::Phase>(p))).beginObject()
+                .field("calls", r.phases[p].calls)
+                .field("wallSeconds", r.phases[p].wallNanos / 1e9)
+                .field("cpuSeconds", r.phases[p].cpuNanos / 1e9)
+                .endObject();
+        }
+        json.endObject().endObject();
+    }
+    json.endArray().endObject();
+    return json.str();
+}
+
+// Just enough JSON to read results files back for compare mode
+struct JsonValue {
+    enum class Type { Null, Bool, Number, String, Array, Object };
+    Type type = Type::Null;
+    double number = 0;
+    std::string text;
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    const JsonValue* find(std::string_view key) const {
+        for (const auto& [name, value] : members) {
+            if (name == key) return &value;
+        }
+        return nullptr;
+    }
+
+    double numberAt(std::string_view key) const {
+        const JsonValue* value = find(key);
+        return value && value->type == Type::Number ? value->number : 0;
+    }
+};
+
+class JsonReader {
+public:
+    explicit JsonReader(const std::string& text) : m_text(text) {}
+
+    bool parse(JsonValue& value) {
+        return parseValue(value) && (skipSpace(), m_pos == m_text.size());
+    }
+
+private:
+    const std::string& m_text;
+    size_t m_pos = 0;
+
+    void skipSpace() {
+        while (m_pos < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_pos]))) m_pos++;
+    }
+
+    bool consume(char c) {
+        skipSpace();
+        if (m_pos < m_text.size() && m_text[m_pos] == c) {
+            m_pos++;
+            return true;
+        }
+        return false;
+    }
+
+    bool parseString(std::string& out) {
+        if (!consume('"')) return false;
+        while (m_pos < m_text.size() && m_text[m_pos] != '"') {
+            char c = m_text[m_pos++];
+            if (c == '\\' && m_pos < m_text.size()) {
+                c = m_text[m_pos++];
+                if (c == 'n') c = '\n';
+                else if (c == 't') c = '\t';
+                else if (c == 'r') c = '\r';
+                else if (c == 'u') {
+                    m_pos += 4;  // Only control characters are escaped this way
+                    c = '?';
+                }
+            }
+            out += c;
+        }
+        return consume('"');
+    }
+
+    bool parseValue(JsonValue& value) {
+        skipSpace();
+        if (m_pos >= m_text.size()) return false;
+        const char c = m_text[m_pos];
+
+        if (c == '{') {
+            value.type = JsonValue::Type::Object;
+            m_pos++;
+            if (consume('}')) return true;
+            do {
+                std::string name;
+                JsonValue member;
+                if (!parseString(name) || !consume(':') || !parseValue(member)) return false;
+                value.members.emplace_back(std::move(name), std::move(member));
+            } while (consume(','));
+            return consume('}');
+        }
+        if (c == '[') {
+            value.type = JsonValue::Type::Array;
+            m_pos++;
+            if (consume(']')) return true;
+            do {
+                JsonValue item;
+                if (!parseValue(item)) return false;
+                value.items.push_back(std::move(item));
+            } while (consume(','));
+            return consume(']');
+        }
+        if (c == '"') {
+            value.type = JsonValue::Type::String;
+            return parseString(value.text);
+        }
+        for (const char* word : {"true", "false", "null"}) {
+            if (m_text.compare(m_pos, std::strlen(word), word) == 0) {
+                value.type = word[0] == 'n' ? JsonValue::Type::Null : JsonValue::Type::Bool;
+                value.number = word[0] == 't' ? 1 : 0;
+                m_pos += std::strlen(word);
+                return true;
+            }
+        }
+
+        const char* begin = m_text.c_str() + m_pos;
+        char* end = nullptr;
+        value.type = JsonValue::Type::Number;
+        value.number = std::strtod(begin, &end);
+        if (end == begin) return false;
+        m_pos += static_cast<size_t>(end - begin);
+        return true;
+    }
+};
+
+bool loadResults(const std::string& path, JsonValue& results) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Error: Cannot open " << path << "\n";
+        return false;
+    }
+    std::stringstream text;
+    text << in.rdbuf();
+    if (!JsonReader(text.str()).parse(results) || !results.find("scenarios")) {
+        std::cerr << "Error: " << path << " is not a tim2batchbench results file\n";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Match scenarios by name and compare throughput and peak RSS. A scenario
+ * regresses when files/s drops, or peak RSS grows, by more than threshold
+ * percent. Phase times are shown for the biggest movers but not judged:
+ * they shift between phases too easily to be a pass/fail criterion.
+ */
+int compareResults(const std::string& baselinePath, const std::string& currentPath, double threshold) {
+    JsonValue baseline, current;
+    if (!loadResults(baselinePath, baseline) || !loadResults(currentPath, current)) return 1;
+
+    std::cout << "Comparing " << currentPath << " against baseline " << baselinePath
+              << " (threshold " << threshold << "%)\n\n";
+    std::cout << std::left << std::setw(22) << "Scenario" << std::right
+              << std::setw(12) << "files/s" << std::setw(10) << "change"
+              << std::setw(12) << "peak MB" << std::setw(10) << "change" << "  Result\n";
+    std::cout << std::string(78, '-') << "\n";
+
+    size_t regressions = 0;
+    size_t compared = 0;
+    for (const JsonValue& scenario : current.find("scenarios")->items) {
+        const JsonValue* name = scenario.find("name");
+        if (!name) continue;
+
+        const JsonValue* base = nullptr;
+        for (const JsonValue& candidate : baseline.find("scenarios")->items) {
+            const JsonValue* candidateName = candidate.find("name");
+            if (candidateName && candidateName->text == name->text) base = &candidate;
+        }
+        if (!base) {
+            std::cout << std::left << std::setw(22) << name->text << "  (not in baseline)\n";
+            continue;
+        }
+        compared++;
+
+        const double rate = scenario.numberAt("filesPerSecond");
+        const double baseRate = base->numberAt("filesPerSecond");
+        const double rss = scenario.numberAt("peakRssBytes");
+        const double baseRss = base->numberAt("peakRssBytes");
+        const double rateChange = baseRate > 0 ? (rate / baseRate - 1) * 100 : 0;
+        const double rssChange = baseRss > 0 ? (rss / baseRss - 1) * 100 : 0;
+
+        const bool slower = rateChange < -threshold;
+        const bool bigger = rssChange > threshold;
+        if (slower || bigger) regressions++;
+
+        std::cout << std::left << std::setw(22) << name->text << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(12) << rate
+                  << std::setw(9) << std::showpos << rateChange << "%" << std::noshowpos
+                  << std::setw(12) << rss / (1024 * 1024)
+                  << std::setw(9) << std::showpos << rssChange << "%" << std::noshowpos << "  "
+                  << (slower && bigger ? "REGRESSION (throughput, memory)"
+                      : slower         ? "REGRESSION (throughput)"
+                      : bigger         ? "REGRESSION (memory)"
+                                       : "ok")
+                  << "\n";
+
+        if (slower) {
+            // Point at the phase whose wall time grew the most
+            const JsonValue* phases = scenario.find("phases");
+            const JsonValue* basePhases = base->find("phases");
+            std::string worst;
+            double worstGrowth = 0;
+            for (size_t i = 0; phases && basePhases && i < phases->members.size(); ++i) {
+                const auto& [phase, value] = phases->members[i];
+                const JsonValue* old = basePhases->find(phase);
+                const double growth = value.numberAt("wallSeconds") - (old ? old->numberAt("wallSeconds") : 0);
+                if (growth > worstGrowth) {
+                    worstGrowth = growth;
+                    worst = phase;
+                }
+            }
+            if (!worst.empty()) {
+                std::cout << "    largest phase increase: " << worst << " +" << std::setprecision(3)
+                          << worstGrowth * 1000 << " ms wall\n";
+            }
+        }
+    }
+
+    std::cout << "\n" << compared << " scenario(s) compared, " << regressions << " regression(s)\n";
+    return regressions > 0 ? 1 : 0;
+}
+
+void printUsage(const char* programName) {
+    std::cout << "Usage: " << programName << " [options]\n";
+    std::cout << "       " << programName << " --compare <baseline.json> <results.json> [--threshold <pct>]\n\n";
+    std::cout << "Options:\n";
+    std::cout << "  --corpus <dir>        Benchmark an existing directory instead of a generated corpus\n";
+    std::cout << "  -n, --count <n>       Files to generate (default: 200)\n";
+    std::cout << "  --seed <n>            Corpus seed (default: 1)\n";
+    std::cout << "  --cache <list>        Cache states: warm, cold (default: warm,cold)\n";
+    std::cout << "  --formats <list>      Output formats: bmp, png (default: bmp,png)\n";
+    std::cout << "  --threads <list>      Worker counts (default: 1,<hardware threads>)\n";
+    std::cout << "  --reps <n>            Measured runs per scenario, median reported (default: 3)\n";
+    std::cout << "  --work <dir>          Scratch directory (default: <temp>/tim2batchbench)\n";
+    std::cout << "  --keep                Keep the scratch directory afterwards\n";
+    std::cout << "  --json <file>         Results file (default: batchbench.json)\n";
+    std::cout << "  --baseline <file>     Compare the results with this baseline afterwards\n";
+    std::cout << "  --threshold <pct>     Regression threshold in percent (default: 5)\n";
+}
+
+bool parseArguments(int argc, char* argv[], BenchOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--corpus" && hasValue) {
+            options.corpusDir = argv[++i];
+        } else if ((arg == "-n" || arg == "--count") && hasValue) {
+            options.count = std::stoul(argv[++i]);
+        } else if (arg == "--seed" && hasValue) {
+            options.seed = std::stoull(argv[++i]);
+        } else if (arg == "--cache" && hasValue) {
+            options.caches = splitList(argv[++i]);
+            for (const auto& cache : options.caches) {
+                if (cache != "warm" && cache != "cold") return false;
+            }
+        } else if (arg == "--formats" && hasValue) {
+            options.formats = splitList(argv[++i]);
+            for (const auto& format : options.formats) {
+                if (format != "bmp" && format != "png") return false;
+            }
+        } else if (arg == "--threads" && hasValue) {
+            options.threads.clear();
+            for (const auto& item : splitList(argv[++i])) {
+                options.threads.push_back(std::max<size_t>(1, std::stoul(item)));
+            }
+        } else if (arg == "--reps" && hasValue) {
+            options.reps = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if (arg == "--work" && hasValue) {
+            options.workDir = argv[++i];
+        } else if (arg == "--keep") {
+            options.keep = true;
+        } else if (arg == "--json" && hasValue) {
+            options.jsonPath = argv[++i];
+        } else if (arg == "--baseline" && hasValue) {
+            options.baselinePath = argv[++i];
+        } else if (arg == "--threshold" && hasValue) {
+            options.threshold = std::stod(argv[++i]);
+        } else {
+            return false;
+        }
+    }
+    return !options.caches.empty() && !options.formats.empty() && !options.threads.empty();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    try {
+        if (argc >= 4 && std::string(argv[1]) == "--compare") {
+            if (argc == 6 && std::string(argv[4]) == "--threshold") options.threshold = std::stod(argv[5]);
+            else if (argc != 4) throw std::invalid_argument("compare");
+            return compareResults(argv[2], argv[3], options.threshold);
+        }
+        if (!parseArguments(argc, argv, options)) {
+            printUsage(argv[0]);
+            return 1;
+        }
+    } catch (const std::exception&) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    Corpus corpus;
+    if (!prepareCorpus(options, corpus)) return 1;
+    const fs::path input = options.corpusDir.empty() ? options.workDir / "corpus" : options.corpusDir;
+
+    std::cout << "Corpus: " << corpus.files.size() << " files, " << std::fixed << std::setprecision(1)
+              << corpus.bytes / (1024.0 * 1024.0) << " MB"
+              << (options.corpusDir.empty() ? " (generated, seed " + std::to_string(options.seed) + ")" : "")
+              << "\n";
+    if (!alloc::resetPeakRss()) {
+        std::cout << "Note: peak RSS cannot be reset on this platform; it is the process peak so far\n";
+    }
+    std::cout << "\n" << std::left << std::setw(22) << "Scenario" << std::right << std::setw(10) << "seconds"
+              << std::setw(10) << "files/s" << std::setw(10) << "MB/s" << std::setw(10) << "peak MB" << "\n";
+    std::cout << std::string(62, '-') << "\n";
+
+    stats::enable(true);
+    std::vector<ScenarioResult> results;
+    for (const auto& cache : options.caches) {
+        for (const auto& format : options.formats) {
+            for (size_t threads : options.threads) {
+                ScenarioResult result;
+                if (!runScenario(options, corpus, input, cache, format, threads, result)) return 1;
+
+                std::cout << std::left << std::setw(22) << result.name << std::right << std::fixed
+                          << std::setprecision(3) << std::setw(10) << result.seconds << std::setprecision(1)
+                          << std::setw(10) << corpus.files.size() / result.seconds
+                          << std::setw(10) << corpus.bytes / (1024.0 * 1024.0) / result.seconds
+                          << std::setw(10) << result.peakRssBytes / (1024.0 * 1024.0) << "\n";
+                results.push_back(std::move(result));
+            }
+        }
+    }
+
+    if (!options.keep) {
+        // Only what this tool created: the work directory may be shared
+        std::error_code ec;
+        fs::remove_all(options.workDir / "out", ec);
+        if (options.corpusDir.empty()) fs::remove_all(options.workDir / "corpus", ec);
+        fs::remove(options.workDir, ec);  // If now empty
+    }
+
+    std::ofstream out(options.jsonPath, std::ios::trunc);
+    if (!(out << resultsJson(options, corpus, results) << "\n")) {
+        std::cerr << "Error: Cannot write " << options.jsonPath << "\n";
+        return 1;
+    }
+    out.close();
+    std::cout << "\nResults written to " << options.jsonPath << "\n";
+
+    if (!options.baselinePath.empty()) {
+        std::cout << "\n";
+        return compareResults(options.baselinePath, options.jsonPath, options.threshold);
+    }
+    return 0;
+}
@@ -0,0 +1,411 @@
+// tim2bench - micro-benchmarks for the TIM2 decode and CLUT kernels.
+//
+// Builds pictures in memory for every image format, CLUT format and CLUT
+// storage mode, at several sizes, and times Picture::decodeImage(), banded
+// Picture::decodeRows() and Picture::getClutColors() on them. Each
+// measurement runs warmup iterations, then several repetitions of at least
+// --min-time each; the median repetition is reported as pixels per second
+// and cycles per pixel.
+
+#include "tim2_parser.h"
+#include "perf_counters.h"
+#include "json_writer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define TIM2BENCH_HAVE_TSC 1
+#endif
+
+using namespace tim2;
+
+namespace {
+
+struct BenchOptions {
+    std::string filter;             // Only run cases whose name contains this
+    std::vector<size_t> sizes = {64, 256, 1024};
+    size_t reps = 5;
+    size_t warmup = 2;
+    double minSeconds = 0.05;       // Per repetition
+    size_t bandPixels = 1 << 16;    // Band size for the decodeRows kernel
+    std::string jsonPath;
+};
+
+// The instruction set the decoder was compiled for. There is no runtime
+// dispatch in the decoder, so this is the only level there is to measure.
+const char* compiledIsa() {
+#if defined(__AVX512F__)
+    return "avx512";
+#elif defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE4_2__)
+    return "sse4.2";
+#elif defined(__x86_64__) || defined(_M_X64)
+    return "x86-64";
+#elif defined(__ARM_NEON)
+    return "neon";
+#else
+    return "generic";
+#endif
+}
+
+enum class CycleSource { None, Perf, Tsc };
+
+CycleSource g_cycleSource = CycleSource::None;
+
+uint64_t readCycles() {
+    if (g_cycleSource == CycleSource::Perf) {
+        perf::Values values;
+        return perf::read(values) ? values[static_cast<size_t>(perf::Counter::Cycles)] : 0;
+    }
+#ifdef TIM2BENCH_HAVE_TSC
+    if (g_cycleSource == CycleSource::Tsc) return __rdtsc();
+#endif
+    return 0;
+}
+
+// A picture shape to generate: formats, CLUT mode and size
+struct PictureSpec {
+    PixelFormat imageFormat;
+    PixelFormat clutFormat = TIM2_NONE;
+    uint8_t clutMode = CLUT_CSM1;   // CLUT_CSM1 or CLUT_CSM2
+    bool compound = false;          // CSM1 only
+    size_t size = 256;              // Width and height
+    size_t mipLevels = 1;
+
+    std::string name() const {
+        std::string text = pixelFormatToString(imageFormat);
+        text = text.substr(0, text.find(' '));
+        if (clutFormat != TIM2_NONE) {
+            text += "/" + pixelFormatToString(clutFormat);
+            text += clutMode == CLUT_CSM2 ? "/csm2" : compound ? "/csm1c" : "/csm1";
+        }
+        return text;
+    }
+};
+
+size_t bytesForPixels(PixelFormat format, size_t pixels) {
+    switch (format) {
+        case TIM2_RGB16:  return pixels * 2;
+        case TIM2_RGB24:  return pixels * 3;
+        case TIM2_RGB32:  return pixels * 4;
+        case TIM2_IDTEX4: return (pixels + 1) / 2;
+        case TIM2_IDTEX8: return pixels;
+        default:          return 0;
+    }
+}
+
+// Random image and CLUT bytes in the layout the parser would produce
+Picture makePicture(const PictureSpec& spec, std::mt19937& random) {
+    Picture pic{};
+    PictureHeader& h = pic.header;
+    h.imageType = spec.imageFormat;
+    h.imageWidth = static_cast<uint16_t>(spec.size);
+    h.imageHeight = static_cast<uint16_t>(spec.size);
+    h.mipMapTextures = static_cast<uint8_t>(spec.mipLevels);
+
+    MipMapHeader mips{};
+    size_t imageSize = 0;
+    for (size_t level = 0; level < spec.mipLevels; ++level) {
+        const size_t side = std::max<size_t>(1, spec.size >> level);
+        const size_t bytes = (bytesForPixels(spec.imageFormat, side * side) + 15) / 16 * 16;
+        mips.sizes.push_back(static_cast<uint32_t>(bytes));
+        imageSize += bytes;
+    }
+    if (spec.mipLevels > 1) pic.mipMapHeader = mips;
+
+    h.imageSize = static_cast<uint32_t>(imageSize);
+    pic.imageData.resize(imageSize);
+    for (auto& byte : pic.imageData) byte = static_cast<uint8_t>(random());
+
+    if (spec.clutFormat != TIM2_NONE) {
+        h.clutColors = spec.imageFormat == TIM2_IDTEX4 ? 16 : 256;
+        h.clutType = static_cast<uint8_t>(spec.clutFormat | spec.clutMode | (spec.compound ? 0x40 : 0));
+        h.clutSize = static_cast<uint32_t>(bytesForPixels(spec.clutFormat, h.clutColors));
+        pic.clutData.resize(h.clutSize);
+        for (auto& byte : pic.clutData) byte = static_cast<uint8_t>(random());
+    }
+    return pic;
+}
+
+struct Result {
+    std::string kernel;
+    std::string picture;
+    size_t size = 0;
+    size_t mip = 0;
+    size_t pixels = 0;      // Per iteration
+    double seconds = 0;     // Median per iteration
+    double bestSeconds = 0; // Fastest repetition, per iteration
+    double cyclesPerPixel = -1;
+};
+
+volatile uint32_t g_sink;  // Keeps results observable
+
+// Time one kernel: warmup, then reps of at least minSeconds each
+Result measure(const BenchOptions& options, const std::function<uint32_t()>& kernel, size_t pixels) {
+    for (size_t i = 0; i < options.warmup; ++i) g_sink = kernel();
+
+    std::vector<double> perIteration;
+    std::vector<double> cyclesPerIteration;
+    for (size_t rep = 0; rep < options.reps; ++rep) {
+        size_t iterations = 0;
+        const uint64_t cyclesStart = readCycles();
+        const auto start = std::chrono::steady_clock::now();
+        double elapsed = 0;
+        do {
+            g_sink = kernel();
+            iterations++;
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        } while (elapsed < options.minSeconds);
+        // Scaled (multiplexed) perf counts can step back slightly
+        const uint64_t cyclesEnd = readCycles();
+        const uint64_t cycles = cyclesEnd > cyclesStart ? cyclesEnd - cyclesStart : 0;
+
+        perIteration.push_back(elapsed / iterations);
+        cyclesPerIteration.push_back(static_cast<double>(cycles) / iterations);
+    }
+
+    // Median by time; its cycle count goes with it
+    std::vector<size_t> order(perIteration.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return perIteration[a] < perIteration[b]; });
+    const size_t median = order[order.size() / 2];
+
+    Result result;
+    result.pixels = pixels;
+    result.seconds = perIteration[median];
+    result.bestSeconds = perIteration[order.front()];
+    if (g_cycleSource != CycleSource::None && pixels > 0) {
+        result.cyclesPerPixel = cyclesPerIteration[median] / pixels;
+    }
+    return result;
+}
+
+void printResult(const Result& r) {
+    std::ostringstream rate;
+    rate << std::fixed << std::setprecision(1) << r.pixels / r.seconds / 1e6;
+    std::ostringstream cycles;
+    if (r.cyclesPerPixel >= 0) {
+        cycles << std::fixed << std::setprecision(2) << r.cyclesPerPixel;
+    } else {
+        cycles << "-";
+    }
+
+    std::cout << std::left << std::setw(8) << r.kernel << std::setw(22) << r.picture << std::right
+              << std::setw(6) << r.size << std::setw(5) << r.mip << std::setw(10) << r.pixels
+              << std::setw(12) << std::fixed << std::setprecision(2) << r.seconds * 1e6
+              << std::setw(11) << rate.str() << std::setw(9) << cycles.str() << "\n";
+}
+
+std::vector<PictureSpec> allShapes() {
+    std::vector<PictureSpec> shapes;
+    for (PixelFormat format : {TIM2_RGB16, TIM2_RGB24, TIM2_RGB32}) {
+        shapes.push_back({format});
+    }
+    for (PixelFormat format : {TIM2_IDTEX4, TIM2_IDTEX8}) {
+        for (PixelFormat clut : {TIM2_RGB16, TIM2_RGB24, TIM2_RGB32}) {
+            shapes.push_back({format, clut, CLUT_CSM1, false});
+            // Compound order shuffles 32-entry blocks, so needs 256 colors
+            if (format == TIM2_IDTEX8) shapes.push_back({format, clut, CLUT_CSM1, true});
+            shapes.push_back({format, clut, CLUT_CSM2, false});
+        }
+    }
+    return shapes;
+}
+
+std::vector<size_t> parseSizes(const std::string& text) {
+    std::vector<size_t> sizes;
+    std::stringstream list(text);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        const size_t size = std::stoul(item);
+        if (size > 0 && size <= 65535) sizes.push_back(size);
+    }
+    return sizes;
+}
+
+void printUsage(const char* programName) {
+    std::cout << "Usage: " << programName << " [options]\n\n";
+    std::cout << "Options:\n";
+    std::cout << "  --filter <text>     Only run cases whose kernel/picture name contains text\n";
+    std::cout << "  --sizes <a,b,...>   Square picture sizes (default: 64,256,1024)\n";
+    std::cout << "  --reps <n>          Measured repetitions per case (default: 5)\n";
+    std::cout << "  --warmup <n>        Unmeasured iterations first (default: 2)\n";
+    std::cout << "  --min-time <ms>     Minimum duration of one repetition (default: 50)\n";
+    std::cout << "  --band-pixels <n>   Band size for the 'band' kernel (default: 65536)\n";
+    std::cout << "  --json <file>       Also write the results as JSON (- = stdout)\n";
+}
+
+bool parseArguments(int argc, char* argv[], BenchOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (arg == "--sizes" && i + 1 < argc) {
+            options.sizes = parseSizes(argv[++i]);
+        } else if (arg == "--reps" && i + 1 < argc) {
+            options.reps = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--warmup" && i + 1 < argc) {
+            options.warmup = std::max(0, std::stoi(argv[++i]));
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            options.minSeconds = std::max(1, std::stoi(argv[++i])) / 1000.0;
+        } else if (arg == "--band-pixels" && i + 1 < argc) {
+            options.bandPixels = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--json" && i + 1 < argc) {
+            options.jsonPath = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    return !options.sizes.empty();
+}
+
+bool writeJson(const BenchOptions& options, const std::vector<Result>& results) {
+    JsonWriter json;
+    json.beginObject()
+        .field("isa", compiledIsa())
+        .field("cycleSource", g_cycleSource == CycleSource::Perf ? "perf"
+                              : g_cycleSource == CycleSource::Tsc ? "tsc" : "none")
+        .field("reps", options.reps)
+        .field("minSeconds", options.minSeconds)
+        .key("results").beginArray();
+
+    for (const Result& r : results) {
+        json.beginObject()
+            .field("kernel", std::string_view(r.kernel))
+            .field("picture", std::string_view(r.picture))
+            .field("size", r.size)
+            .field("mip", r.mip)
+            .field("pixels", r.pixels)
+            .field("seconds", r.seconds)
+            .field("bestSeconds", r.bestSeconds)
+            .field("pixelsPerSecond", r.pixels / r.seconds);
+        if (r.cyclesPerPixel >= 0) json.field("cyclesPerPixel", r.cyclesPerPixel);
+        json.endObject();
+    }
+    json.endArray().endObject();
+
+    if (options.jsonPath == "-") {
+        std::cout << json.str() << "\n";
+        return true;
+    }
+    std::ofstream out(options.jsonPath, std::ios::trunc);
+    return static_cast<bool>(out << json.str() << "\n");
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    if (!parseArguments(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::string counterError;
+    if (perf::start(counterError) && perf::available(perf::Counter::Cycles)) {
+        g_cycleSource = CycleSource::Perf;
+    } else {
+#ifdef TIM2BENCH_HAVE_TSC
+        g_cycleSource = CycleSource::Tsc;
+#endif
+    }
+
+    std::cout << "ISA: " << compiledIsa() << " (no runtime dispatch)\n";
+    std::cout << "Cycles: "
+              << (g_cycleSource == CycleSource::Perf  ? "perf_event CPU cycles"
+                  : g_cycleSource == CycleSource::Tsc ? "TSC reference cycles (hardware counters unavailable)"
+                                                      : "unavailable")
+              << "\n";
+    std::cout << options.reps << " repetitions of at least " << options.minSeconds * 1000
+              << " ms after " << options.warmup << " warmup iteration(s); median shown\n\n";
+
+    std::cout << std::left << std::setw(8) << "Kernel" << std::setw(22) << "Picture" << std::right
+              << std::setw(6) << "Size" << std::setw(5) << "Mip" << std::setw(10) << "Pixels"
+              << std::setw(12) << "us/iter" << std::setw(11) << "Mpix/s" << std::setw(9) << "cyc/px" << "\n";
+    std::cout << std::string(83, '-') << "\n";
+
+    std::mt19937 random(12345);
+    std::vector<Result> results;
+    std::vector<Color32> buffer;
+
+    auto selected = [&](const std::string& kernel, const std::string& picture) {
+        return options.filter.empty() || (kernel + " " + picture).find(options.filter) != std::string::npos;
+    };
+    auto record = [&](Result result, const char* kernel, const PictureSpec& spec, size_t mip) {
+        result.kernel = kernel;
+        result.picture = spec.name();
+        result.size = spec.size;
+        result.mip = mip;
+        printResult(result);
+        results.push_back(std::move(result));
+    };
+
+    for (PictureSpec spec : allShapes()) {
+        // The CLUT kernel does not depend on the picture size
+        if (spec.clutFormat != TIM2_NONE && selected("clut", spec.name())) {
+            spec.size = 16;
+            const Picture pic = makePicture(spec, random);
+            const Result result = measure(options, [&pic] {
+                const auto colors = pic.getClutColors();
+                return static_cast<uint32_t>(colors.back().r);
+            }, pic.header.clutColors);
+            spec.size = 0;  // Pixels are CLUT entries here
+            record(result, "clut", spec, 0);
+        }
+
+        for (size_t size : options.sizes) {
+            spec.size = size;
+            spec.mipLevels = size >= 16 ? 3 : 1;
+            const Picture pic = makePicture(spec, random);
+
+            for (size_t mip = 0; mip < spec.mipLevels; mip += 2) {
+                const size_t width = pic.getMipMapWidth(mip);
+                const size_t height = pic.getMipMapHeight(mip);
+                const size_t pixels = width * height;
+
+                if (selected("decode", spec.name())) {
+                    const Result result = measure(options, [&pic, mip] {
+                        const auto image = pic.decodeImage(mip);
+                        return static_cast<uint32_t>(image.back().g);
+                    }, pixels);
+                    record(result, "decode", spec, mip);
+                }
+
+                if (selected("band", spec.name())) {
+                    buffer.resize(pixels);
+                    const size_t rowsPerBand = std::max<size_t>(1, options.bandPixels / width);
+                    const Result result = measure(options, [&pic, &buffer, mip, height, width, rowsPerBand] {
+                        for (size_t row = 0; row < height; row += rowsPerBand) {
+                            const size_t rows = std::min(rowsPerBand, height - row);
+                            pic.decodeRows(mip, row, rows, buffer.data() + row * width);
+                        }
+                        return static_cast<uint32_t>(buffer.back().b);
+                    }, pixels);
+                    record(result, "band", spec, mip);
+                }
+            }
+        }
+    }
+
+    if (!options.jsonPath.empty() && !writeJson(options, results)) {
+        std::cerr << "Error: Cannot write " << options.jsonPath << "\n";
+        return 1;
+    }
+    return 0;
+}
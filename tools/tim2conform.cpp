@@ -0,0 +1,399 @@
+// tim2conform - differential conformance check of the decode kernels.
+//
+// Generates randomized pictures (every pixel format, CLUT format and
+// storage mode, odd sizes, mip chains, random and truncated image data) and
+// checks that each optimized kernel produces exactly the bytes of the
+// reference decoder (reference_decoder.h) for every mip level. On a mismatch
+// the picture is shrunk while it still fails, written as a TIM2 file, and
+// the tool exits with status 1. `--file` re-runs the check on such a file,
+// or on any real TIM2 file.
+
+#include "reference_decoder.h"
+#include "tim2_generator.h"
+#include "tim2_writer.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace tim2;
+namespace fs = std::filesystem;
+
+namespace {
+
+struct ConformOptions {
+    uint64_t seed = 1;
+    size_t iterations = 1000;
+    std::optional<size_t> only;    // Run just this iteration
+    size_t maxSize = 96;
+    std::string file;              // Check this TIM2 file instead of generating
+    fs::path reproDir = ".";
+    bool verbose = false;
+};
+
+// A kernel under test: decodes one mip level the optimized way. seed drives
+// any choices the kernel makes (band boundaries), so a failure replays.
+struct Kernel {
+    const char* name;
+    std::function<std::vector<Color32>(const Picture&, size_t mip, uint64_t seed)> decode;
+};
+
+std::vector<Color32> decodeInBands(const Picture& pic, size_t mip, uint64_t seed) {
+    const size_t width = pic.getMipMapWidth(mip);
+    const size_t height = pic.getMipMapHeight(mip);
+    std::vector<Color32> pixels(width * height);
+
+    // Random band heights, including single rows and the whole level
+    TIM2Generator random(seed);
+    for (size_t row = 0; row < height;) {
+        const size_t rows = std::min(height - row, 1 + random.below(std::max<size_t>(1, height / 2)));
+        pic.decodeRows(mip, row, rows, pixels.data() + row * width);
+        row += rows;
+    }
+    return pixels;
+}
+
+// Every optimized path. A new variant (SIMD, per-ISA dispatch level) gets
+// an entry here.
+const std::vector<Kernel>& kernels() {
+    static const std::vector<Kernel> list = {
+        {"decodeImage", [](const Picture& pic, size_t mip, uint64_t) { return pic.decodeImage(mip); }},
+        {"decodeRows/bands", decodeInBands},
+        {"decodeRows/rows", [](const Picture& pic, size_t mip, uint64_t) {
+            const size_t width = pic.getMipMapWidth(mip);
+            const size_t height = pic.getMipMapHeight(mip);
+            std::vector<Color32> pixels(width * height);
+            for (size_t row = 0; row < height; ++row) {
+                pic.decodeRows(mip, row, 1, pixels.data() + row * width);
+            }
+            return pixels;
+        }},
+    };
+    return list;
+}
+
+struct Mismatch {
+    std::string kernel;
+    size_t mip = 0;
+    size_t index = 0;              // First differing pixel or CLUT entry
+    size_t expectedCount = 0;
+    size_t actualCount = 0;
+    Color32 expected;
+    Color32 actual;
+};
+
+bool sameColor(const Color32& a, const Color32& b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+bool findMismatch(const std::vector<Color32>& expected, const std::vector<Color32>& actual, Mismatch& mismatch) {
+    mismatch.expectedCount = expected.size();
+    mismatch.actualCount = actual.size();
+    const size_t common = std::min(expected.size(), actual.size());
+    for (size_t i = 0; i < common; ++i) {
+        if (!sameColor(expected[i], actual[i])) {
+            mismatch.index = i;
+            mismatch.expected = expected[i];
+            mismatch.actual = actual[i];
+            return true;
+        }
+    }
+    mismatch.index = common;
+    return expected.size() != actual.size();
+}
+
+// First failing check of a picture: the CLUT, then each kernel on each level
+bool checkPicture(const Picture& pic, uint64_t seed, Mismatch& mismatch) {
+    if (findMismatch(reference::clutColors(pic), pic.getClutColors(), mismatch)) {
+        mismatch.kernel = "getClutColors";
+        return true;
+    }
+    for (size_t mip = 0; mip < pic.header.mipMapTextures; ++mip) {
+        const std::vector<Color32> expected = reference::decodeImage(pic, mip);
+        for (const Kernel& kernel : kernels()) {
+            if (findMismatch(expected, kernel.decode(pic, mip, seed), mismatch)) {
+                mismatch.kernel = kernel.name;
+                mismatch.mip = mip;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * Random picture: a generated picture of random shape whose data is then
+ * mangled in ways real files are: raw random bytes instead of texture-like
+ * content (all indices, including ones past a short CLUT), and image or
+ * CLUT data cut short of what the header describes.
+ */
+Picture randomPicture(TIM2Generator& random, size_t maxSize) {
+    static const PixelFormat imageFormats[] = {TIM2_RGB16, TIM2_RGB24, TIM2_RGB32, TIM2_IDTEX4, TIM2_IDTEX8};
+    static const PixelFormat clutFormats[] = {TIM2_RGB16, TIM2_RGB24, TIM2_RGB32};
+
+    GeneratedPicture spec;
+    spec.imageFormat = imageFormats[random.below(5)];
+    spec.clutFormat = clutFormats[random.below(3)];
+    spec.clutMode = random.below(4) == 0 ? CLUT_CSM2 : CLUT_CSM1;
+    spec.compound = random.below(2) == 0;
+    spec.width = static_cast<uint16_t>(1 + random.below(maxSize));
+    spec.height = static_cast<uint16_t>(1 + random.below(maxSize));
+    spec.mipLevels = static_cast<uint8_t>(1 + random.below(4));
+    Picture pic = random.makePicture(spec);
+
+    if (random.below(3) == 0) {
+        for (auto& byte : pic.imageData) byte = static_cast<uint8_t>(random.next());
+    }
+    if (random.below(8) == 0 && !pic.imageData.empty()) {
+        pic.imageData.resize(random.below(pic.imageData.size()));
+    }
+    if (random.below(8) == 0) {
+        // Cut inside the top level, so rows of the level itself lie past the data
+        const size_t topLevel = (static_cast<size_t>(pic.header.imageWidth) * pic.header.imageHeight *
+                                 getBitsPerPixel(pic.header.getImagePixelFormat()) + 7) / 8;
+        const size_t limit = std::min(topLevel, pic.imageData.size());
+        if (limit > 0) pic.imageData.resize(random.below(limit));
+    }
+    if (pic.header.hasClut() && random.below(8) == 0) {
+        // Fewer colors than the indices can address
+        pic.header.clutColors = static_cast<uint16_t>(random.below(pic.header.clutColors));
+    }
+    if (pic.header.hasClut() && random.below(8) == 0 && !pic.clutData.empty()) {
+        // Fewer CLUT bytes than the header's colors need (clutSize too small)
+        pic.clutData.resize(random.below(pic.clutData.size()));
+    }
+    return pic;
+}
+
+bool stillFails(const Picture& pic, uint64_t seed, const Mismatch& original, Mismatch& mismatch) {
+    return checkPicture(pic, seed, mismatch) && mismatch.kernel == original.kernel;
+}
+
+/**
+ * Make a failing picture as small as possible while the same kernel still
+ * fails: drop mip levels after the failing one, crop a single-level picture
+ * to the rows up to the failing pixel, and drop the user data.
+ */
+Picture shrink(Picture pic, uint64_t seed, Mismatch& mismatch) {
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        Mismatch candidateMismatch;
+
+        if (mismatch.mip + 1 < pic.header.mipMapTextures && pic.mipMapHeader) {
+            Picture candidate = pic;
+            const size_t levels = mismatch.mip + 1;
+            candidate.header.mipMapTextures = static_cast<uint8_t>(levels);
+            candidate.mipMapHeader->sizes.resize(levels);
+            size_t bytes = 0;
+            for (uint32_t size : candidate.mipMapHeader->sizes) bytes += size;
+            if (candidate.imageData.size() > bytes) candidate.imageData.resize(bytes);
+            if (levels == 1) candidate.mipMapHeader.reset();
+
+            if (stillFails(candidate, seed, mismatch, candidateMismatch)) {
+                pic = std::move(candidate);
+                mismatch = candidateMismatch;
+                progress = true;
+                continue;
+            }
+        }
+
+        const size_t width = pic.getMipMapWidth(0);
+        const size_t row = width > 0 ? mismatch.index / width : 0;
+        if (mismatch.kernel != "getClutColors" && pic.header.mipMapTextures == 1 &&
+            row + 1 < pic.header.imageHeight) {
+            Picture candidate = pic;
+            candidate.header.imageHeight = static_cast<uint16_t>(row + 1);
+            const size_t bytes = (getBitsPerPixel(pic.header.getImagePixelFormat()) * width * (row + 1) + 7) / 8;
+            if (candidate.imageData.size() > bytes) candidate.imageData.resize(bytes);
+
+            if (stillFails(candidate, seed, mismatch, candidateMismatch)) {
+                pic = std::move(candidate);
+                mismatch = candidateMismatch;
+                progress = true;
+                continue;
+            }
+        }
+
+        if (!pic.userData.empty()) {
+            Picture candidate = pic;
+            candidate.userData.clear();
+            candidate.extHeader.reset();
+            candidate.comment.clear();
+            if (stillFails(candidate, seed, mismatch, candidateMismatch)) {
+                pic = std::move(candidate);
+                mismatch = candidateMismatch;
+                progress = true;
+            }
+        }
+    }
+    return pic;
+}
+
+std::string describe(const Picture& pic) {
+    std::ostringstream text;
+    const PictureHeader& h = pic.header;
+    text << pixelFormatToString(h.getImagePixelFormat()) << " " << h.imageWidth << "x" << h.imageHeight
+         << ", " << static_cast<int>(h.mipMapTextures) << " level(s), " << pic.imageData.size() << " image bytes";
+    if (h.hasClut()) {
+        text << ", CLUT " << pixelFormatToString(h.getClutPixelFormat()) << " x" << h.clutColors
+             << (h.isClutCSM2() ? " CSM2" : h.isClutCompound() ? " CSM1 compound" : " CSM1");
+    }
+    return text.str();
+}
+
+std::string colorText(const Color32& c) {
+    std::ostringstream text;
+    text << "(" << int(c.r) << "," << int(c.g) << "," << int(c.b) << "," << int(c.a) << ")";
+    return text.str();
+}
+
+void reportMismatch(const Picture& pic, const Mismatch& mismatch) {
+    std::cerr << "MISMATCH in " << mismatch.kernel;
+    if (mismatch.kernel != "getClutColors") {
+        const size_t width = pic.getMipMapWidth(mismatch.mip);
+        std::cerr << ", mip " << mismatch.mip << ", pixel (" << mismatch.index % width << ", "
+                  << mismatch.index / width << ")";
+    } else {
+        std::cerr << ", entry " << mismatch.index;
+    }
+    std::cerr << "\n  picture:   " << describe(pic) << "\n";
+    if (mismatch.expectedCount != mismatch.actualCount && mismatch.index >= std::min(mismatch.expectedCount, mismatch.actualCount)) {
+        std::cerr << "  expected " << mismatch.expectedCount << " values, got " << mismatch.actualCount << "\n";
+    } else {
+        std::cerr << "  reference: " << colorText(mismatch.expected) << "\n"
+                  << "  kernel:    " << colorText(mismatch.actual) << "\n";
+    }
+}
+
+bool writeRepro(const ConformOptions& options, const Picture& pic, const std::string& name, std::string& path) {
+    std::error_code ec;
+    fs::create_directories(options.reproDir, ec);
+    path = (options.reproDir / name).string();
+
+    std::string error;
+    if (!TIM2Writer::writeFile(path, {pic}, TIM2_ALIGN_16, error)) {
+        std::cerr << "Error: " << error << "\n";
+        return false;
+    }
+    return true;
+}
+
+int checkFile(const ConformOptions& options) {
+    TIM2Parser parser;
+    if (!parser.loadFile(options.file)) {
+        std::cerr << "Error: " << options.file << ": " << parser.getLastError() << "\n";
+        return 1;
+    }
+
+    for (size_t i = 0; i < parser.getPictureCount(); ++i) {
+        Mismatch mismatch;
+        if (checkPicture(*parser.getPicture(i), options.seed, mismatch)) {
+            std::cerr << options.file << ", picture " << i << ": ";
+            reportMismatch(*parser.getPicture(i), mismatch);
+            return 1;
+        }
+    }
+    std::cout << options.file << ": " << parser.getPictureCount() << " picture(s) match the reference decoder\n";
+    return 0;
+}
+
+void printUsage(const char* programName) {
+    std::cout << "Usage: " << programName << " [options]\n\n";
+    std::cout << "Options:\n";
+    std::cout << "  --seed <n>            Seed of the random pictures (default: 1)\n";
+    std::cout << "  --iterations <n>      Random pictures to check (default: 1000)\n";
+    std::cout << "  --iteration <i>       Check only picture i (to replay a failure)\n";
+    std::cout << "  --max-size <n>        Largest picture side (default: 96)\n";
+    std::cout << "  --repro-dir <dir>     Where to write failing pictures (default: .)\n";
+    std::cout << "  --file <file>         Check every picture of a TIM2 file instead\n";
+    std::cout << "  -v, --verbose         List every picture checked\n";
+}
+
+bool parseArguments(int argc, char* argv[], ConformOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--seed" && hasValue) {
+            options.seed = std::stoull(argv[++i]);
+        } else if (arg == "--iterations" && hasValue) {
+            options.iterations = std::stoul(argv[++i]);
+        } else if (arg == "--iteration" && hasValue) {
+            options.only = std::stoul(argv[++i]);
+        } else if (arg == "--max-size" && hasValue) {
+            options.maxSize = std::clamp<size_t>(std::stoul(argv[++i]), 1, 4096);
+        } else if (arg == "--repro-dir" && hasValue) {
+            options.reproDir = argv[++i];
+        } else if (arg == "--file" && hasValue) {
+            options.file = argv[++i];
+        } else if (arg == "-v" || arg == "--verbose") {
+            options.verbose = true;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    ConformOptions options;
+    try {
+        if (!parseArguments(argc, argv, options)) {
+            printUsage(argv[0]);
+            return 1;
+        }
+    } catch (const std::exception&) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (!options.file.empty()) return checkFile(options);
+
+    const size_t first = options.only.value_or(0);
+    const size_t last = options.only ? first + 1 : options.iterations;
+    uint64_t pixels = 0;
+
+    for (size_t iteration = first; iteration < last; ++iteration) {
+        const uint64_t seed = options.seed ^ (iteration * 0x9E3779B97F4A7C15ull);
+        TIM2Generator random(seed);
+        const Picture pic = randomPicture(random, options.maxSize);
+        if (options.verbose) std::cout << iteration << ": " << describe(pic) << "\n";
+
+        Mismatch mismatch;
+        if (!checkPicture(pic, seed, mismatch)) {
+            for (size_t mip = 0; mip < pic.header.mipMapTextures; ++mip) {
+                pixels += pic.getMipMapWidth(mip) * pic.getMipMapHeight(mip);
+            }
+            continue;
+        }
+
+        std::cerr << "Iteration " << iteration << " (seed " << options.seed << "): ";
+        reportMismatch(pic, mismatch);
+
+        const Picture minimal = shrink(pic, seed, mismatch);
+        std::cerr << "\nMinimal failing picture:\n";
+        reportMismatch(minimal, mismatch);
+
+        std::string path;
+        const std::string name = "conform_" + std::to_string(options.seed) + "_" + std::to_string(iteration) + ".tm2";
+        if (writeRepro(options, minimal, name, path)) {
+            std::cerr << "\nWritten to " << path << "\n"
+                      << "Replay: " << argv[0] << " --seed " << options.seed << " --iteration " << iteration
+                      << "   or: " << argv[0] << " --file " << path << " --seed " << seed << "\n";
+        }
+        return 1;
+    }
+
+    std::cout << (last - first) << " random picture(s), " << pixels << " pixels x " << kernels().size()
+              << " kernel(s): all match the reference decoder\n";
+    return 0;
+}
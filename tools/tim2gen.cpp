@@ -0,0 +1,206 @@
+// tim2gen - writes a synthetic, reproducible TIM2 corpus.
+//
+// Every file is determined by the seed, its index and the fixed parameters
+// given on the command line; anything not fixed is drawn from a distribution
+// modelled on real game archives (see TIM2Generator::randomFile). The same
+// command line produces byte-identical files on every platform, so a corpus
+// can be shared as the command that made it.
+
+#include "tim2_generator.h"
+#include "tim2_writer.h"
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using namespace tim2;
+namespace fs = std::filesystem;
+
+namespace {
+
+struct GenOptions {
+    fs::path outputDir;
+    size_t count = 100;
+    uint64_t seed = 1;
+    std::string prefix = "gen";
+    bool verify = false;
+    bool quiet = false;
+    CorpusParams params;
+};
+
+bool parsePixelFormat(const std::string& text, PixelFormat& format) {
+    if (text == "rgb16") format = TIM2_RGB16;
+    else if (text == "rgb24") format = TIM2_RGB24;
+    else if (text == "rgb32") format = TIM2_RGB32;
+    else if (text == "idtex4") format = TIM2_IDTEX4;
+    else if (text == "idtex8") format = TIM2_IDTEX8;
+    else return false;
+    return true;
+}
+
+bool parseSize(const std::string& text, uint16_t& width, uint16_t& height) {
+    const size_t x = text.find('x');
+    if (x == std::string::npos) return false;
+    const unsigned long w = std::stoul(text.substr(0, x));
+    const unsigned long h = std::stoul(text.substr(x + 1));
+    if (w == 0 || h == 0 || w > 65535 || h > 65535) return false;
+    width = static_cast<uint16_t>(w);
+    height = static_cast<uint16_t>(h);
+    return true;
+}
+
+void printUsage(const char* programName) {
+    std::cout << "Usage: " << programName << " <output_dir> [options]\n\n";
+    std::cout << "Options:\n";
+    std::cout << "  -n, --count <n>       Files to generate (default: 100)\n";
+    std::cout << "  --seed <n>            Corpus seed (default: 1)\n";
+    std::cout << "  --prefix <name>       File name prefix (default: gen)\n";
+    std::cout << "  --format <fmt>        Image format: rgb16, rgb24, rgb32, idtex4, idtex8\n";
+    std::cout << "  --clut <fmt>          CLUT format: rgb16, rgb24, rgb32\n";
+    std::cout << "  --clut-mode <mode>    csm1, csm1-compound or csm2\n";
+    std::cout << "  --size <W>x<H>        Picture size\n";
+    std::cout << "  --mips <n>            Mip levels per picture (1-7)\n";
+    std::cout << "  --pictures <n>        Pictures per file\n";
+    std::cout << "  --align <16|128>      Data alignment\n";
+    std::cout << "  --user-data <bytes>   User data per picture (0 = no extended header)\n";
+    std::cout << "  --verify              Parse every file back and check it round-trips\n";
+    std::cout << "  -q, --quiet           Only print errors\n\n";
+    std::cout << "Parameters not given are drawn per picture from a distribution modelled\n";
+    std::cout << "on real texture archives.\n";
+}
+
+bool parseArguments(int argc, char* argv[], GenOptions& options) {
+    if (argc < 2 || argv[1][0] == '-') return false;
+    options.outputDir = argv[1];
+
+    for (int i = 2; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if ((arg == "-n" || arg == "--count") && hasValue) {
+            options.count = std::stoul(argv[++i]);
+        } else if (arg == "--seed" && hasValue) {
+            options.seed = std::stoull(argv[++i]);
+        } else if (arg == "--prefix" && hasValue) {
+            options.prefix = argv[++i];
+        } else if (arg == "--format" && hasValue) {
+            PixelFormat format;
+            if (!parsePixelFormat(argv[++i], format)) return false;
+            options.params.imageFormat = format;
+        } else if (arg == "--clut" && hasValue) {
+            PixelFormat format;
+            if (!parsePixelFormat(argv[++i], format) || format > TIM2_RGB32) return false;
+            options.params.clutFormat = format;
+        } else if (arg == "--clut-mode" && hasValue) {
+            const std::string mode = argv[++i];
+            if (mode == "csm1" || mode == "csm1-compound") {
+                options.params.clutMode = CLUT_CSM1;
+                options.params.compound = mode == "csm1-compound";
+            } else if (mode == "csm2") {
+                options.params.clutMode = CLUT_CSM2;
+                options.params.compound = false;
+            } else {
+                return false;
+            }
+        } else if (arg == "--size" && hasValue) {
+            uint16_t width, height;
+            if (!parseSize(argv[++i], width, height)) return false;
+            options.params.width = width;
+            options.params.height = height;
+        } else if (arg == "--mips" && hasValue) {
+            const int mips = std::stoi(argv[++i]);
+            if (mips < 1 || mips > 7) return false;
+            options.params.mipLevels = static_cast<uint8_t>(mips);
+        } else if (arg == "--pictures" && hasValue) {
+            const int pictures = std::stoi(argv[++i]);
+            if (pictures < 1 || pictures > 65535) return false;
+            options.params.pictures = static_cast<uint16_t>(pictures);
+        } else if (arg == "--align" && hasValue) {
+            const std::string align = argv[++i];
+            if (align == "16") options.params.formatId = TIM2_ALIGN_16;
+            else if (align == "128") options.params.formatId = TIM2_ALIGN_128;
+            else return false;
+        } else if (arg == "--user-data" && hasValue) {
+            options.params.userDataSize = std::stoul(argv[++i]);
+        } else if (arg == "--verify") {
+            options.verify = true;
+        } else if (arg == "-q" || arg == "--quiet") {
+            options.quiet = true;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string fileName(const GenOptions& options, size_t index) {
+    std::ostringstream name;
+    name << options.prefix << "_" << std::setw(5) << std::setfill('0') << index << ".tm2";
+    return name.str();
+}
+
+// Parse the file and serialize what was parsed: the bytes must not change
+bool roundTrips(const std::vector<uint8_t>& data, std::string& error) {
+    TIM2Parser parser;
+    if (!parser.loadFromMemory(data.data(), data.size())) {
+        error = parser.getLastError();
+        return false;
+    }
+    const auto again = TIM2Writer::serialize(parser.getPictures(), parser.getFileHeader().formatId);
+    if (again != data) {
+        error = "file does not round-trip through the parser";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    GenOptions options;
+    try {
+        if (!parseArguments(argc, argv, options)) {
+            printUsage(argv[0]);
+            return 1;
+        }
+    } catch (const std::exception&) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::error_code ec;
+    fs::create_directories(options.outputDir, ec);
+    if (ec) {
+        std::cerr << "Error: Cannot create " << options.outputDir.string() << ": " << ec.message() << "\n";
+        return 1;
+    }
+
+    uint64_t totalBytes = 0;
+    for (size_t i = 0; i < options.count; ++i) {
+        const std::vector<uint8_t> data = TIM2Generator::corpusFile(options.seed, i, options.params);
+        const fs::path path = options.outputDir / fileName(options, i);
+
+        std::string error;
+        if (options.verify && !roundTrips(data, error)) {
+            std::cerr << "Error: " << path.string() << ": " << error << "\n";
+            return 1;
+        }
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        if (!out) {
+            std::cerr << "Error: Failed to write " << path.string() << "\n";
+            return 1;
+        }
+        totalBytes += data.size();
+    }
+
+    if (!options.quiet) {
+        std::cout << "Generated " << options.count << " files (" << totalBytes << " bytes) in "
+                  << options.outputDir.string() << " with seed " << options.seed
+                  << (options.verify ? ", all verified" : "") << "\n";
+    }
+    return 0;
+}